@@ -17,12 +17,20 @@
 #define REACT_AGGREGATOR_HPP
 
 #include <list>
+#include <memory>
 
 #include "call_tree.hpp"
 #include "utils.hpp"
 
 namespace react {
 
+/*!
+ * \brief Handle of call tree which ownership is passed to aggregators
+ *
+ *  Handle can be kept, deferred or shared between several aggregators without copying the tree.
+ */
+typedef std::shared_ptr<const call_tree_t> call_tree_handle_t;
+
 /*!
  * \brief Aggregators base class. Represents call tree collector.
  */
@@ -43,6 +51,17 @@ public:
 	 * \param Call tree for aggregation
 	 */
 	virtual void aggregate(const call_tree_t &call_tree) = 0;
+
+	/*!
+	 * \brief Aggregates call tree which ownership is passed to aggregator
+	 *
+	 *  Aggregators that keep or defer call trees should override it to avoid copying.
+	 *  Default implementation falls back to aggregate(const call_tree_t &).
+	 * \param call_tree Handle of call tree for aggregation
+	 */
+	virtual void aggregate_handle(call_tree_handle_t call_tree) {
+		aggregate(*call_tree);
+	}
 };
 
 /*!
@@ -0,0 +1,263 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_ASYNC_AGGREGATOR_HPP
+#define REACT_ASYNC_AGGREGATOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "aggregator.hpp"
+#include "bounded_queue.hpp"
+
+namespace react {
+
+/*!
+ * \brief Aggregator that hands call trees over to background workers
+ *
+ *  Trees are passed through bounded lock-free queue, so serialization and I/O of wrapped
+ *  aggregator are done by worker threads instead of request thread.
+ *  Queued handles are passed on to wrapped aggregator, so sinks that keep trees don't copy them again.
+ *  If there is more than one worker, wrapped aggregator must be thread-safe.
+ */
+class async_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief What to do with call tree when queue is full
+	 */
+	enum overflow_policy_t {
+		/*!
+		 * \brief Call tree is dropped and drop is counted
+		 */
+		DROP_ON_OVERFLOW,
+		/*!
+		 * \brief Caller waits until workers free space in queue
+		 */
+		BLOCK_ON_OVERFLOW
+	};
+
+	/*!
+	 * \brief Default capacity of handoff queue
+	 */
+	static const size_t DEFAULT_QUEUE_SIZE = 1024;
+
+	/*!
+	 * \brief Constructs aggregator and starts workers
+	 * \param aggregator Aggregator which will be called by workers
+	 * \param queue_size Capacity of handoff queue
+	 * \param overflow_policy Behaviour when queue is full
+	 * \param workers_count Number of background workers
+	 */
+	async_aggregator_t(std::shared_ptr<aggregator_t> aggregator,
+					   size_t queue_size = DEFAULT_QUEUE_SIZE,
+					   overflow_policy_t overflow_policy = DROP_ON_OVERFLOW,
+					   size_t workers_count = 1):
+		aggregator(aggregator), queue(queue_size), overflow_policy(overflow_policy),
+		dropped_count(0), aggregated_count(0), sleeping_workers(0), is_stopping(false) {
+		if (!aggregator) {
+			throw std::invalid_argument("Can't create async aggregator: aggregator is NULL");
+		}
+
+		for (size_t i = 0; i < std::max<size_t>(workers_count, 1); ++i) {
+			workers.emplace_back(&async_aggregator_t::worker_loop, this);
+		}
+	}
+
+	/*!
+	 * \brief Aggregates all queued call trees and stops workers
+	 */
+	~async_aggregator_t() {
+		{
+			std::lock_guard<std::mutex> guard(workers_mutex);
+			is_stopping = true;
+		}
+		workers_condition.notify_all();
+
+		for (auto it = workers.begin(); it != workers.end(); ++it) {
+			it->join();
+		}
+	}
+
+	/*!
+	 * \brief Queues copy of \a call_tree for background aggregation
+	 * \param call_tree Tree that will be aggregated
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		if (overflow_policy == DROP_ON_OVERFLOW && queue.size() >= queue.capacity()) {
+			++dropped_count;
+			return;
+		}
+
+		push(std::make_shared<const call_tree_t>(call_tree));
+	}
+
+	/*!
+	 * \brief Queues \a call_tree for background aggregation without copying
+	 * \param call_tree Handle of tree that will be aggregated
+	 */
+	void aggregate_handle(call_tree_handle_t call_tree) {
+		push(std::move(call_tree));
+	}
+
+	/*!
+	 * \brief Returns approximate number of call trees waiting for aggregation
+	 */
+	size_t get_queue_depth() const {
+		return queue.size();
+	}
+
+	/*!
+	 * \brief Returns number of call trees dropped due to queue overflow
+	 */
+	uint64_t get_dropped_count() const {
+		return dropped_count.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	 * \brief Returns number of call trees passed to wrapped aggregator
+	 */
+	uint64_t get_aggregated_count() const {
+		return aggregated_count.load(std::memory_order_relaxed);
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Puts \a call_tree into queue according to overflow policy and wakes up worker
+	 */
+	void push(call_tree_handle_t call_tree) {
+		while (!queue.try_push(call_tree)) {
+			if (overflow_policy == DROP_ON_OVERFLOW) {
+				++dropped_count;
+				return;
+			}
+			wake_up_worker();
+			std::this_thread::yield();
+		}
+
+		wake_up_worker();
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Notifies sleeping worker if there is one
+	 */
+	void wake_up_worker() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleeping_workers.load(std::memory_order_relaxed) != 0) {
+			std::lock_guard<std::mutex> guard(workers_mutex);
+			workers_condition.notify_one();
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Passes queued call trees to wrapped aggregator until aggregator is destroyed
+	 */
+	void worker_loop() {
+		call_tree_handle_t call_tree;
+		for (;;) {
+			if (queue.try_pop(call_tree)) {
+				try {
+					aggregator->aggregate_handle(std::move(call_tree));
+				} catch (std::exception &e) {
+					std::cerr << e.what() << std::endl;
+				}
+				call_tree.reset();
+				++aggregated_count;
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(workers_mutex);
+			if (is_stopping) {
+				if (queue.size() == 0) {
+					return;
+				}
+				continue;
+			}
+
+			++sleeping_workers;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (queue.size() == 0) {
+				workers_condition.wait_for(lock, std::chrono::milliseconds(+WORKER_SLEEP_TIMEOUT));
+			}
+			--sleeping_workers;
+		}
+	}
+
+	/*!
+	 * \brief Upper bound of worker sleep in milliseconds, guards against missed notifications
+	 */
+	static const int WORKER_SLEEP_TIMEOUT = 100;
+
+	/*!
+	 * \brief Wrapped aggregator
+	 */
+	std::shared_ptr<aggregator_t> aggregator;
+
+	/*!
+	 * \brief Handoff queue between request threads and workers
+	 */
+	bounded_queue_t<call_tree_handle_t> queue;
+
+	/*!
+	 * \brief Behaviour when queue is full
+	 */
+	const overflow_policy_t overflow_policy;
+
+	/*!
+	 * \brief Number of call trees dropped due to queue overflow
+	 */
+	std::atomic<uint64_t> dropped_count;
+
+	/*!
+	 * \brief Number of call trees passed to wrapped aggregator
+	 */
+	std::atomic<uint64_t> aggregated_count;
+
+	/*!
+	 * \brief Number of workers waiting for new call trees
+	 */
+	std::atomic<int> sleeping_workers;
+
+	/*!
+	 * \brief Set when aggregator is destroyed
+	 */
+	bool is_stopping;
+
+	/*!
+	 * \brief Workers sleep synchronization
+	 */
+	std::mutex workers_mutex;
+	std::condition_variable workers_condition;
+
+	/*!
+	 * \brief Background workers
+	 */
+	std::vector<std::thread> workers;
+};
+
+} // namespace react
+
+#endif // REACT_ASYNC_AGGREGATOR_HPP
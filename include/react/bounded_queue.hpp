@@ -0,0 +1,179 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_BOUNDED_QUEUE_HPP
+#define REACT_BOUNDED_QUEUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+namespace react {
+
+/*!
+ * \brief Bounded lock-free queue for multiple producers and consumers
+ *
+ *  Each cell carries sequence number which tells whether it is ready for push or pop,
+ *  so producers and consumers only contend on single atomic position each.
+ */
+template<typename T>
+class bounded_queue_t {
+public:
+	/*!
+	 * \brief Initializes empty queue
+	 * \param size Capacity of the queue, rounded up to the power of two
+	 */
+	bounded_queue_t(size_t size): buffer_mask(round_up_power_of_two(size) - 1),
+		buffer(new cell_t[buffer_mask + 1]) {
+		for (size_t i = 0; i <= buffer_mask; ++i) {
+			buffer[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	bounded_queue_t(const bounded_queue_t &other) = delete;
+	bounded_queue_t &operator =(const bounded_queue_t &other) = delete;
+
+	/*!
+	 * \brief Moves \a value into the queue
+	 * \return False if queue is full, \a value is left untouched in this case
+	 */
+	bool try_push(T &value) {
+		cell_t *cell;
+		size_t pos = enqueue_pos.value.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &buffer[pos & buffer_mask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+			if (diff == 0) {
+				if (enqueue_pos.value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = enqueue_pos.value.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->data = std::move(value);
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/*!
+	 * \brief Moves value from the head of the queue into \a value
+	 * \return False if queue is empty
+	 */
+	bool try_pop(T &value) {
+		cell_t *cell;
+		size_t pos = dequeue_pos.value.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &buffer[pos & buffer_mask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+			if (diff == 0) {
+				if (dequeue_pos.value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = dequeue_pos.value.load(std::memory_order_relaxed);
+			}
+		}
+
+		value = std::move(cell->data);
+		cell->data = T();
+		cell->sequence.store(pos + buffer_mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	/*!
+	 * \brief Returns approximate number of elements in the queue
+	 */
+	size_t size() const {
+		size_t enqueued = enqueue_pos.value.load(std::memory_order_relaxed);
+		size_t dequeued = dequeue_pos.value.load(std::memory_order_relaxed);
+		return enqueued > dequeued ? enqueued - dequeued : 0;
+	}
+
+	/*!
+	 * \brief Returns capacity of the queue
+	 */
+	size_t capacity() const {
+		return buffer_mask + 1;
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns least power of two which is not less than \a size
+	 */
+	static size_t round_up_power_of_two(size_t size) {
+		if (size == 0) {
+			throw std::invalid_argument("Can't create queue: size is zero");
+		}
+
+		size_t power = 1;
+		while (power < size) {
+			power <<= 1;
+		}
+		return power;
+	}
+
+	/*!
+	 * \brief Queue element with its sequence number
+	 */
+	struct cell_t {
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+	/*!
+	 * \brief Position padded to cache line to avoid false sharing between producers and consumers
+	 */
+	struct position_t {
+		position_t(): value(0) {}
+
+		std::atomic<size_t> value;
+		char pad[64 - sizeof(std::atomic<size_t>)];
+	};
+
+	/*!
+	 * \brief Mask for converting positions to buffer indices
+	 */
+	const size_t buffer_mask;
+
+	/*!
+	 * \brief Queue cells
+	 */
+	std::unique_ptr<cell_t[]> buffer;
+
+	/*!
+	 * \brief Position of the next push
+	 */
+	position_t enqueue_pos;
+
+	/*!
+	 * \brief Position of the next pop
+	 */
+	position_t dequeue_pos;
+};
+
+} // namespace react
+
+#endif // REACT_BOUNDED_QUEUE_HPP
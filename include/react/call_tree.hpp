@@ -23,6 +23,7 @@
 
 #include "actions_set.hpp"
 
+#include <memory>
 #include <unordered_map>
 #include <vector>
 #include <mutex>
@@ -52,30 +53,75 @@ struct JsonRenderer : boost::static_visitor<>
 
 	void operator () (bool value) const
 	{
-		stat_value.AddMember(key.c_str(), value, allocator);
+		rapidjson::Value json_value(value);
+		add_member(json_value);
 	}
 
 	void operator () (int value) const
 	{
-		stat_value.AddMember(key.c_str(), value, allocator);
+		rapidjson::Value json_value(value);
+		add_member(json_value);
 	}
 
 	void operator () (double value) const
 	{
-		stat_value.AddMember(key.c_str(), value, allocator);
+		rapidjson::Value json_value(value);
+		add_member(json_value);
 	}
 
 	void operator () (const std::string& value) const
 	{
-		stat_value.AddMember(key.c_str(), value.c_str(), allocator);
+		rapidjson::Value json_value(value.c_str(), static_cast<rapidjson::SizeType>(value.size()), allocator);
+		add_member(json_value);
 	}
 
 private:
+	/*!
+	 * \brief Adds member with copied key, renderer may not outlive json
+	 */
+	void add_member(rapidjson::Value &json_value) const
+	{
+		rapidjson::Value name(key.c_str(), static_cast<rapidjson::SizeType>(key.size()), allocator);
+		stat_value.AddMember(name, json_value, allocator);
+	}
+
 	std::string key;
 	rapidjson::Value &stat_value;
 	rapidjson::Document::AllocatorType &allocator;
 };
 
+/*!
+ * \brief Helper structure for streaming stats stored in stat_value_t directly to json writer
+ */
+template<typename Writer>
+struct JsonWriterRenderer : boost::static_visitor<>
+{
+	JsonWriterRenderer(Writer &writer): writer(writer) {}
+
+	void operator () (bool value) const
+	{
+		writer.Bool(value);
+	}
+
+	void operator () (int value) const
+	{
+		writer.Int(value);
+	}
+
+	void operator () (double value) const
+	{
+		writer.Double(value);
+	}
+
+	void operator () (const std::string& value) const
+	{
+		writer.String(value.c_str(), static_cast<rapidjson::SizeType>(value.size()));
+	}
+
+private:
+	Writer &writer;
+};
+
 /*!
  * \brief Represents node of call tree
  */
@@ -94,13 +140,18 @@ struct node_t {
 	 * \brief Initializes node with \a action_code and zero start and stop times
 	 * \param action_code Action code of the node
 	 */
-	node_t(int action_code): action_code(action_code), start_time(0), stop_time(0) {}
+	node_t(int action_code): action_code(action_code), is_changed(false), start_time(0), stop_time(0) {}
 
 	/*!
 	 * \brief Action which this node represents
 	 */
 	int action_code;
 
+	/*!
+	 * \brief Whether node is already listed in changes of the tree
+	 */
+	bool is_changed;
+
 	/*!
 	 * \brief Time when node action was started
 	 */
@@ -134,6 +185,21 @@ public:
 	 */
 	static const p_node_t NO_NODE = -1;
 
+	/*!
+	 * \brief Node created or modified since the last clear_changes()
+	 */
+	struct node_change_t {
+		/*!
+		 * \brief Changed node
+		 */
+		p_node_t node;
+
+		/*!
+		 * \brief Parent of node if node was created, NO_NODE otherwise
+		 */
+		p_node_t parent;
+	};
+
 	/*!
 	 * \brief Pointer to the root of call tree
 	 */
@@ -143,10 +209,21 @@ public:
 	 * \brief Initializes call tree with single root node and specified actions set
 	 * \param actions_set Set of available actions for monitoring in call tree
 	 */
-	call_tree_t(const actions_set_t &actions_set): actions_set(actions_set) {
+	call_tree_t(const actions_set_t &actions_set): actions_set(actions_set),
+		track_changes(false), is_stats_changed(false) {
 		root = new_node(+actions_set_t::NO_ACTION);
 	}
 
+	/*!
+	 * \brief Copies call tree with all its nodes and stats
+	 */
+	call_tree_t(const call_tree_t &other) = default;
+
+	/*!
+	 * \brief Moves nodes and stats of \a other call tree without copying
+	 */
+	call_tree_t(call_tree_t &&other) = default;
+
 	/*!
 	 * \brief Frees memory consumed by call tree
 	 */
@@ -185,6 +262,7 @@ public:
 	 */
 	void set_node_start_time(p_node_t node, int64_t time) {
 		nodes[node].start_time = time;
+		mark_changed(node, NO_NODE);
 	}
 
 	/*!
@@ -194,6 +272,7 @@ public:
 	 */
 	void set_node_stop_time(p_node_t node, int64_t time) {
 		nodes[node].stop_time = time;
+		mark_changed(node, NO_NODE);
 	}
 
 	/*!
@@ -227,6 +306,7 @@ public:
 
 		p_node_t action_node = new_node(action_code);
 		nodes[node].links.push_back(std::make_pair(action_code, action_node));
+		mark_changed(action_node, node);
 		return action_node;
 	}
 
@@ -249,10 +329,12 @@ public:
 	template<typename T>
 	void add_stat(const std::string &key, T value) {
 		stats[key] = value;
+		is_stats_changed = track_changes;
 	}
 
 	void add_stat(const std::string &key, const char *value) {
 		stats[key] = std::string(value);
+		is_stats_changed = track_changes;
 	}
 
 	bool has_stat(const std::string &key) const {
@@ -264,6 +346,57 @@ public:
 		return boost::get<T>(stats.at(key));
 	}
 
+	/*!
+	 * \brief Returns all stats stored in call tree
+	 * \return Key-Value map of call tree stats
+	 */
+	const std::unordered_map<std::string, stat_value_t> &get_stats() const {
+		return stats;
+	}
+
+	/*!
+	 * \brief Enables or disables recording of changed nodes
+	 *
+	 *  Changes made before tracking was enabled are not recorded.
+	 */
+	void set_change_tracking(bool enabled) {
+		track_changes = enabled;
+	}
+
+	/*!
+	 * \brief Returns whether changed nodes are recorded
+	 */
+	bool is_tracking_changes() const {
+		return track_changes;
+	}
+
+	/*!
+	 * \brief Returns nodes created or modified since the last clear_changes() in order of first change
+	 *
+	 *  Created node is listed with its parent, so that parents always precede their children.
+	 */
+	const std::vector<node_change_t> &get_changes() const {
+		return changes;
+	}
+
+	/*!
+	 * \brief Returns whether stats were added since the last clear_changes()
+	 */
+	bool stats_changed() const {
+		return is_stats_changed;
+	}
+
+	/*!
+	 * \brief Forgets recorded changes
+	 */
+	void clear_changes() {
+		for (auto it = changes.begin(); it != changes.end(); ++it) {
+			nodes[it->node].is_changed = false;
+		}
+		changes.clear();
+		is_stats_changed = false;
+	}
+
 	/*!
 	 * \brief Converts call tree to json
 	 * \param stat_value Json node for writing
@@ -275,6 +408,15 @@ public:
 		return to_json(root, stat_value, allocator);
 	}
 
+	/*!
+	 * \brief Streams call tree to json writer without building intermediate document
+	 * \param writer Json writer
+	 */
+	template<typename Writer>
+	void write_json(Writer &writer) const {
+		write_json(root, writer);
+	}
+
 	/*!
 	 * \brief Recursively merges this tree into \a rhs_node
 	 * \param rhs_node Node in which this tree will be merged
@@ -297,7 +439,9 @@ private:
 	rapidjson::Value& to_json(p_node_t current_node, rapidjson::Value &stat_value,
 							  rapidjson::Document::AllocatorType &allocator) const {
 		if (current_node != root) {
-			stat_value.AddMember("name", actions_set.get_action_name(get_node_action_code(current_node)).c_str(), allocator);
+			const std::string name = actions_set.get_action_name(get_node_action_code(current_node));
+			rapidjson::Value name_value(name.c_str(), static_cast<rapidjson::SizeType>(name.size()), allocator);
+			stat_value.AddMember("name", name_value, allocator);
 			stat_value.AddMember("start_time", get_node_start_time(current_node), allocator);
 			stat_value.AddMember("stop_time", get_node_stop_time(current_node), allocator);
 		} else {
@@ -322,6 +466,38 @@ private:
 		return stat_value;
 	}
 
+	/*!
+	 * \internal
+	 *
+	 * \brief Recursively streams subtree to json writer
+	 * \param current_node Node which subtree will be written
+	 * \param writer Json writer
+	 */
+	template<typename Writer>
+	void write_json(p_node_t current_node, Writer &writer) const {
+		writer.StartObject();
+		if (current_node != root) {
+			const std::string &name = actions_set.get_action_name(get_node_action_code(current_node));
+			writer.String("name").String(name.c_str(), static_cast<rapidjson::SizeType>(name.size()));
+			writer.String("start_time").Int64(get_node_start_time(current_node));
+			writer.String("stop_time").Int64(get_node_stop_time(current_node));
+		} else {
+			for (auto it = stats.begin(); it != stats.end(); ++it) {
+				writer.String(it->first.c_str(), static_cast<rapidjson::SizeType>(it->first.size()));
+				boost::apply_visitor(JsonWriterRenderer<Writer>(writer), it->second);
+			}
+		}
+
+		if (!nodes[current_node].links.empty()) {
+			writer.String("actions").StartArray();
+			for (auto it = nodes[current_node].links.begin(); it != nodes[current_node].links.end(); ++it) {
+				write_json(it->second, writer);
+			}
+			writer.EndArray();
+		}
+		writer.EndObject();
+	}
+
 	/*!
 	 * \internal
 	 *
@@ -356,6 +532,19 @@ private:
 		return nodes.size() - 1;
 	}
 
+	/*!
+	 * \internal
+	 *
+	 * \brief Records change of \a node if tracking is enabled and node is not recorded yet
+	 */
+	void mark_changed(p_node_t node, p_node_t parent) {
+		if (!track_changes || nodes[node].is_changed) {
+			return;
+		}
+		nodes[node].is_changed = true;
+		changes.push_back(node_change_t{node, parent});
+	}
+
 	/*!
 	 * \brief Tree nodes
 	 */
@@ -370,10 +559,140 @@ private:
 	 * \brief Key-Value map for storing arbitary user stats
 	 */
 	std::unordered_map<std::string, stat_value_t> stats;
+
+	/*!
+	 * \brief Whether changes are recorded
+	 */
+	bool track_changes;
+
+	/*!
+	 * \brief Nodes changed since the last clear_changes()
+	 */
+	std::vector<node_change_t> changes;
+
+	/*!
+	 * \brief Whether stats were added since the last clear_changes()
+	 */
+	bool is_stats_changed;
+};
+
+/*!
+ * \brief Nodes and stats of call tree changed since previous delta, or the whole tree for snapshot
+ */
+struct call_tree_delta_t {
+	/*!
+	 * \brief State of single node
+	 */
+	struct node_record_t {
+		/*!
+		 * \brief Node in source tree
+		 */
+		call_tree_t::p_node_t node;
+
+		/*!
+		 * \brief Parent of node if node is new, NO_NODE otherwise
+		 */
+		call_tree_t::p_node_t parent;
+
+		int action_code;
+		int64_t start_time;
+		int64_t stop_time;
+	};
+
+	/*!
+	 * \brief Constructs empty delta
+	 */
+	call_tree_delta_t(): is_snapshot(false), has_stats(false) {}
+
+	/*!
+	 * \brief Returns whether delta carries no changes
+	 */
+	bool empty() const {
+		return !is_snapshot && nodes.empty() && !has_stats;
+	}
+
+	/*!
+	 * \brief Builds snapshot of the whole \a call_tree
+	 */
+	static call_tree_delta_t make_snapshot(const call_tree_t &call_tree) {
+		call_tree_delta_t delta;
+		delta.is_snapshot = true;
+		delta.has_stats = true;
+		delta.stats = call_tree.get_stats();
+		add_subtree(call_tree, call_tree.root, delta.nodes);
+		return delta;
+	}
+
+	/*!
+	 * \brief Streams delta as single json object, actions are written by name
+	 */
+	template<typename Writer>
+	void write_json(Writer &writer, const actions_set_t &actions_set) const {
+		writer.StartObject();
+		writer.String("snapshot").Bool(is_snapshot);
+
+		writer.String("nodes").StartArray();
+		for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+			const std::string &name = actions_set.get_action_name(it->action_code);
+			writer.StartArray();
+			writer.Int64(it->node);
+			writer.Int64(it->parent == call_tree_t::NO_NODE ? -1 : static_cast<int64_t>(it->parent));
+			writer.String(name.c_str(), static_cast<rapidjson::SizeType>(name.size()));
+			writer.Int64(it->start_time);
+			writer.Int64(it->stop_time);
+			writer.EndArray();
+		}
+		writer.EndArray();
+
+		if (has_stats) {
+			writer.String("stats").StartObject();
+			for (auto it = stats.begin(); it != stats.end(); ++it) {
+				writer.String(it->first.c_str(), static_cast<rapidjson::SizeType>(it->first.size()));
+				boost::apply_visitor(JsonWriterRenderer<Writer>(writer), it->second);
+			}
+			writer.EndObject();
+		}
+		writer.EndObject();
+	}
+
+	/*!
+	 * \brief Whether delta contains the whole tree
+	 */
+	bool is_snapshot;
+
+	/*!
+	 * \brief Changed nodes, parents precede their children
+	 */
+	std::vector<node_record_t> nodes;
+
+	/*!
+	 * \brief Whether stats were changed
+	 */
+	bool has_stats;
+
+	/*!
+	 * \brief All stats of the tree if they were changed
+	 */
+	std::unordered_map<std::string, stat_value_t> stats;
+
+private:
+	static void add_subtree(const call_tree_t &call_tree, call_tree_t::p_node_t node,
+							std::vector<node_record_t> &records) {
+		const auto &links = call_tree.get_node_links(node);
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			records.push_back(node_record_t{it->second, node, it->first,
+						call_tree.get_node_start_time(it->second), call_tree.get_node_stop_time(it->second)});
+			add_subtree(call_tree, it->second, records);
+		}
+	}
 };
 
 /*!
  * \brief Concurrent version of time stats tree to handle simultanious updates
+ *
+ *  Besides the tree itself keeps snapshot mirror of it for readers. Mirror is brought up to date
+ *  with changes recorded since previous snapshot, so updaters are blocked only for O(changes)
+ *  while copying and serialization of snapshot are done under separate snapshot lock.
  */
 class concurrent_call_tree_t {
 public:
@@ -381,7 +700,7 @@ public:
 	 * \brief Initializes call_tree with \a actions_set
 	 * \param actions_set Set of available action for monitoring
 	 */
-	concurrent_call_tree_t(actions_set_t &actions_set): call_tree(actions_set) {}
+	concurrent_call_tree_t(actions_set_t &actions_set): call_tree(actions_set), is_collecting_delta(false) {}
 
 	/*!
 	 * \brief Gets ownership of time stats tree
@@ -407,27 +726,156 @@ public:
 
 	/*!
 	 * \brief Returns copy of inner time stats tree
+	 *
+	 *  The first call copies the whole tree under lock and enables change tracking,
+	 *  subsequent calls hold tree lock only while collecting changes.
 	 * \return Copy of inner time stats tree
 	 */
 	call_tree_t copy_call_tree() const {
-		lock();
-		call_tree_t call_tree_copy = call_tree;
-		unlock();
-		return call_tree_copy;
+		std::lock_guard<std::mutex> guard(snapshot_mutex);
+		update_snapshot();
+		return *snapshot;
+	}
+
+	/*!
+	 * \brief Returns changes of the tree since previous take_changes() or take_snapshot()
+	 *
+	 *  The first call returns snapshot of the whole tree.
+	 */
+	call_tree_delta_t take_changes() {
+		std::lock_guard<std::mutex> guard(snapshot_mutex);
+		update_snapshot();
+		if (!is_collecting_delta) {
+			is_collecting_delta = true;
+			return call_tree_delta_t::make_snapshot(*snapshot);
+		}
+
+		call_tree_delta_t delta;
+		std::swap(delta, pending_delta);
+		pending_nodes.clear();
+		return delta;
+	}
+
+	/*!
+	 * \brief Returns snapshot of the whole tree, subsequent take_changes() will be relative to it
+	 */
+	call_tree_delta_t take_snapshot() {
+		std::lock_guard<std::mutex> guard(snapshot_mutex);
+		update_snapshot();
+		is_collecting_delta = true;
+		pending_delta = call_tree_delta_t();
+		pending_nodes.clear();
+		return call_tree_delta_t::make_snapshot(*snapshot);
 	}
 
 private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Applies changes of the tree to snapshot mirror, must be called under snapshot lock
+	 */
+	void update_snapshot() const {
+		if (!snapshot) {
+			std::lock_guard<std::mutex> guard(tree_mutex);
+			snapshot.reset(new call_tree_t(call_tree));
+			call_tree.clear_changes();
+			call_tree.set_change_tracking(true);
+			snapshot->clear_changes();
+			return;
+		}
+
+		call_tree_delta_t delta;
+		{
+			std::lock_guard<std::mutex> guard(tree_mutex);
+			const auto &changes = call_tree.get_changes();
+			delta.nodes.reserve(changes.size());
+			for (auto it = changes.begin(); it != changes.end(); ++it) {
+				delta.nodes.push_back(call_tree_delta_t::node_record_t{it->node, it->parent,
+							call_tree.get_node_action_code(it->node),
+							call_tree.get_node_start_time(it->node), call_tree.get_node_stop_time(it->node)});
+			}
+			if (call_tree.stats_changed()) {
+				delta.has_stats = true;
+				delta.stats = call_tree.get_stats();
+			}
+			call_tree.clear_changes();
+		}
+
+		for (auto it = delta.nodes.begin(); it != delta.nodes.end(); ++it) {
+			if (it->parent != call_tree_t::NO_NODE &&
+					snapshot->add_new_link(it->parent, it->action_code) != it->node) {
+				throw std::logic_error("Can't update call tree snapshot: nodes are out of order");
+			}
+			snapshot->set_node_start_time(it->node, it->start_time);
+			snapshot->set_node_stop_time(it->node, it->stop_time);
+		}
+		for (auto it = delta.stats.begin(); it != delta.stats.end(); ++it) {
+			snapshot->add_stat(it->first, it->second);
+		}
+
+		if (is_collecting_delta) {
+			merge_pending_delta(delta);
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Adds \a delta to changes not yet taken by take_changes()
+	 */
+	void merge_pending_delta(const call_tree_delta_t &delta) const {
+		for (auto it = delta.nodes.begin(); it != delta.nodes.end(); ++it) {
+			auto pending_it = pending_nodes.find(it->node);
+			if (pending_it == pending_nodes.end()) {
+				pending_nodes[it->node] = pending_delta.nodes.size();
+				pending_delta.nodes.push_back(*it);
+			} else {
+				call_tree_delta_t::node_record_t &record = pending_delta.nodes[pending_it->second];
+				record.start_time = it->start_time;
+				record.stop_time = it->stop_time;
+			}
+		}
+		if (delta.has_stats) {
+			pending_delta.has_stats = true;
+			pending_delta.stats = delta.stats;
+		}
+	}
+
 	/*!
 	 * \brief Lock to handle concurrency during updates
 	 */
 	mutable std::mutex tree_mutex;
 
 	/*!
-	 * \brief Inner call_tree
+	 * \brief Inner call_tree, its change tracking is updated by snapshots
 	 */
-	call_tree_t call_tree;
-};
+	mutable call_tree_t call_tree;
+
+	/*!
+	 * \brief Lock of snapshot mirror, never held by updaters
+	 */
+	mutable std::mutex snapshot_mutex;
 
+	/*!
+	 * \brief Mirror of call_tree as of the last snapshot, created by the first snapshot
+	 */
+	mutable std::unique_ptr<call_tree_t> snapshot;
+
+	/*!
+	 * \brief Whether changes are accumulated for take_changes()
+	 */
+	bool is_collecting_delta;
+
+	/*!
+	 * \brief Changes applied to mirror since previous take_changes()
+	 */
+	mutable call_tree_delta_t pending_delta;
+
+	/*!
+	 * \brief Positions of nodes in pending_delta
+	 */
+	mutable std::unordered_map<call_tree_t::p_node_t, size_t> pending_nodes;
+};
 
 } // namespace react
 
@@ -0,0 +1,405 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_CALL_TREE_LOG_HPP
+#define REACT_CALL_TREE_LOG_HPP
+
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "rapidjson/reader.h"
+
+#include "call_tree.hpp"
+
+namespace react {
+
+/*!
+ * \brief Append-only log of call tree deltas
+ *
+ *  Each line of the log is a json object written by call_tree_delta_t::write_json().
+ *  Log starts with snapshot, compaction replaces all records with a single new snapshot.
+ */
+class call_tree_log_t {
+public:
+	/*!
+	 * \brief Opens log at \a path for appending
+	 * \param path Log file path
+	 * \param actions_set Actions of logged tree
+	 * \throw std::runtime_error if file can't be opened
+	 */
+	call_tree_log_t(const std::string &path, const actions_set_t &actions_set):
+		path(path), actions_set(actions_set), records_count(0) {
+		open(std::ios_base::app);
+	}
+
+	/*!
+	 * \brief Appends \a delta to the log, empty deltas are skipped
+	 */
+	void append(const call_tree_delta_t &delta) {
+		if (delta.empty()) {
+			return;
+		}
+		write_record(output, delta);
+		output.flush();
+		++records_count;
+	}
+
+	/*!
+	 * \brief Atomically replaces log contents with \a snapshot
+	 * \throw std::runtime_error if log can't be rewritten
+	 */
+	void compact(const call_tree_delta_t &snapshot) {
+		if (!snapshot.is_snapshot) {
+			throw std::invalid_argument("Can't compact call tree log: delta is not a snapshot");
+		}
+
+		std::string temporary_path = path + ".tmp";
+		{
+			std::ofstream temporary_output(temporary_path, std::ios_base::out | std::ios_base::trunc);
+			write_record(temporary_output, snapshot);
+			temporary_output.flush();
+			if (!temporary_output) {
+				throw std::runtime_error("Can't compact call tree log: failed to write " + temporary_path);
+			}
+		}
+
+		output.close();
+		if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+			open(std::ios_base::app);
+			throw std::runtime_error("Can't compact call tree log: failed to replace " + path);
+		}
+		open(std::ios_base::app);
+		records_count = 1;
+	}
+
+	/*!
+	 * \brief Returns number of records in the log written by this object since the last compaction
+	 */
+	size_t get_records_count() const {
+		return records_count;
+	}
+
+	/*!
+	 * \brief Rebuilds the latest state of call tree from log read from \a input
+	 *
+	 *  Actions missing in \a actions_set are defined.
+	 * \throw std::runtime_error if log is malformed or does not start with snapshot
+	 */
+	static std::unique_ptr<call_tree_t> read(std::istream &input, actions_set_t &actions_set) {
+		std::unique_ptr<call_tree_t> call_tree;
+		std::vector<call_tree_t::p_node_t> nodes_map;
+
+		std::string line;
+		while (std::getline(input, line)) {
+			if (line.empty()) {
+				continue;
+			}
+
+			record_t record;
+			record_handler_t handler(record);
+			rapidjson::StringStream stream(line.c_str());
+			rapidjson::Reader reader;
+			if (!reader.Parse<0>(stream, handler) || !handler.is_complete()) {
+				throw std::runtime_error("Can't read call tree log: malformed record");
+			}
+
+			if (record.is_snapshot) {
+				call_tree.reset(new call_tree_t(actions_set));
+				nodes_map.assign(1, call_tree->root);
+			} else if (!call_tree) {
+				throw std::runtime_error("Can't read call tree log: log does not start with snapshot");
+			}
+
+			apply_nodes(record, *call_tree, actions_set, nodes_map);
+			for (auto it = record.stats.begin(); it != record.stats.end(); ++it) {
+				call_tree->add_stat(it->first, it->second);
+			}
+		}
+
+		if (!call_tree) {
+			throw std::runtime_error("Can't read call tree log: log is empty");
+		}
+		return call_tree;
+	}
+
+private:
+	/*!
+	 * \brief Parsed log record, actions are referenced by name
+	 */
+	struct record_t {
+		struct record_node_t {
+			int64_t fields[4];
+			std::string name;
+		};
+
+		record_t(): is_snapshot(false) {}
+
+		bool is_snapshot;
+		std::vector<record_node_t> nodes;
+		std::vector<std::pair<std::string, stat_value_t>> stats;
+	};
+
+	/*!
+	 * \brief Streaming parser of single log record
+	 *
+	 *  Record is parsed with SAX interface into record_t without building json document.
+	 *  Numeric node fields are stored in order: node, parent, start_time, stop_time.
+	 */
+	class record_handler_t : public rapidjson::BaseReaderHandler<> {
+	public:
+		record_handler_t(record_t &record): record(record), state(RECORD_START), field(0),
+			has_snapshot(false), has_nodes(false) {}
+
+		bool is_complete() const {
+			return state == RECORD_END && has_snapshot && has_nodes;
+		}
+
+		void Default() {
+			fail();
+		}
+
+		void Bool(bool value) {
+			if (state == SNAPSHOT_VALUE) {
+				record.is_snapshot = value;
+				has_snapshot = true;
+				state = RECORD_KEY;
+			} else {
+				stat(value);
+			}
+		}
+
+		void Int(int value) {
+			if (state == STAT_VALUE) {
+				stat(value);
+			} else {
+				integer(value);
+			}
+		}
+
+		void Uint(unsigned value) {
+			if (state == STAT_VALUE && value <= static_cast<unsigned>(std::numeric_limits<int>::max())) {
+				stat(static_cast<int>(value));
+			} else {
+				Uint64(value);
+			}
+		}
+
+		void Int64(int64_t value) {
+			if (state == STAT_VALUE) {
+				stat(static_cast<double>(value));
+			} else {
+				integer(value);
+			}
+		}
+
+		void Uint64(uint64_t value) {
+			if (state == STAT_VALUE) {
+				stat(static_cast<double>(value));
+			} else {
+				integer(static_cast<int64_t>(value));
+			}
+		}
+
+		void Double(double value) {
+			stat(value);
+		}
+
+		void String(const Ch *value, rapidjson::SizeType length, bool) {
+			std::string string(value, length);
+			switch (state) {
+			case RECORD_KEY:
+				if (string == "snapshot") {
+					state = SNAPSHOT_VALUE;
+				} else if (string == "nodes") {
+					state = NODES_VALUE;
+				} else if (string == "stats") {
+					state = STATS_VALUE;
+				} else {
+					fail();
+				}
+				break;
+			case NODE:
+				if (field != 2) {
+					fail();
+				}
+				record.nodes.back().name = string;
+				++field;
+				break;
+			case STAT_KEY:
+				stat_key = string;
+				state = STAT_VALUE;
+				break;
+			default:
+				stat(string);
+			}
+		}
+
+		void StartObject() {
+			if (state == RECORD_START) {
+				state = RECORD_KEY;
+			} else if (state == STATS_VALUE) {
+				state = STAT_KEY;
+			} else {
+				fail();
+			}
+		}
+
+		void EndObject(rapidjson::SizeType) {
+			if (state == RECORD_KEY) {
+				state = RECORD_END;
+			} else if (state == STAT_KEY) {
+				state = RECORD_KEY;
+			} else {
+				fail();
+			}
+		}
+
+		void StartArray() {
+			if (state == NODES_VALUE) {
+				state = NODES;
+			} else if (state == NODES) {
+				record.nodes.push_back(record_t::record_node_t());
+				field = 0;
+				state = NODE;
+			} else {
+				fail();
+			}
+		}
+
+		void EndArray(rapidjson::SizeType) {
+			if (state == NODES) {
+				has_nodes = true;
+				state = RECORD_KEY;
+			} else if (state == NODE && field == 5) {
+				state = NODES;
+			} else {
+				fail();
+			}
+		}
+
+	private:
+		enum state_t {
+			RECORD_START,
+			RECORD_KEY,
+			SNAPSHOT_VALUE,
+			NODES_VALUE,
+			NODES,
+			NODE,
+			STATS_VALUE,
+			STAT_KEY,
+			STAT_VALUE,
+			RECORD_END
+		};
+
+		static void fail() {
+			throw std::runtime_error("Can't read call tree log: malformed record");
+		}
+
+		void integer(int64_t value) {
+			if (state != NODE || field == 2 || field >= 5) {
+				fail();
+			}
+			record.nodes.back().fields[field < 2 ? field : field - 1] = value;
+			++field;
+		}
+
+		void stat(const stat_value_t &value) {
+			if (state != STAT_VALUE) {
+				fail();
+			}
+			record.stats.push_back(std::make_pair(stat_key, value));
+			state = STAT_KEY;
+		}
+
+		record_t &record;
+		state_t state;
+		size_t field;
+		std::string stat_key;
+		bool has_snapshot;
+		bool has_nodes;
+	};
+
+	void open(std::ios_base::openmode mode) {
+		output.open(path, std::ios_base::out | mode);
+		if (!output) {
+			throw std::runtime_error("Can't open call tree log: " + path);
+		}
+	}
+
+	void write_record(std::ostream &stream, const call_tree_delta_t &delta) const {
+		rapidjson::StringBuffer buffer;
+		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+		delta.write_json(writer, actions_set);
+		stream.write(buffer.GetString(), buffer.Size());
+		stream.put('\n');
+	}
+
+	static void apply_nodes(const record_t &record, call_tree_t &call_tree, actions_set_t &actions_set,
+							std::vector<call_tree_t::p_node_t> &nodes_map) {
+		for (auto it = record.nodes.begin(); it != record.nodes.end(); ++it) {
+			int64_t id = it->fields[0];
+			int64_t parent = it->fields[1];
+			if (id <= 0) {
+				throw std::runtime_error("Can't read call tree log: malformed node");
+			}
+
+			size_t index = id;
+			if (parent >= 0) {
+				if (static_cast<size_t>(parent) >= nodes_map.size() || nodes_map[parent] == call_tree_t::NO_NODE) {
+					throw std::runtime_error("Can't read call tree log: node parent is unknown");
+				}
+				if (index >= nodes_map.size()) {
+					nodes_map.resize(index + 1, +call_tree_t::NO_NODE);
+				}
+				int action_code = actions_set.define_new_action(it->name);
+				nodes_map[index] = call_tree.add_new_link(nodes_map[parent], action_code);
+			} else if (index >= nodes_map.size() || nodes_map[index] == call_tree_t::NO_NODE) {
+				throw std::runtime_error("Can't read call tree log: changed node is unknown");
+			}
+
+			call_tree.set_node_start_time(nodes_map[index], it->fields[2]);
+			call_tree.set_node_stop_time(nodes_map[index], it->fields[3]);
+		}
+	}
+
+	/*!
+	 * \brief Log file path
+	 */
+	const std::string path;
+
+	/*!
+	 * \brief Actions of logged tree
+	 */
+	const actions_set_t &actions_set;
+
+	/*!
+	 * \brief Log file
+	 */
+	std::ofstream output;
+
+	/*!
+	 * \brief Records written since the last compaction
+	 */
+	size_t records_count;
+};
+
+} // namespace react
+
+#endif // REACT_CALL_TREE_LOG_HPP
@@ -0,0 +1,309 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_CALLGRIND_AGGREGATOR_HPP
+#define REACT_CALLGRIND_AGGREGATOR_HPP
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <mutex>
+
+#include "aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Aggregator that merges call trees into single callgrind profile
+ *
+ *  Every action is represented as function, self cost is accumulated per action
+ *  and inclusive cost and number of calls are accumulated per call edge.
+ *  Memory is proportional to number of distinct call edges.
+ *  Output can be opened in KCachegrind.
+ *
+ *  Call trees keep only wall time per action, so optional "CpuTime" event is taken
+ *  from per-tree stat and charged as self cost of top-level actions in proportion to their wall time.
+ */
+class callgrind_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Constructs empty aggregator
+	 * \param actions_set Actions set used to resolve action names on dump
+	 * \param count_event If true, number of actions calls is written as extra "Count" event
+	 * \param cpu_time_stat Name of int or double tree stat with CPU time in microseconds,
+	 *  if not empty it is written as extra "CpuTime" event
+	 */
+	callgrind_aggregator_t(const actions_set_t &actions_set, bool count_event = true,
+						   const std::string &cpu_time_stat = std::string()):
+		actions_set(actions_set), count_event(count_event), cpu_time_stat(cpu_time_stat) {}
+
+	/*!
+	 * \brief Frees memory consumed by callgrind_aggregator
+	 */
+	~callgrind_aggregator_t() {}
+
+	/*!
+	 * \brief Merges costs of \a call_tree into profile in single pass
+	 * \param call_tree Tree that will be aggregated
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		std::lock_guard<std::mutex> guard(mutex);
+		const node_t::Container &links = call_tree.get_node_links(call_tree.root);
+		std::vector<int64_t> top_level_times;
+		top_level_times.reserve(links.size());
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			top_level_times.push_back(aggregate(call_tree, it->second).time);
+		}
+
+		if (!cpu_time_stat.empty() && !links.empty()) {
+			charge_cpu_time(get_cpu_time(call_tree), links, top_level_times);
+		}
+	}
+
+	/*!
+	 * \brief Outputs profile in callgrind format into stream
+	 * \param os Stream where profile will be outputed
+	 */
+	void dump(std::ostream &os) const {
+		std::lock_guard<std::mutex> guard(mutex);
+
+		cost_t totals;
+		for (auto it = self_costs.begin(); it != self_costs.end(); ++it) {
+			totals += it->second;
+		}
+
+		os << "# callgrind format\n";
+		os << "version: 1\n";
+		os << "creator: react\n";
+		os << "positions: line\n";
+		os << "events: Time" << (count_event ? " Count" : "") << (cpu_time_stat.empty() ? "" : " CpuTime") << '\n';
+		os << "totals: ";
+		write_cost(os, totals);
+		os << '\n';
+
+		std::set<int> defined_functions;
+		auto edge = calls.begin();
+		for (auto it = self_costs.begin(); it != self_costs.end(); ++it) {
+			os << "fn=";
+			write_function(os, it->first, defined_functions);
+			os << "0 ";
+			write_cost(os, it->second);
+
+			for (; edge != calls.end() && edge->first.first == it->first; ++edge) {
+				os << "cfn=";
+				write_function(os, edge->first.second, defined_functions);
+				os << "calls=" << edge->second.calls << " 0\n";
+				os << "0 ";
+				write_cost(os, edge->second.inclusive_cost);
+			}
+			os << '\n';
+		}
+		os.flush();
+	}
+
+	/*!
+	 * \brief Drops accumulated profile
+	 */
+	void clear() {
+		std::lock_guard<std::mutex> guard(mutex);
+		self_costs.clear();
+		calls.clear();
+	}
+
+private:
+	/*!
+	 * \brief Cost of action in all events
+	 */
+	struct cost_t {
+		cost_t(): time(0), count(0), cpu_time(0) {}
+		cost_t(int64_t time, int64_t count): time(time), count(count), cpu_time(0) {}
+
+		cost_t &operator +=(const cost_t &other) {
+			time += other.time;
+			count += other.count;
+			cpu_time += other.cpu_time;
+			return *this;
+		}
+
+		/*!
+		 * \brief Wall time in microseconds
+		 */
+		int64_t time;
+
+		/*!
+		 * \brief Number of calls
+		 */
+		int64_t count;
+
+		/*!
+		 * \brief CPU time in microseconds
+		 */
+		int64_t cpu_time;
+	};
+
+	/*!
+	 * \brief Call edge from caller action to callee action
+	 */
+	struct call_t {
+		call_t(): calls(0) {}
+
+		/*!
+		 * \brief Number of times callee was called by caller
+		 */
+		int64_t calls;
+
+		/*!
+		 * \brief Cost of callee including its own callees
+		 */
+		cost_t inclusive_cost;
+	};
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Recursively accumulates costs of subtree of \a node
+	 * \return Inclusive cost of \a node
+	 */
+	cost_t aggregate(const call_tree_t &call_tree, call_tree_t::p_node_t node) {
+		int action_code = call_tree.get_node_action_code(node);
+		cost_t inclusive_cost(call_tree.get_node_stop_time(node) - call_tree.get_node_start_time(node), 1);
+		cost_t self_cost = inclusive_cost;
+
+		const node_t::Container &links = call_tree.get_node_links(node);
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			cost_t child_cost = aggregate(call_tree, it->second);
+			call_t &call = calls[std::make_pair(action_code, it->first)];
+			++call.calls;
+			call.inclusive_cost += child_cost;
+
+			self_cost.time -= child_cost.time;
+			inclusive_cost.count += child_cost.count;
+		}
+
+		self_cost.time = std::max<int64_t>(self_cost.time, 0);
+		self_costs[action_code] += self_cost;
+		return inclusive_cost;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns CPU time of \a call_tree in microseconds or 0 if stat is missing
+	 */
+	int64_t get_cpu_time(const call_tree_t &call_tree) const {
+		auto stat = call_tree.get_stats().find(cpu_time_stat);
+		if (stat == call_tree.get_stats().end()) {
+			return 0;
+		}
+		if (const int *value = boost::get<int>(&stat->second)) {
+			return *value;
+		}
+		if (const double *value = boost::get<double>(&stat->second)) {
+			return static_cast<int64_t>(*value);
+		}
+		return 0;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Splits \a cpu_time between top-level actions in proportion to their wall time
+	 */
+	void charge_cpu_time(int64_t cpu_time, const node_t::Container &links,
+						 const std::vector<int64_t> &top_level_times) {
+		int64_t total_time = 0;
+		for (auto it = top_level_times.begin(); it != top_level_times.end(); ++it) {
+			total_time += std::max<int64_t>(*it, 0);
+		}
+
+		int64_t charged = 0;
+		for (size_t i = 0; i < links.size(); ++i) {
+			int64_t share = cpu_time - charged;
+			if (i + 1 < links.size()) {
+				share = total_time > 0 ?
+						static_cast<int64_t>(static_cast<double>(cpu_time) * std::max<int64_t>(top_level_times[i], 0) / total_time) :
+						cpu_time / static_cast<int64_t>(links.size());
+			}
+			self_costs[links[i].first].cpu_time += share;
+			charged += share;
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Writes cost line in order of declared events
+	 */
+	void write_cost(std::ostream &os, const cost_t &cost) const {
+		os << cost.time;
+		if (count_event) {
+			os << ' ' << cost.count;
+		}
+		if (!cpu_time_stat.empty()) {
+			os << ' ' << cost.cpu_time;
+		}
+		os << '\n';
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Writes function using callgrind name compression
+	 */
+	void write_function(std::ostream &os, int action_code, std::set<int> &defined_functions) const {
+		os << '(' << action_code + 1 << ')';
+		if (defined_functions.insert(action_code).second) {
+			os << ' ' << actions_set.get_action_name(action_code);
+		}
+		os << '\n';
+	}
+
+	/*!
+	 * \brief Available actions for monitoring
+	 */
+	const actions_set_t &actions_set;
+
+	/*!
+	 * \brief Whether number of calls is written as extra event
+	 */
+	const bool count_event;
+
+	/*!
+	 * \brief Name of tree stat with CPU time, empty if CPU time is not written
+	 */
+	const std::string cpu_time_stat;
+
+	/*!
+	 * \brief Self cost of every action
+	 */
+	std::map<int, cost_t> self_costs;
+
+	/*!
+	 * \brief Calls between actions keyed by (caller, callee) action codes
+	 */
+	std::map<std::pair<int, int>, call_t> calls;
+
+	/*!
+	 * \brief Profile access synchronization
+	 */
+	mutable std::mutex mutex;
+};
+
+} // namespace react
+
+#endif // REACT_CALLGRIND_AGGREGATOR_HPP
@@ -0,0 +1,195 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_CHROME_TRACE_AGGREGATOR_HPP
+#define REACT_CHROME_TRACE_AGGREGATOR_HPP
+
+#include <ostream>
+#include <mutex>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Aggregator that streams call trees as Chrome Trace Event Format
+ *
+ *  Every action is written as complete ("X") event and tree stats are written as
+ *  instant ("i") event, so output of many threads and requests forms single timeline
+ *  which can be opened in chrome://tracing or Perfetto UI.
+ *  Events are written to stream tree by tree, the whole trace is never kept in memory.
+ */
+class chrome_trace_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Constructs aggregator and writes trace header
+	 * \param os Stream where trace events will be outputed
+	 */
+	chrome_trace_aggregator_t(std::ostream &os): os(os), events_count(0), pid(getpid()) {
+		os << "{\"traceEvents\":[\n";
+	}
+
+	/*!
+	 * \brief Writes trace footer
+	 */
+	~chrome_trace_aggregator_t() {
+		os << "\n]}" << std::endl;
+	}
+
+	/*!
+	 * \brief Outputs call tree actions and stats as trace events
+	 * \param call_tree Tree that will be outputed
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		int tid = get_tree_thread_id(call_tree);
+
+		rapidjson::StringBuffer buffer;
+		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+		size_t tree_events_count = 0;
+		write_stats_event(call_tree, tid, writer, buffer, tree_events_count);
+		write_events(call_tree, call_tree.root, tid, writer, buffer, tree_events_count);
+
+		std::lock_guard<std::mutex> guard(mutex);
+		if (tree_events_count == 0) {
+			return;
+		}
+		if (events_count != 0) {
+			os << ",\n";
+		}
+		os << buffer.GetString();
+		events_count += tree_events_count;
+	}
+
+	/*!
+	 * \brief Flushes written events to underlying stream
+	 */
+	void flush() {
+		std::lock_guard<std::mutex> guard(mutex);
+		os.flush();
+	}
+
+private:
+	typedef rapidjson::Writer<rapidjson::StringBuffer> writer_t;
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns id of thread which produced \a call_tree
+	 */
+	int get_tree_thread_id(const call_tree_t &call_tree) const {
+		if (call_tree.has_stat("thread_id")) {
+			return call_tree.get_stat<int>("thread_id");
+		}
+		return static_cast<int>(syscall(SYS_gettid));
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Separates events of single tree in \a buffer
+	 */
+	void start_event(rapidjson::StringBuffer &buffer, size_t &tree_events_count) const {
+		if (tree_events_count != 0) {
+			buffer.Put(',');
+			buffer.Put('\n');
+		}
+		++tree_events_count;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Writes tree stats as instant event at the beginning of the first action
+	 */
+	void write_stats_event(const call_tree_t &call_tree, int tid, writer_t &writer,
+						   rapidjson::StringBuffer &buffer, size_t &tree_events_count) const {
+		const node_t::Container &links = call_tree.get_node_links(call_tree.root);
+		if (links.empty() || call_tree.get_stats().empty()) {
+			return;
+		}
+
+		start_event(buffer, tree_events_count);
+		writer.StartObject();
+		writer.String("name").String("stats");
+		writer.String("ph").String("i");
+		writer.String("s").String("t");
+		writer.String("ts").Int64(call_tree.get_node_start_time(links.front().second));
+		writer.String("pid").Int(pid);
+		writer.String("tid").Int(tid);
+		writer.String("args").StartObject();
+		for (auto it = call_tree.get_stats().begin(); it != call_tree.get_stats().end(); ++it) {
+			writer.String(it->first.c_str(), static_cast<rapidjson::SizeType>(it->first.size()));
+			boost::apply_visitor(JsonWriterRenderer<writer_t>(writer), it->second);
+		}
+		writer.EndObject();
+		writer.EndObject();
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Recursively writes complete events for every action in subtree of \a node
+	 */
+	void write_events(const call_tree_t &call_tree, call_tree_t::p_node_t node, int tid, writer_t &writer,
+					  rapidjson::StringBuffer &buffer, size_t &tree_events_count) const {
+		if (node != call_tree.root) {
+			int64_t start_time = call_tree.get_node_start_time(node);
+			const std::string &name = call_tree.get_actions_set().get_action_name(call_tree.get_node_action_code(node));
+
+			start_event(buffer, tree_events_count);
+			writer.StartObject();
+			writer.String("name").String(name.c_str(), static_cast<rapidjson::SizeType>(name.size()));
+			writer.String("ph").String("X");
+			writer.String("ts").Int64(start_time);
+			writer.String("dur").Int64(call_tree.get_node_stop_time(node) - start_time);
+			writer.String("pid").Int(pid);
+			writer.String("tid").Int(tid);
+			writer.EndObject();
+		}
+
+		const node_t::Container &links = call_tree.get_node_links(node);
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			write_events(call_tree, it->second, tid, writer, buffer, tree_events_count);
+		}
+	}
+
+	/*!
+	 * \brief Target stream where trace events will be outputed
+	 */
+	std::ostream &os;
+
+	/*!
+	 * \brief Number of events written to stream
+	 */
+	size_t events_count;
+
+	/*!
+	 * \brief Id of current process
+	 */
+	const int pid;
+
+	/*!
+	 * \brief Stream access synchronization
+	 */
+	std::mutex mutex;
+};
+
+} // namespace react
+
+#endif // REACT_CHROME_TRACE_AGGREGATOR_HPP
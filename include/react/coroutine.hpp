@@ -0,0 +1,152 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_COROUTINE_HPP
+#define REACT_COROUTINE_HPP
+
+#include "react/react.hpp"
+
+#if __cplusplus >= 202002L
+
+#include <coroutine>
+#include <type_traits>
+#include <utility>
+
+namespace react {
+
+/*!
+ * \brief Awaiter that moves react context together with awaiting coroutine
+ *
+ *  Wraps another awaiter: context is suspended right before coroutine suspends
+ *  and resumed on the thread that resumes coroutine.
+ */
+template<typename awaiter_t>
+class tracked_awaiter_t {
+public:
+	/*!
+	 * \brief Wraps \a awaiter, context is kept in \a context while coroutine is suspended
+	 */
+	tracked_awaiter_t(awaiter_t &&awaiter, coroutine_context_t &context):
+		m_awaiter(std::forward<awaiter_t>(awaiter)), m_context(context) {}
+
+	bool await_ready() {
+		return m_awaiter.await_ready();
+	}
+
+	template<typename promise_t>
+	auto await_suspend(std::coroutine_handle<promise_t> handle) {
+		m_context.suspend();
+		try {
+			return m_awaiter.await_suspend(handle);
+		} catch (...) {
+			m_context.resume();
+			throw;
+		}
+	}
+
+	decltype(auto) await_resume() {
+		m_context.resume();
+		return m_awaiter.await_resume();
+	}
+
+private:
+	/*!
+	 * \brief Wrapped awaiter, stored by reference if lvalue was wrapped
+	 */
+	awaiter_t m_awaiter;
+
+	/*!
+	 * \brief Storage of context while coroutine is suspended
+	 */
+	coroutine_context_t &m_context;
+};
+
+namespace detail {
+
+template<typename awaitable_t>
+concept has_member_co_await = requires(awaitable_t &&awaitable) {
+	std::forward<awaitable_t>(awaitable).operator co_await();
+};
+
+template<typename awaitable_t>
+concept has_free_co_await = requires(awaitable_t &&awaitable) {
+	operator co_await(std::forward<awaitable_t>(awaitable));
+};
+
+/*!
+ * \brief Returns awaiter of \a awaitable the way co_await obtains it
+ *
+ *  Member operator co_await is preferred to free one, awaitable without them is awaiter itself.
+ */
+template<typename awaitable_t>
+decltype(auto) get_awaiter(awaitable_t &&awaitable) {
+	if constexpr (has_member_co_await<awaitable_t>) {
+		return std::forward<awaitable_t>(awaitable).operator co_await();
+	} else if constexpr (has_free_co_await<awaitable_t>) {
+		return operator co_await(std::forward<awaitable_t>(awaitable));
+	} else {
+		return std::forward<awaitable_t>(awaitable);
+	}
+}
+
+/*!
+ * \brief Type of awaiter kept by tracked_awaiter_t: lvalues are kept by reference, rvalues by value
+ */
+template<typename awaitable_t>
+using tracked_awaiter_type_t = std::conditional_t<
+	std::is_rvalue_reference_v<decltype(get_awaiter(std::declval<awaitable_t>()))>,
+	std::remove_reference_t<decltype(get_awaiter(std::declval<awaitable_t>()))>,
+	decltype(get_awaiter(std::declval<awaitable_t>()))
+>;
+
+} // namespace detail
+
+/*!
+ * \brief Wraps \a awaitable so react context follows coroutine across threads
+ *
+ *  Awaiter is obtained from operator co_await of \a awaitable if it has one.
+ */
+template<typename awaitable_t>
+tracked_awaiter_t<detail::tracked_awaiter_type_t<awaitable_t>> tracked(awaitable_t &&awaitable,
+		coroutine_context_t &context) {
+	return tracked_awaiter_t<detail::tracked_awaiter_type_t<awaitable_t>>(
+				detail::get_awaiter(std::forward<awaitable_t>(awaitable)), context);
+}
+
+/*!
+ * \brief Base for promise types of coroutines which actions are tracked by react
+ *
+ *  Every co_await in coroutine is wrapped into tracked_awaiter_t,
+ *  so started actions may be stopped after resumption on any thread.
+ */
+class tracked_promise_base_t {
+public:
+	template<typename awaitable_t>
+	tracked_awaiter_t<detail::tracked_awaiter_type_t<awaitable_t>> await_transform(awaitable_t &&awaitable) {
+		return tracked(std::forward<awaitable_t>(awaitable), m_react_context);
+	}
+
+protected:
+	/*!
+	 * \brief Context of suspended coroutine
+	 */
+	coroutine_context_t m_react_context;
+};
+
+} // namespace react
+
+#endif // __cplusplus >= 202002L
+
+#endif // REACT_COROUTINE_HPP
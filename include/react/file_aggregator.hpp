@@ -0,0 +1,227 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_FILE_AGGREGATOR_HPP
+#define REACT_FILE_AGGREGATOR_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "aggregator.hpp"
+#include "file_writer.hpp"
+
+namespace react {
+
+/*!
+ * \brief Aggregator that writes call trees into rotating files through large user-space buffer
+ *
+ *  Each call tree is written as single line of compact json. Files are named "<path>.<number>",
+ *  numbering continues after the highest existing file, so files of previous runs are kept.
+ *  When file is closed, trailing line with offsets of all trees in the file is appended:
+ *  {"react_index":{"trees":2,"offsets":[0,1234]}}
+ */
+class file_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief When written data is synced to disk
+	 */
+	enum sync_policy_t {
+		/*!
+		 * \brief Data is never synced explicitly
+		 */
+		NO_SYNC,
+		/*!
+		 * \brief Data is synced after every buffer flush
+		 */
+		SYNC_ON_FLUSH,
+		/*!
+		 * \brief Data is synced when file is closed on rotation
+		 */
+		SYNC_ON_ROTATE
+	};
+
+	/*!
+	 * \brief Parameters of file aggregator
+	 */
+	struct options_t {
+		/*!
+		 * \brief Initializes default options
+		 */
+		options_t(): buffer_size(1 << 20), max_file_size(1 << 30),
+			rotation_interval(0), flush_interval(1000), sync_policy(NO_SYNC),
+			backend(file_writer_t::POSIX_BACKEND) {}
+
+		/*!
+		 * \brief Size of user-space buffer in bytes
+		 */
+		size_t buffer_size;
+
+		/*!
+		 * \brief File is rotated when it would exceed this size in bytes, 0 disables rotation by size
+		 */
+		size_t max_file_size;
+
+		/*!
+		 * \brief File is rotated when it is older than this interval in seconds, 0 disables rotation by time
+		 *
+		 *  Background thread rotates the file even if no new trees arrive.
+		 */
+		int rotation_interval;
+
+		/*!
+		 * \brief Buffer is flushed when it is older than this interval in milliseconds, 0 disables flush by time
+		 *
+		 *  Background thread flushes buffered trees even if no new trees arrive.
+		 */
+		int flush_interval;
+
+		/*!
+		 * \brief When written data is synced to disk
+		 */
+		sync_policy_t sync_policy;
+
+		/*!
+		 * \brief I/O mechanism used for writing, io_uring falls back to pwrite() when unavailable
+		 */
+		file_writer_t::backend_t backend;
+	};
+
+	/*!
+	 * \brief Constructs aggregator and opens first file
+	 * \param path Prefix of output files names
+	 * \param options Buffering, rotation and sync parameters
+	 */
+	file_aggregator_t(const std::string &path, const options_t &options = options_t());
+
+	/*!
+	 * \brief Flushes buffer, writes index and closes current file
+	 */
+	~file_aggregator_t();
+
+	/*!
+	 * \brief Serializes call tree and appends it to buffer
+	 * \param call_tree Tree that will be written
+	 */
+	void aggregate(const call_tree_t &call_tree);
+
+	/*!
+	 * \brief Writes buffered call trees to current file
+	 */
+	void flush();
+
+	/*!
+	 * \brief Returns name of file currently written
+	 */
+	std::string get_current_file_name() const;
+
+	/*!
+	 * \brief Returns I/O mechanism actually used for writing
+	 */
+	file_writer_t::backend_t get_backend() const;
+
+	/*!
+	 * \brief Returns number of bytes handed over to kernel but not yet written
+	 */
+	size_t get_in_flight_bytes() const;
+
+private:
+	typedef std::chrono::steady_clock clock_t;
+
+	std::string get_file_name(size_t number) const;
+	size_t find_next_file_number() const;
+	void open_file();
+	void close_file();
+	void rotate_if_needed(size_t record_size);
+	void flush_buffer();
+	void flush_loop();
+
+	/*!
+	 * \brief Prefix of output files names
+	 */
+	const std::string path;
+
+	/*!
+	 * \brief Buffering, rotation and sync parameters
+	 */
+	const options_t options;
+
+	/*!
+	 * \brief Buffered writer of current file
+	 */
+	std::unique_ptr<file_writer_t> writer;
+
+	/*!
+	 * \brief Whether current file is open
+	 */
+	bool file_opened;
+
+	/*!
+	 * \brief Number of current file
+	 */
+	size_t file_number;
+
+	/*!
+	 * \brief Size of current file including buffered data
+	 */
+	size_t file_size;
+
+	/*!
+	 * \brief Offsets of call trees in current file
+	 */
+	std::vector<size_t> offsets;
+
+	/*!
+	 * \brief Time when current file was opened
+	 */
+	clock_t::time_point file_open_time;
+
+	/*!
+	 * \brief Time when the oldest unflushed tree was buffered
+	 */
+	clock_t::time_point flush_time;
+
+	/*!
+	 * \brief Whether buffer has trees appended since last flush
+	 */
+	bool has_unflushed_data;
+
+	/*!
+	 * \brief Files and buffer access synchronization
+	 */
+	mutable std::mutex mutex;
+
+	/*!
+	 * \brief Wakes flush thread up on new buffered data and on shutdown
+	 */
+	std::condition_variable flush_condition;
+
+	/*!
+	 * \brief Whether flush thread must exit
+	 */
+	bool is_stopping;
+
+	/*!
+	 * \brief Thread flushing buffer and rotating files by time, started if either interval is set
+	 */
+	std::thread flush_thread;
+};
+
+} // namespace react
+
+#endif // REACT_FILE_AGGREGATOR_HPP
@@ -0,0 +1,104 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_FILE_WRITER_HPP
+#define REACT_FILE_WRITER_HPP
+
+#include <memory>
+#include <string>
+
+namespace react {
+
+/*!
+ * \brief Buffered sequential writer of single file used by file aggregators
+ */
+class file_writer_t {
+public:
+	/*!
+	 * \brief I/O mechanism used for writing
+	 */
+	enum backend_t {
+		/*!
+		 * \brief Buffer is written with blocking pwrite()
+		 */
+		POSIX_BACKEND,
+		/*!
+		 * \brief Buffers are registered in io_uring and written asynchronously
+		 */
+		IO_URING_BACKEND
+	};
+
+	/*!
+	 * \brief Creates writer with requested \a backend
+	 *
+	 *  If io_uring is not available at build or run time, pwrite() writer is returned.
+	 * \param backend Requested I/O mechanism
+	 * \param buffer_size Size of single user-space buffer in bytes
+	 * \return Newly created writer
+	 */
+	static std::unique_ptr<file_writer_t> create(backend_t backend, size_t buffer_size);
+
+	/*!
+	 * \brief Returns whether io_uring is available at build and run time
+	 *
+	 *  Running kernel may not support io_uring or it may be forbidden by seccomp or sysctl.
+	 */
+	static bool is_io_uring_available();
+
+	/*!
+	 * \brief Frees memory consumed by writer
+	 */
+	virtual ~file_writer_t() {}
+
+	/*!
+	 * \brief Returns I/O mechanism actually used by writer
+	 */
+	virtual backend_t get_backend() const = 0;
+
+	/*!
+	 * \brief Closes current file if any and creates new file \a file_name
+	 * \throw std::runtime_error if file can't be created or already exists
+	 */
+	virtual void open(const std::string &file_name) = 0;
+
+	/*!
+	 * \brief Appends data to the end of file through buffer
+	 */
+	virtual void append(const char *data, size_t size) = 0;
+
+	/*!
+	 * \brief Hands buffered data over to kernel
+	 */
+	virtual void flush() = 0;
+
+	/*!
+	 * \brief Waits for all handed over data and syncs it to disk
+	 */
+	virtual void sync() = 0;
+
+	/*!
+	 * \brief Writes all buffered data and closes file
+	 */
+	virtual void close() = 0;
+
+	/*!
+	 * \brief Returns number of bytes handed over to kernel but not yet written
+	 */
+	virtual size_t get_in_flight_bytes() const = 0;
+};
+
+} // namespace react
+
+#endif // REACT_FILE_WRITER_HPP
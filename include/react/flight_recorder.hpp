@@ -0,0 +1,235 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_FLIGHT_RECORDER_HPP
+#define REACT_FLIGHT_RECORDER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "actions_set.hpp"
+#include "call_tree.hpp"
+
+namespace react {
+
+/*!
+ * \brief Fixed-size buffer of action start and stop events of single request
+ *
+ *  Recording is a store into preallocated array, call tree is built from events only on demand,
+ *  so requests whose trees are not needed are discarded with reset() without building anything.
+ *  Events that do not fit into buffer are dropped and tree built from truncated buffer is marked.
+ *  Actions are validated when recorded, so recorded events always form a tree.
+ */
+class flight_recorder_t {
+public:
+	/*!
+	 * \brief Default maximum number of events
+	 */
+	static const size_t DEFAULT_CAPACITY = 4096;
+
+	/*!
+	 * \brief Preallocates buffer for \a capacity events of actions defined in \a actions_set
+	 */
+	flight_recorder_t(const actions_set_t &actions_set, size_t capacity = DEFAULT_CAPACITY):
+		actions_set(actions_set), events(std::max<size_t>(capacity, 1)),
+		events_count(0), is_truncated(false), start_time(0) {}
+
+	/*!
+	 * \brief Drops recorded events and stats and remembers start time of new request
+	 */
+	void reset() {
+		events_count = 0;
+		is_truncated = false;
+		open_actions.clear();
+		stats.clear();
+		start_time = get_current_time();
+	}
+
+	/*!
+	 * \brief Records start of action with \a action_code
+	 * \throw std::invalid_argument if action code is invalid
+	 */
+	void start(int action_code) {
+		if (!actions_set.code_is_valid(action_code) || action_code == actions_set_t::NO_ACTION) {
+			throw std::invalid_argument("Can't start action: action code is invalid: "
+										+ std::to_string(static_cast<long long>(action_code)));
+		}
+
+		open_actions.push_back(action_code);
+		push(action_code, START_EVENT);
+	}
+
+	/*!
+	 * \brief Records stop of action with \a action_code
+	 * \throw std::logic_error if \a action_code is not the last started action
+	 */
+	void stop(int action_code) {
+		if (open_actions.empty()) {
+			throw std::logic_error("Can't stop action: no action was started");
+		}
+
+		if (open_actions.back() != action_code) {
+			throw std::logic_error("Stopping wrong action. Expected: "
+								   + actions_set.get_action_name(open_actions.back())
+								   + ", Found: " + actions_set.get_action_name(action_code));
+		}
+
+		open_actions.pop_back();
+		push(action_code, STOP_EVENT);
+	}
+
+	/*!
+	 * \brief Records stat of request
+	 */
+	void add_stat(const std::string &key, const stat_value_t &value) {
+		stats.push_back(std::make_pair(key, value));
+	}
+
+	/*!
+	 * \brief Returns time passed since reset() in microseconds
+	 */
+	int64_t get_elapsed_time() const {
+		return get_current_time() - start_time;
+	}
+
+	/*!
+	 * \brief Returns number of recorded events
+	 */
+	size_t size() const {
+		return events_count;
+	}
+
+	/*!
+	 * \brief Returns whether some events were dropped because buffer was full
+	 */
+	bool truncated() const {
+		return is_truncated;
+	}
+
+	/*!
+	 * \brief Replays recorded events and stats into \a call_tree
+	 *
+	 *  Actions left open by truncation are stopped at the time of the last recorded event,
+	 *  call tree of truncated buffer gets "truncated" stat.
+	 * \throw std::logic_error if stop event does not match the last started action
+	 */
+	void build_call_tree(call_tree_t &call_tree) const {
+		for (auto it = stats.begin(); it != stats.end(); ++it) {
+			call_tree.add_stat(it->first, it->second);
+		}
+
+		std::vector<call_tree_t::p_node_t> stack(1, call_tree.root);
+		int64_t last_time = start_time;
+		for (size_t i = 0; i < events_count; ++i) {
+			const event_t &event = events[i];
+			last_time = event.time;
+
+			if (event.type == START_EVENT) {
+				call_tree_t::p_node_t node = call_tree.add_new_link(stack.back(), event.action_code);
+				call_tree.set_node_start_time(node, event.time);
+				stack.push_back(node);
+				continue;
+			}
+
+			if (stack.size() == 1 || call_tree.get_node_action_code(stack.back()) != event.action_code) {
+				throw std::logic_error("Can't build call tree from flight recorder: stopping action "
+									   + call_tree.get_actions_set().get_action_name(event.action_code)
+									   + " which was not started last");
+			}
+			call_tree.set_node_stop_time(stack.back(), event.time);
+			stack.pop_back();
+		}
+
+		for (; stack.size() > 1; stack.pop_back()) {
+			call_tree.set_node_stop_time(stack.back(), last_time);
+		}
+
+		if (is_truncated) {
+			call_tree.add_stat("truncated", true);
+		}
+	}
+
+private:
+	enum event_type_t {
+		START_EVENT,
+		STOP_EVENT
+	};
+
+	struct event_t {
+		int action_code;
+		event_type_t type;
+		int64_t time;
+	};
+
+	static int64_t get_current_time() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	void push(int action_code, event_type_t type) {
+		if (events_count == events.size()) {
+			is_truncated = true;
+			return;
+		}
+
+		event_t &event = events[events_count++];
+		event.action_code = action_code;
+		event.type = type;
+		event.time = get_current_time();
+	}
+
+	/*!
+	 * \brief Actions which codes are recorded
+	 */
+	const actions_set_t &actions_set;
+
+	/*!
+	 * \brief Preallocated events buffer
+	 */
+	std::vector<event_t> events;
+
+	/*!
+	 * \brief Number of recorded events
+	 */
+	size_t events_count;
+
+	/*!
+	 * \brief Whether some events were dropped
+	 */
+	bool is_truncated;
+
+	/*!
+	 * \brief Codes of started and not stopped actions, including dropped ones
+	 */
+	std::vector<int> open_actions;
+
+	/*!
+	 * \brief Time of reset() in microseconds since epoch
+	 */
+	int64_t start_time;
+
+	/*!
+	 * \brief Stats of request in order they were added
+	 */
+	std::vector<std::pair<std::string, stat_value_t>> stats;
+};
+
+} // namespace react
+
+#endif // REACT_FLIGHT_RECORDER_HPP
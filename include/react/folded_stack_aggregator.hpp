@@ -0,0 +1,192 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_FOLDED_STACK_AGGREGATOR_HPP
+#define REACT_FOLDED_STACK_AGGREGATOR_HPP
+
+#include <algorithm>
+#include <map>
+#include <ostream>
+#include <mutex>
+
+#include "aggregator.hpp"
+#include "path_aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Aggregator that accumulates call trees as collapsed stacks weighted by self time
+ *
+ *  Output has one line per distinct stack in format "READ;FIND;LOAD FROM DISK 1234",
+ *  where weight is exclusive time of the last action in microseconds.
+ *  It is ready to be passed to flamegraph tooling. Memory is bounded by number of distinct stacks.
+ */
+class folded_stack_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Constructs empty aggregator
+	 * \param actions_set Actions set used to resolve action names on dump
+	 */
+	folded_stack_aggregator_t(const actions_set_t &actions_set): actions_set(actions_set) {}
+
+	/*!
+	 * \brief Frees memory consumed by folded_stack_aggregator
+	 */
+	~folded_stack_aggregator_t() {}
+
+	/*!
+	 * \brief Adds self time of every action of \a call_tree to corresponding stack
+	 * \param call_tree Tree that will be aggregated
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		std::vector<int> path;
+		std::lock_guard<std::mutex> guard(mutex);
+		aggregate(call_tree, call_tree.root, path);
+	}
+
+	/*!
+	 * \brief Adds self time of every path of \a path_tree to corresponding stack
+	 *
+	 *  Self time of path is its total time minus total time of its child paths.
+	 * \param path_tree Paths that will be aggregated
+	 */
+	void aggregate_paths(const path_tree_t &path_tree) {
+		std::vector<int> path;
+		std::lock_guard<std::mutex> guard(mutex);
+		aggregate_paths(path_tree, path_tree.root, path);
+	}
+
+	/*!
+	 * \brief Outputs accumulated stacks into stream
+	 * \param os Stream where stacks will be outputed
+	 */
+	void dump(std::ostream &os) const {
+		std::lock_guard<std::mutex> guard(mutex);
+		for (auto it = stacks.begin(); it != stacks.end(); ++it) {
+			for (size_t i = 0; i < it->first.size(); ++i) {
+				if (i != 0) {
+					os << ';';
+				}
+				os << get_frame_name(it->first[i]);
+			}
+			os << ' ' << it->second << '\n';
+		}
+		os.flush();
+	}
+
+	/*!
+	 * \brief Drops all accumulated stacks
+	 */
+	void clear() {
+		std::lock_guard<std::mutex> guard(mutex);
+		stacks.clear();
+	}
+
+	/*!
+	 * \brief Returns number of distinct accumulated stacks
+	 */
+	size_t size() const {
+		std::lock_guard<std::mutex> guard(mutex);
+		return stacks.size();
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Recursively accumulates self time of subtree of \a node
+	 * \param path Stack of action codes leading to \a node
+	 */
+	void aggregate(const call_tree_t &call_tree, call_tree_t::p_node_t node, std::vector<int> &path) {
+		const node_t::Container &links = call_tree.get_node_links(node);
+
+		if (node != call_tree.root) {
+			int64_t self_time = get_duration(call_tree, node);
+			for (auto it = links.begin(); it != links.end(); ++it) {
+				self_time -= get_duration(call_tree, it->second);
+			}
+			stacks[path] += std::max<int64_t>(self_time, 0);
+		}
+
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			path.push_back(it->first);
+			aggregate(call_tree, it->second, path);
+			path.pop_back();
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Recursively accumulates self time of paths under \a node
+	 * \param path Stack of action codes leading to \a node
+	 */
+	void aggregate_paths(const path_tree_t &path_tree, path_tree_t::p_node_t node, std::vector<int> &path) {
+		const auto &links = path_tree.get_node_links(node);
+
+		if (node != path_tree.root) {
+			int64_t self_time = path_tree.get_histogram(node).get_sum();
+			for (auto it = links.begin(); it != links.end(); ++it) {
+				self_time -= path_tree.get_histogram(it->second).get_sum();
+			}
+			stacks[path] += std::max<int64_t>(self_time, 0);
+		}
+
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			path.push_back(it->first);
+			aggregate_paths(path_tree, it->second, path);
+			path.pop_back();
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns inclusive time of action represented by \a node
+	 */
+	static int64_t get_duration(const call_tree_t &call_tree, call_tree_t::p_node_t node) {
+		return call_tree.get_node_stop_time(node) - call_tree.get_node_start_time(node);
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns action name with stack separators replaced
+	 */
+	std::string get_frame_name(int action_code) const {
+		std::string name = actions_set.get_action_name(action_code);
+		std::replace(name.begin(), name.end(), ';', ':');
+		return name;
+	}
+
+	/*!
+	 * \brief Available actions for monitoring
+	 */
+	const actions_set_t &actions_set;
+
+	/*!
+	 * \brief Accumulated self time of every distinct stack
+	 */
+	std::map<std::vector<int>, int64_t> stacks;
+
+	/*!
+	 * \brief Stacks access synchronization
+	 */
+	mutable std::mutex mutex;
+};
+
+} // namespace react
+
+#endif // REACT_FOLDED_STACK_AGGREGATOR_HPP
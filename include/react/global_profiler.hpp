@@ -18,11 +18,29 @@
 
 #include "react/react.hpp"
 #include "react/utils.hpp"
+#include "react/call_tree_log.hpp"
+#include "react/path_recorder.hpp"
+#include "react/lock_free_call_tree.hpp"
 
-#include <thread>
+#include <atomic>
+#include <csignal>
+#include <condition_variable>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
 
+#ifndef CONTINUOUS_REACT_OUTPUT
 #define CONTINUOUS_REACT_OUTPUT 0
+#endif
+
+#ifndef FOLDED_REACT_OUTPUT
+#define FOLDED_REACT_OUTPUT 0
+#endif
+
+#ifndef MERGE_REACT_OUTPUT
+#define MERGE_REACT_OUTPUT 0
+#endif
 
 namespace react {
 
@@ -36,36 +54,37 @@ std::string get_thread_id();
  */
 
 #define PROFILE_FUNC_GLOBAL()\
-static thread_local const int react_defined_action = react::global_profiler_t::get_profiler().get_action_set().define_new_action( \
-	__FUNCTION__ + std::string("_") + react::get_thread_id()); \
-react::action_guard_t react_defined_guard(react::global_profiler_t::get_updater(), react_defined_action);
+static const react::global_action_t react_defined_action(__FUNCTION__); \
+static thread_local int react_defined_thread_action = react::actions_set_t::NO_ACTION; \
+react::global_action_guard_t react_defined_guard(react_defined_action, react_defined_thread_action);
 
 #define MERGE_PROFILE_FUNC_GLOBAL()\
-static thread_local const int react_defined_action = react::global_profiler_t::get_profiler().get_action_set().define_new_action( \
-	__FUNCTION__ + std::string("_") + react::get_thread_id() + "_merge"); \
-react::action_guard_t react_defined_guard(react::global_profiler_t::get_updater(), react_defined_action, true);
+static const react::global_action_t react_defined_action(__FUNCTION__, "_merge"); \
+static thread_local int react_defined_thread_action = react::actions_set_t::NO_ACTION; \
+react::global_action_guard_t react_defined_guard(react_defined_action, react_defined_thread_action, true);
 
 #define SAMPLE_MERGE_PROFILE_FUNC_GLOBAL(SAMPLE_PERIOD)\
 static int react_sample_counter = 0; \
-static thread_local const int react_defined_action = react::global_profiler_t::get_profiler().get_action_set().define_new_action( \
-	__FUNCTION__ + std::string("_") + react::get_thread_id() + "_sample_" + std::to_string(SAMPLE_PERIOD)); \
-react::action_guard_t react_defined_guard(react::global_profiler_t::get_updater(), react_defined_action, ((react_sample_counter++) % SAMPLE_PERIOD) != 0);
+static const react::global_action_t react_defined_action(__FUNCTION__, "_sample_" + std::to_string(SAMPLE_PERIOD)); \
+static thread_local int react_defined_thread_action = react::actions_set_t::NO_ACTION; \
+react::global_action_guard_t react_defined_guard(react_defined_action, react_defined_thread_action, ((react_sample_counter++) % SAMPLE_PERIOD) != 0);
 
 #define PROFILE_BLOCK_GLOBAL(NAME)\
-static thread_local const int react_defined_action_ ## NAME = react::global_profiler_t::get_profiler().get_action_set().define_new_action( \
-	#NAME + std::string("_") + react::get_thread_id()); \
-react::action_guard_t react_defined_guard(react::global_profiler_t::get_updater(), react_defined_action_ ## NAME);
+static const react::global_action_t react_defined_action_ ## NAME(#NAME); \
+static thread_local int react_defined_thread_action_ ## NAME = react::actions_set_t::NO_ACTION; \
+react::global_action_guard_t react_defined_guard(react_defined_action_ ## NAME, react_defined_thread_action_ ## NAME);
 
 #define MERGE_PROFILE_BLOCK_GLOBAL(NAME)\
-static thread_local const int react_defined_action_ ## NAME = react::global_profiler_t::get_profiler().get_action_set().define_new_action( \
-	#NAME + std::string("_") + react::get_thread_id() + "_merge"); \
-react::action_guard_t react_defined_guard(react::global_profiler_t::get_updater(), react_defined_action_ ## NAME, true);
+static const react::global_action_t react_defined_action_ ## NAME(#NAME, "_merge"); \
+static thread_local int react_defined_thread_action_ ## NAME = react::actions_set_t::NO_ACTION; \
+react::global_action_guard_t react_defined_guard(react_defined_action_ ## NAME, react_defined_thread_action_ ## NAME, true);
 
 #define SAMPLE_MERGE_PROFILE_BLOCK_GLOBAL(NAME, SAMPLE_PERIOD)\
 static int react_sample_counter ## NAME = 0; \
-static thread_local const int react_defined_action_ ## NAME = react::global_profiler_t::get_profiler().get_action_set().define_new_action( \
-#NAME + std::string("_") + react::get_thread_id() + "_sample_" + std::to_string(SAMPLE_PERIOD)); \
-react::action_guard_t react_defined_guard(react::global_profiler_t::get_updater(), react_defined_action_ ## NAME, ((react_sample_counter ## NAME ++) % SAMPLE_PERIOD) != 0);
+static const react::global_action_t react_defined_action_ ## NAME(#NAME, "_sample_" + std::to_string(SAMPLE_PERIOD)); \
+static thread_local int react_defined_thread_action_ ## NAME = react::actions_set_t::NO_ACTION; \
+react::global_action_guard_t react_defined_guard(react_defined_action_ ## NAME, react_defined_thread_action_ ## NAME, \
+	((react_sample_counter ## NAME ++) % SAMPLE_PERIOD) != 0);
 
 namespace react {
 
@@ -74,9 +93,76 @@ namespace react {
  * \brief Class to manage global action set and call tree and per-thread call tree updater.
  *
  *  Allows you to globally log actions in call-tree manner, new threads will attach to root.
+ *  Output is configured at startup from REACT_OUTPUT, REACT_INTERVAL, REACT_CONTINUOUS,
+ *  REACT_FORMAT, REACT_MERGE, REACT_PER_CPU and REACT_LOCK_FREE environment variables and can be changed
+ *  later with configure(). In merging mode actions of all macros are merged by call path, so memory is bounded
+ *  by code paths, per-CPU merging additionally bounds it by number of CPUs instead of threads.
+ *  In lock-free mode actions are recorded into shared call tree without taking locks.
  */
 class global_profiler_t {
 public:
+	/*!
+	 * \brief Formats of call tree dump, can be combined
+	 */
+	enum output_format_t {
+		JSON_OUTPUT = 1,
+		FOLDED_OUTPUT = 2,
+		ALL_OUTPUT = JSON_OUTPUT | FOLDED_OUTPUT
+	};
+
+	/*!
+	 * \brief Profiler output parameters.
+	 */
+	struct options_t {
+		/*!
+		 * \brief Initializes options with compile-time defaults.
+		 */
+		options_t()
+			: output_path("log.react")
+			, refresh_interval(1000)
+			, continuous(CONTINUOUS_REACT_OUTPUT)
+			, format(FOLDED_REACT_OUTPUT ? ALL_OUTPUT : JSON_OUTPUT)
+			, merge_paths(MERGE_REACT_OUTPUT)
+			, lock_free(false)
+			, per_cpu(false)
+		{}
+
+		/*!
+		 * \brief Dump file path, folded stacks go to path + ".folded", deltas to path + ".delta".
+		 */
+		std::string		output_path;
+
+		/*!
+		 * \brief Continuous output interval in milliseconds.
+		 */
+		int				refresh_interval;
+
+		/*!
+		 * \brief If deltas are continuously written to delta log.
+		 */
+		bool			continuous;
+
+		/*!
+		 * \brief Formats of call tree dumps.
+		 */
+		output_format_t	format;
+
+		/*!
+		 * \brief If actions are merged by path into statistics instead of call tree nodes.
+		 */
+		bool			merge_paths;
+
+		/*!
+		 * \brief If actions are recorded into shared call tree updated without locks, ignored in merging mode.
+		 */
+		bool			lock_free;
+
+		/*!
+		 * \brief If merged paths are recorded into per-CPU shards instead of per-thread trees, used in merging mode.
+		 */
+		bool			per_cpu;
+	};
+
 	/*!
 	 * \brief Returns global profiler action set.
 	 */
@@ -92,12 +178,96 @@ public:
 	 */
 	static react::call_tree_updater_t* get_updater();
 
+	/*!
+	 * \brief Returns per-thread cursor in path tree used in merging mode.
+	 */
+	static react::path_cursor_t* get_path_cursor();
+
+	/*!
+	 * \brief Returns per-thread cursor recording into per-CPU shards used in per-CPU merging mode.
+	 */
+	static react::per_cpu_cursor_t* get_per_cpu_cursor();
+
+	/*!
+	 * \brief Returns per-thread updater of lock-free call tree, must be called only in lock-free mode.
+	 */
+	static react::lock_free_updater_t* get_lock_free_updater();
+
+	/*!
+	 * \brief Returns snapshot of global call tree, or of lock-free call tree in lock-free mode.
+	 */
+	react::call_tree_t copy_call_tree() const;
+
+	/*!
+	 * \brief Returns paths merged in merging mode.
+	 */
+	react::path_tree_t copy_path_tree() const;
+
+	/*!
+	 * \brief Returns if actions are merged by path.
+	 */
+	bool is_merging_paths() const {
+		return m_merge_paths.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	 * \brief Returns if actions are recorded into lock-free call tree.
+	 */
+	bool is_lock_free() const {
+		return m_lock_free.load(std::memory_order_acquire);
+	}
+
+	/*!
+	 * \brief Returns if merged paths are recorded into per-CPU shards.
+	 */
+	bool is_per_cpu() const {
+		return m_per_cpu.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	 * \brief Applies new output parameters, restarts profiler thread if needed.
+	 * \throw std::invalid_argument if refresh interval is not positive.
+	 */
+	void configure(const options_t &options);
+
+	/*!
+	 * \brief Returns current output parameters.
+	 */
+	options_t get_options() const;
+
+	/*!
+	 * \brief Returns \a options overridden by REACT_* environment variables, invalid values are reported and ignored.
+	 */
+	static options_t read_environment(const options_t &options);
+
+	/*!
+	 * \brief Asks profiler thread to dump call tree, starts the thread if needed.
+	 */
+	void request_dump();
+
+	/*!
+	 * \brief Makes \a signal_number trigger dump on profiler thread.
+	 * \throw std::runtime_error if signal handler can't be installed.
+	 */
+	void install_dump_signal(int signal_number = SIGUSR2);
+
+	/*!
+	 * \brief Restores handler that dump signal had before install_dump_signal(), stops polling for it.
+	 * \throw std::runtime_error if previous signal handler can't be restored.
+	 */
+	void uninstall_dump_signal();
+
+	/*!
+	 * \brief Returns number of dumps made on request.
+	 */
+	size_t get_dumps_count() const;
+
 private:
 	/*!
 	 * \brief Initializes profiler.
-	 * \param name Output filename.
+	 * \param options Output parameters.
 	 */
-	global_profiler_t(const std::string &file_name);
+	global_profiler_t(const options_t &options);
 
 	/*!
 	 * \brief Stop output thread if exists and output collected data.
@@ -105,14 +275,39 @@ private:
 	~global_profiler_t();
 
 	/*!
-	 * \brief Continuously output collected data(optional).
+	 * \brief Starts profiler thread if it is not running, must be called under m_mutex.
+	 */
+	void start_thread();
+
+	/*!
+	 * \brief Stops profiler thread if it is running.
+	 */
+	void stop_thread();
+
+	/*!
+	 * \brief Restores previous handler of dump signal, must be called under m_mutex.
+	 */
+	void restore_dump_signal();
+
+	/*!
+	 * \brief Continuously output collected data and serves dump requests.
 	 */
 	void profile_loop();
 
 	/*!
 	 * \brief Writes current call tre to out file.
 	 */
-	void write_call_tree();
+	void write_call_tree(const options_t &options);
+
+	/*!
+	 * \brief Writes paths merged in merging mode to out file.
+	 */
+	void write_path_tree(const options_t &options);
+
+	/*!
+	 * \brief Appends changes of call tree to delta log, compacts log every m_compaction_period calls.
+	 */
+	void write_call_tree_delta();
 
 	/*!
 	 * \brief Global action set.
@@ -124,6 +319,36 @@ private:
 	 */
 	react::concurrent_call_tree_t	m_call_tree;
 
+	/*!
+	 * \brief Paths of actions recorded in merging mode.
+	 */
+	react::path_recorder_t			m_path_recorder;
+
+	/*!
+	 * \brief Copy of m_options.merge_paths read by action guards.
+	 */
+	std::atomic<bool>				m_merge_paths;
+
+	/*!
+	 * \brief Paths of actions recorded in per-CPU merging mode.
+	 */
+	react::per_cpu_recorder_t		m_per_cpu_recorder;
+
+	/*!
+	 * \brief Copy of m_options.per_cpu read by action guards.
+	 */
+	std::atomic<bool>				m_per_cpu;
+
+	/*!
+	 * \brief Shared call tree of lock-free mode, created when the mode is enabled for the first time.
+	 */
+	std::unique_ptr<react::lock_free_call_tree_t>	m_lock_free_tree;
+
+	/*!
+	 * \brief Copy of m_options.lock_free read by action guards, set after m_lock_free_tree is created.
+	 */
+	std::atomic<bool>				m_lock_free;
+
 	/*!
 	 * \brief Global aggregator.
 	 */
@@ -140,26 +365,212 @@ private:
 	std::ofstream					m_output;
 
 	/*!
-	 * \brief Output file name.
+	 * \brief Output parameters.
+	 */
+	options_t						m_options;
+
+	/*!
+	 * \brief Serializes stopping and starting of profiler thread, taken before m_mutex.
 	 */
-	std::string						m_name;
+	std::mutex						m_thread_mutex;
 
 	/*!
-	 * \brief Output refresh interval.
+	 * \brief Guards options, thread state and dump requests.
 	 */
-	const int						m_refresh_interval;
+	mutable std::mutex				m_mutex;
 
 	/*!
-	 * \brief If continuous output active.
+	 * \brief Wakes profiler thread up.
+	 */
+	std::condition_variable			m_condition;
+
+	/*!
+	 * \brief If profiler thread is running.
 	 */
 	bool							m_active;
 
+	/*!
+	 * \brief If dump was requested through API.
+	 */
+	bool							m_dump_requested;
+
+	/*!
+	 * \brief If dump signal handler is installed, profiler thread then polls for signals.
+	 */
+	bool							m_signal_installed;
+
+	/*!
+	 * \brief Installed dump signal.
+	 */
+	int								m_signal_number;
+
+	/*!
+	 * \brief Handler that dump signal had before it was installed.
+	 */
+	struct sigaction				m_previous_signal_action;
+
+	/*!
+	 * \brief Number of dumps made on request.
+	 */
+	size_t							m_dumps_count;
+
+	/*!
+	 * \brief Continuous output log of call tree deltas.
+	 */
+	std::unique_ptr<react::call_tree_log_t>	m_delta_log;
+
+	/*!
+	 * \brief Number of refresh intervals between delta log compactions.
+	 */
+	const int						m_compaction_period;
+
+	/*!
+	 * \brief Number of delta log updates.
+	 */
+	int								m_deltas_count;
+
 	/*!
 	 * \brief Profiler instance.
 	 */
 	static global_profiler_t		m_profiler;
 };
 
+/*!
+ * \brief Action of global profiler macro call site.
+ *
+ *  Merging modes record all threads into the same path, so their action name does not depend on thread.
+ *  Call trees keep per-thread action named after thread, it is defined on first use by that thread.
+ */
+class global_action_t {
+public:
+	/*!
+	 * \brief Defines path action named \a name followed by \a suffix.
+	 */
+	global_action_t(const std::string &name, const std::string &suffix = std::string())
+		: m_name(name)
+		, m_suffix(suffix)
+		, m_path_action_code(global_profiler_t::get_profiler().get_action_set().define_new_action(name + suffix))
+	{}
+
+	/*!
+	 * \brief Returns action shared by all threads.
+	 */
+	int get_path_action_code() const {
+		return m_path_action_code;
+	}
+
+	/*!
+	 * \brief Returns action of calling thread, \a thread_action_code caches it.
+	 */
+	int get_thread_action_code(int &thread_action_code) const {
+		if (thread_action_code == react::actions_set_t::NO_ACTION) {
+			thread_action_code = global_profiler_t::get_profiler().get_action_set().define_new_action(
+						m_name + "_" + react::get_thread_id() + m_suffix);
+		}
+		return thread_action_code;
+	}
+
+private:
+	/*!
+	 * \brief Name of call site.
+	 */
+	const std::string				m_name;
+
+	/*!
+	 * \brief Suffix of macro kind.
+	 */
+	const std::string				m_suffix;
+
+	/*!
+	 * \brief Code of action shared by all threads.
+	 */
+	const int						m_path_action_code;
+};
+
+/*!
+ * \brief Guard used by global profiler macros.
+ *
+ *  Records action into global call tree or, in merging mode, into path tree of calling thread
+ *  or of current CPU.
+ *  Mode is chosen when action starts, so switching mode does not break started actions.
+ */
+class global_action_guard_t {
+public:
+	/*!
+	 * \brief Starts \a action.
+	 * \param thread_action_code Per-thread cache of thread action code used outside of merging mode.
+	 * \param merge When true call tree nodes with the same path are merged, always true in merging mode.
+	 */
+	global_action_guard_t(const global_action_t &action, int &thread_action_code, bool merge = false)
+		: m_action_code(react::actions_set_t::NO_ACTION)
+		, m_updater(NULL)
+		, m_cursor(NULL)
+		, m_per_cpu_cursor(NULL)
+		, m_lock_free_updater(NULL)
+	{
+		bool is_merging_paths = global_profiler_t::get_profiler().is_merging_paths();
+		m_action_code = is_merging_paths ? action.get_path_action_code()
+										 : action.get_thread_action_code(thread_action_code);
+
+		if (is_merging_paths && global_profiler_t::get_profiler().is_per_cpu()) {
+			m_per_cpu_cursor = global_profiler_t::get_per_cpu_cursor();
+			m_per_cpu_cursor->start(m_action_code);
+		} else if (is_merging_paths) {
+			m_cursor = global_profiler_t::get_path_cursor();
+			m_cursor->start(m_action_code);
+		} else if (global_profiler_t::get_profiler().is_lock_free()) {
+			m_lock_free_updater = global_profiler_t::get_lock_free_updater();
+			m_lock_free_updater->start(m_action_code, merge);
+		} else {
+			m_updater = global_profiler_t::get_updater();
+			m_updater->start(m_action_code, merge);
+		}
+	}
+
+	/*!
+	 * \brief Stops action.
+	 */
+	~global_action_guard_t() {
+		if (m_cursor) {
+			m_cursor->stop(m_action_code);
+		} else if (m_per_cpu_cursor) {
+			m_per_cpu_cursor->stop(m_action_code);
+		} else if (m_lock_free_updater) {
+			m_lock_free_updater->stop(m_action_code);
+		} else {
+			m_updater->stop(m_action_code);
+		}
+	}
+
+private:
+	global_action_guard_t(const global_action_guard_t &);
+	global_action_guard_t &operator =(const global_action_guard_t &);
+
+	/*!
+	 * \brief Code of guarded action.
+	 */
+	int								m_action_code;
+
+	/*!
+	 * \brief Updater of global call tree if action is recorded there.
+	 */
+	react::call_tree_updater_t		*m_updater;
+
+	/*!
+	 * \brief Path cursor of the thread in merging mode.
+	 */
+	react::path_cursor_t			*m_cursor;
+
+	/*!
+	 * \brief Per-CPU cursor of the thread in per-CPU merging mode.
+	 */
+	react::per_cpu_cursor_t			*m_per_cpu_cursor;
+
+	/*!
+	 * \brief Updater of lock-free call tree in lock-free mode.
+	 */
+	react::lock_free_updater_t		*m_lock_free_updater;
+};
 }
 
 #endif //__react_global_profiler_h__
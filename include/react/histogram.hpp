@@ -0,0 +1,213 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_HISTOGRAM_HPP
+#define REACT_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "rapidjson/document.h"
+
+namespace react {
+
+/*!
+ * \brief Mergeable latency sketch with log-linear buckets
+ *
+ *  Values below 2^SUB_BUCKET_BITS are counted exactly, larger values fall into one of
+ *  2^SUB_BUCKET_BITS buckets per power of two, so relative error of quantiles is below 1/32.
+ *  Memory is bounded by logarithm of maximum value, histograms of different threads or requests
+ *  are merged by adding bucket counters.
+ */
+class histogram_t {
+public:
+	/*!
+	 * \brief Number of quantiles exported to json
+	 */
+	static const size_t QUANTILES_COUNT = 5;
+
+	/*!
+	 * \brief Initializes empty histogram
+	 */
+	histogram_t(): count(0), sum(0), min(std::numeric_limits<int64_t>::max()), max(0) {}
+
+	/*!
+	 * \brief Adds \a value measured \a times times, negative values are counted as zero
+	 */
+	void add(int64_t value, uint64_t times = 1) {
+		if (times == 0) {
+			return;
+		}
+
+		value = std::max<int64_t>(value, 0);
+		size_t index = get_bucket_index(value);
+		if (index >= buckets.size()) {
+			buckets.resize(index + 1, 0);
+		}
+		buckets[index] += times;
+
+		count += times;
+		sum += value * static_cast<int64_t>(times);
+		min = std::min(min, value);
+		max = std::max(max, value);
+	}
+
+	/*!
+	 * \brief Adds all values counted in \a other histogram
+	 */
+	void merge(const histogram_t &other) {
+		if (other.count == 0) {
+			return;
+		}
+
+		if (other.buckets.size() > buckets.size()) {
+			buckets.resize(other.buckets.size(), 0);
+		}
+		for (size_t i = 0; i < other.buckets.size(); ++i) {
+			buckets[i] += other.buckets[i];
+		}
+
+		count += other.count;
+		sum += other.sum;
+		min = std::min(min, other.min);
+		max = std::max(max, other.max);
+	}
+
+	/*!
+	 * \brief Drops all counted values
+	 */
+	void clear() {
+		*this = histogram_t();
+	}
+
+	/*!
+	 * \brief Returns number of counted values
+	 */
+	uint64_t get_count() const {
+		return count;
+	}
+
+	/*!
+	 * \brief Returns sum of counted values
+	 */
+	int64_t get_sum() const {
+		return sum;
+	}
+
+	/*!
+	 * \brief Returns minimum counted value or zero if histogram is empty
+	 */
+	int64_t get_min() const {
+		return count == 0 ? 0 : min;
+	}
+
+	/*!
+	 * \brief Returns maximum counted value
+	 */
+	int64_t get_max() const {
+		return max;
+	}
+
+	/*!
+	 * \brief Returns estimation of value below which \a quantile of values lie
+	 * \param quantile Number from [0, 1]
+	 */
+	int64_t get_quantile(double quantile) const {
+		if (count == 0) {
+			return 0;
+		}
+
+		uint64_t rank = static_cast<uint64_t>(std::ceil(quantile * count));
+		if (rank >= count) {
+			return max;
+		}
+		rank = std::max<uint64_t>(rank, 1);
+
+		uint64_t seen = 0;
+		for (size_t i = 0; i < buckets.size(); ++i) {
+			seen += buckets[i];
+			if (seen >= rank) {
+				int64_t lower = get_bucket_lower_bound(i);
+				int64_t upper = lower + get_bucket_width(i) - 1;
+				return std::min(std::max(lower + (upper - lower) / 2, min), max);
+			}
+		}
+		return max;
+	}
+
+	/*!
+	 * \brief Adds calls count, total, min, max and quantiles of values to json object \a value
+	 */
+	rapidjson::Value& to_json(rapidjson::Value &value, rapidjson::Document::AllocatorType &allocator) const {
+		static const double quantiles[QUANTILES_COUNT] = {0.5, 0.75, 0.9, 0.95, 0.99};
+		static const char *names[QUANTILES_COUNT] = {"50%", "75%", "90%", "95%", "99%"};
+
+		value.AddMember("calls", count, allocator);
+		value.AddMember("total", sum, allocator);
+		value.AddMember("min", get_min(), allocator);
+		value.AddMember("max", max, allocator);
+		for (size_t i = 0; i < QUANTILES_COUNT; ++i) {
+			value.AddMember(names[i], get_quantile(quantiles[i]), allocator);
+		}
+		return value;
+	}
+
+private:
+	static const int SUB_BUCKET_BITS = 5;
+	static const int64_t SUB_BUCKETS_COUNT = 1 << SUB_BUCKET_BITS;
+
+	static size_t get_bucket_index(int64_t value) {
+		if (value < SUB_BUCKETS_COUNT) {
+			return value;
+		}
+
+		int shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+		return (shift + 1) * SUB_BUCKETS_COUNT + ((value >> shift) - SUB_BUCKETS_COUNT);
+	}
+
+	static int64_t get_bucket_lower_bound(size_t index) {
+		if (index < static_cast<size_t>(SUB_BUCKETS_COUNT)) {
+			return index;
+		}
+
+		int shift = index / SUB_BUCKETS_COUNT - 1;
+		int64_t sub_bucket = index % SUB_BUCKETS_COUNT + SUB_BUCKETS_COUNT;
+		return sub_bucket << shift;
+	}
+
+	static int64_t get_bucket_width(size_t index) {
+		if (index < static_cast<size_t>(SUB_BUCKETS_COUNT)) {
+			return 1;
+		}
+		return int64_t(1) << (index / SUB_BUCKETS_COUNT - 1);
+	}
+
+	/*!
+	 * \brief Number of values in every bucket
+	 */
+	std::vector<uint64_t> buckets;
+
+	uint64_t count;
+	int64_t sum;
+	int64_t min;
+	int64_t max;
+};
+
+} // namespace react
+
+#endif // REACT_HISTOGRAM_HPP
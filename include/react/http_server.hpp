@@ -0,0 +1,166 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_HTTP_SERVER_HPP
+#define REACT_HTTP_SERVER_HPP
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "path_aggregator.hpp"
+#include "recent_trees_aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Minimal single-threaded HTTP/1.1 server exposing react data as json
+ *
+ *  Server thread multiplexes connections with epoll and answers GET requests
+ *  by calling route handlers, so all serialization happens on server thread.
+ *  Every response closes the connection.
+ */
+class http_server_t {
+public:
+	/*!
+	 * \brief Returns json body of response, called on server thread
+	 */
+	typedef std::function<std::string ()> handler_t;
+
+	/*!
+	 * \brief Parameters of http server
+	 */
+	struct options_t {
+		/*!
+		 * \brief Initializes options for loopback server on ephemeral port
+		 */
+		options_t(): address("127.0.0.1"), port(0), backlog(16), max_request_size(8192) {}
+
+		/*!
+		 * \brief IPv4 address to listen on
+		 */
+		std::string address;
+
+		/*!
+		 * \brief Port to listen on, 0 for port chosen by kernel
+		 */
+		int port;
+
+		/*!
+		 * \brief Maximum number of pending connections
+		 */
+		int backlog;
+
+		/*!
+		 * \brief Requests with larger headers are rejected
+		 */
+		size_t max_request_size;
+	};
+
+	/*!
+	 * \brief Starts listening and spawns server thread
+	 * \throw std::runtime_error if socket can't be set up
+	 */
+	http_server_t(const options_t &options = options_t());
+
+	/*!
+	 * \brief Stops server thread and closes all connections
+	 */
+	~http_server_t();
+
+	/*!
+	 * \brief Returns port server listens on
+	 */
+	int get_port() const;
+
+	/*!
+	 * \brief Serves result of \a handler on \a path
+	 */
+	void add_route(const std::string &path, handler_t handler);
+
+	/*!
+	 * \brief Serves snapshot of global profiler call tree, or its merged paths in merging mode, on \a path
+	 */
+	void serve_global_profiler(const std::string &path = "/profile");
+
+	/*!
+	 * \brief Serves trees kept by \a aggregator on \a path
+	 *
+	 *  Format is the one web/web.py expects in remote mode: {"call_tree":{"react_aggregator":[...]}}
+	 */
+	void serve_recent_trees(std::shared_ptr<recent_trees_aggregator_t> aggregator,
+							const std::string &path = "/call_tree");
+
+	/*!
+	 * \brief Serves per-path statistics of \a aggregator on \a path
+	 */
+	void serve_path_statistics(std::shared_ptr<path_aggregator_t> aggregator,
+							   const std::string &path = "/paths");
+
+private:
+	http_server_t(const http_server_t &);
+	http_server_t &operator =(const http_server_t &);
+
+	struct connection_t;
+
+	void serve_loop();
+	void accept_connections();
+	/*!
+	 * \brief Reads request, returns false if connection must be closed
+	 */
+	bool handle_input(connection_t &connection);
+	bool handle_output(connection_t &connection);
+	std::string build_response(const std::string &request);
+	void close_connection(int fd);
+
+	/*!
+	 * \brief Parameters of http server
+	 */
+	const options_t options;
+
+	int listen_fd;
+	int epoll_fd;
+
+	/*!
+	 * \brief Wakes server thread up on shutdown
+	 */
+	int event_fd;
+
+	int port;
+
+	/*!
+	 * \brief Open connections by descriptor, used only by server thread
+	 */
+	std::map<int, std::unique_ptr<connection_t>> connections;
+
+	/*!
+	 * \brief Handlers by path
+	 */
+	std::map<std::string, handler_t> routes;
+
+	/*!
+	 * \brief Routes access synchronization
+	 */
+	std::mutex routes_mutex;
+
+	std::thread server_thread;
+};
+
+} // namespace react
+
+#endif // REACT_HTTP_SERVER_HPP
@@ -0,0 +1,429 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_LOCK_FREE_CALL_TREE_HPP
+#define REACT_LOCK_FREE_CALL_TREE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "call_tree.hpp"
+
+namespace react {
+
+/*!
+ * \brief Call tree shared by threads that add and find links without locks
+ *
+ *  Nodes live in chunked arena and are never moved, so pointers to them stay valid
+ *  while other threads add nodes. Children of a node form singly linked list,
+ *  new child is published by compare-and-swap of list head. Times are updated with atomics.
+ *  Nodes are never removed, tree is converted to call_tree_t for output.
+ *  When arena is exhausted new links are dropped and counted: they all share single overflow node,
+ *  which is never linked into the tree, so recording degrades instead of failing.
+ */
+class lock_free_call_tree_t {
+public:
+	/*!
+	 * \brief Node of lock-free call tree
+	 */
+	struct node_t {
+		node_t(): action_code(+actions_set_t::NO_ACTION), start_time(0), duration(0),
+			first_child(NULL), next_sibling(NULL) {}
+
+		/*!
+		 * \brief Action which this node represents, immutable after publication
+		 */
+		int action_code;
+
+		/*!
+		 * \brief Time when action was started for the first time
+		 */
+		std::atomic<int64_t> start_time;
+
+		/*!
+		 * \brief Total duration of all calls merged into node
+		 */
+		std::atomic<int64_t> duration;
+
+		/*!
+		 * \brief The most recently added child
+		 */
+		std::atomic<node_t *> first_child;
+
+		/*!
+		 * \brief Previously added child of the same parent, immutable after publication
+		 */
+		node_t *next_sibling;
+	};
+
+	typedef node_t *p_node_t;
+
+	/*!
+	 * \brief Number of nodes allocated at once
+	 */
+	static const size_t CHUNK_SIZE = 4096;
+
+	/*!
+	 * \brief Maximum number of chunks
+	 */
+	static const size_t MAX_CHUNKS_COUNT = 16384;
+
+	/*!
+	 * \brief Initializes tree with single root node
+	 * \param actions_set Set of available actions for monitoring in call tree
+	 * \param max_nodes_count Maximum number of nodes including root, limited by arena size
+	 */
+	lock_free_call_tree_t(const actions_set_t &actions_set, size_t max_nodes_count = CHUNK_SIZE * MAX_CHUNKS_COUNT):
+		actions_set(actions_set),
+		max_nodes_count(std::max<size_t>(std::min(max_nodes_count, CHUNK_SIZE * MAX_CHUNKS_COUNT), 1)),
+		nodes_count(0), dropped_count(0) {
+		for (size_t i = 0; i < MAX_CHUNKS_COUNT; ++i) {
+			chunks[i].store(NULL, std::memory_order_relaxed);
+		}
+		root = allocate_node();
+	}
+
+	/*!
+	 * \brief Frees all chunks
+	 */
+	~lock_free_call_tree_t() {
+		for (size_t i = 0; i < MAX_CHUNKS_COUNT; ++i) {
+			delete[] chunks[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	/*!
+	 * \brief Returns actions set monitored by this tree
+	 */
+	const actions_set_t &get_actions_set() const {
+		return actions_set;
+	}
+
+	/*!
+	 * \brief Returns root of the tree
+	 */
+	p_node_t get_root() const {
+		return root;
+	}
+
+	/*!
+	 * \brief Returns node shared by all links dropped because arena is exhausted
+	 */
+	p_node_t get_overflow_node() {
+		return &overflow_node;
+	}
+
+	/*!
+	 * \brief Adds new child with \a action_code to \a node
+	 *
+	 *  Returns overflow node if arena is exhausted.
+	 * \throw std::invalid_argument if action code is invalid
+	 */
+	p_node_t add_new_link(p_node_t node, int action_code) {
+		check_action_code(action_code);
+		p_node_t child = allocate_node();
+		if (!child) {
+			return drop_link();
+		}
+		child->action_code = action_code;
+
+		node_t *head = node->first_child.load(std::memory_order_acquire);
+		do {
+			child->next_sibling = head;
+		} while (!node->first_child.compare_exchange_weak(head, child,
+					std::memory_order_release, std::memory_order_acquire));
+		return child;
+	}
+
+	/*!
+	 * \brief Returns the most recent child of \a node with \a action_code or NULL
+	 */
+	p_node_t find_link(p_node_t node, int action_code) const {
+		return find_link(node->first_child.load(std::memory_order_acquire), NULL, action_code);
+	}
+
+	/*!
+	 * \brief Returns child of \a node with \a action_code, adds it if there is none
+	 *
+	 *  Concurrent callers get the same child. Node allocated by the loser of the race is left unlinked.
+	 *  Returns overflow node if child has to be added and arena is exhausted.
+	 */
+	p_node_t find_or_add_link(p_node_t node, int action_code) {
+		check_action_code(action_code);
+		node_t *head = node->first_child.load(std::memory_order_acquire);
+		p_node_t child = find_link(head, NULL, action_code);
+		if (child) {
+			return child;
+		}
+
+		child = allocate_node();
+		if (!child) {
+			return drop_link();
+		}
+		child->action_code = action_code;
+		for (;;) {
+			child->next_sibling = head;
+			node_t *previous_head = head;
+			if (node->first_child.compare_exchange_weak(head, child,
+						std::memory_order_release, std::memory_order_acquire)) {
+				return child;
+			}
+
+			p_node_t concurrent_child = find_link(head, previous_head, action_code);
+			if (concurrent_child) {
+				return concurrent_child;
+			}
+		}
+	}
+
+	/*!
+	 * \brief Records call of \a node which lasted from \a start_time to \a stop_time
+	 *
+	 *  Start time of the first recorded call is kept, durations of all calls are summed.
+	 */
+	void add_call(p_node_t node, int64_t start_time, int64_t stop_time) {
+		int64_t expected = 0;
+		node->start_time.compare_exchange_strong(expected, start_time, std::memory_order_relaxed);
+		node->duration.fetch_add(stop_time - start_time, std::memory_order_relaxed);
+	}
+
+	/*!
+	 * \brief Returns number of allocated nodes including root
+	 */
+	size_t size() const {
+		return std::min(nodes_count.load(std::memory_order_relaxed), max_nodes_count);
+	}
+
+	/*!
+	 * \brief Returns number of links dropped because arena was exhausted
+	 */
+	size_t get_dropped_count() const {
+		return dropped_count.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	 * \brief Copies tree into \a call_tree, children are added in order they were added to this tree
+	 *
+	 *  Can be called concurrently with updates, calls that are in progress are not included.
+	 *  Stop time of node is its start time plus total duration of its calls.
+	 */
+	void copy_to(call_tree_t &call_tree) const {
+		copy_to(root, call_tree, call_tree.root);
+	}
+
+private:
+	lock_free_call_tree_t(const lock_free_call_tree_t &);
+	lock_free_call_tree_t &operator =(const lock_free_call_tree_t &);
+
+	void check_action_code(int action_code) const {
+		if (!actions_set.code_is_valid(action_code) || action_code == actions_set_t::NO_ACTION) {
+			throw std::invalid_argument("Can't add new link: action code is invalid");
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Searches siblings list from \a head up to \a end
+	 */
+	static p_node_t find_link(node_t *head, node_t *end, int action_code) {
+		for (node_t *child = head; child != end; child = child->next_sibling) {
+			if (child->action_code == action_code) {
+				return child;
+			}
+		}
+		return NULL;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Takes next node from arena, allocating new chunk if needed
+	 * \return New node or NULL if arena is exhausted
+	 */
+	p_node_t allocate_node() {
+		size_t index = nodes_count.fetch_add(1, std::memory_order_relaxed);
+		if (index >= max_nodes_count) {
+			return NULL;
+		}
+
+		size_t chunk_index = index / CHUNK_SIZE;
+
+		node_t *chunk = chunks[chunk_index].load(std::memory_order_acquire);
+		if (!chunk) {
+			node_t *new_chunk = new node_t[CHUNK_SIZE];
+			if (chunks[chunk_index].compare_exchange_strong(chunk, new_chunk,
+						std::memory_order_acq_rel, std::memory_order_acquire)) {
+				chunk = new_chunk;
+			} else {
+				delete[] new_chunk;
+			}
+		}
+		return chunk + index % CHUNK_SIZE;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Counts dropped link and returns overflow node instead of it
+	 */
+	p_node_t drop_link() {
+		dropped_count.fetch_add(1, std::memory_order_relaxed);
+		return &overflow_node;
+	}
+
+	void copy_to(p_node_t node, call_tree_t &call_tree, call_tree_t::p_node_t tree_node) const {
+		std::vector<p_node_t> children;
+		for (node_t *child = node->first_child.load(std::memory_order_acquire); child; child = child->next_sibling) {
+			children.push_back(child);
+		}
+
+		for (auto it = children.rbegin(); it != children.rend(); ++it) {
+			call_tree_t::p_node_t tree_child = call_tree.add_new_link(tree_node, (*it)->action_code);
+			int64_t start_time = (*it)->start_time.load(std::memory_order_relaxed);
+			call_tree.set_node_start_time(tree_child, start_time);
+			call_tree.set_node_stop_time(tree_child, start_time + (*it)->duration.load(std::memory_order_relaxed));
+			copy_to(*it, call_tree, tree_child);
+		}
+	}
+
+	/*!
+	 * \brief Available actions for monitoring
+	 */
+	const actions_set_t &actions_set;
+
+	/*!
+	 * \brief Maximum number of nodes taken from arena
+	 */
+	const size_t max_nodes_count;
+
+	/*!
+	 * \brief Node arena chunks, allocated on demand
+	 */
+	std::atomic<node_t *> chunks[MAX_CHUNKS_COUNT];
+
+	/*!
+	 * \brief Number of nodes taken from arena
+	 */
+	std::atomic<size_t> nodes_count;
+
+	/*!
+	 * \brief Number of links dropped because arena was exhausted
+	 */
+	std::atomic<size_t> dropped_count;
+
+	/*!
+	 * \brief Root of the tree
+	 */
+	p_node_t root;
+
+	/*!
+	 * \brief Node returned instead of dropped links, collects their calls and is never copied
+	 */
+	node_t overflow_node;
+};
+
+/*!
+ * \brief Per-thread updater of lock-free call tree
+ *
+ *  Same as call_tree_updater_t but never takes locks, must be used by single thread.
+ */
+class lock_free_updater_t {
+public:
+	/*!
+	 * \brief Time point type
+	 */
+	typedef std::chrono::time_point<std::chrono::system_clock> time_point_t;
+
+	/*!
+	 * \brief Initializes updater of \a call_tree
+	 */
+	lock_free_updater_t(lock_free_call_tree_t &call_tree): call_tree(call_tree) {}
+
+	/*!
+	 * \brief Starts new branch in tree with action \a action_code
+	 * \param try_merging If true calls of the same path are merged into single node
+	 */
+	void start(int action_code, bool try_merging = false) {
+		lock_free_call_tree_t::p_node_t parent = stack.empty() ? call_tree.get_root() : stack.back().node;
+		lock_free_call_tree_t::p_node_t node = try_merging ? call_tree.find_or_add_link(parent, action_code)
+														   : call_tree.add_new_link(parent, action_code);
+		stack.push_back(frame_t(node, action_code, std::chrono::system_clock::now()));
+	}
+
+	/*!
+	 * \brief Stops last action and records its time
+	 * \throw std::logic_error if \a action_code is not the last started action
+	 */
+	void stop(int action_code) {
+		time_point_t stop_time = std::chrono::system_clock::now();
+		if (stack.empty()) {
+			throw std::logic_error("Can't stop action: no action was started");
+		}
+
+		const frame_t &frame = stack.back();
+		if (frame.action_code != action_code) {
+			throw std::logic_error("Stopping wrong action. Expected: "
+								   + call_tree.get_actions_set().get_action_name(frame.action_code)
+								   + ", Found: " + call_tree.get_actions_set().get_action_name(action_code));
+		}
+
+		call_tree.add_call(frame.node, to_microseconds(frame.start_time), to_microseconds(stop_time));
+		stack.pop_back();
+	}
+
+	/*!
+	 * \brief Returns number of started and not stopped actions
+	 */
+	size_t get_depth() const {
+		return stack.size();
+	}
+
+private:
+	/*!
+	 * \brief Started action, its node may be overflow node so action code is kept separately
+	 */
+	struct frame_t {
+		frame_t(lock_free_call_tree_t::p_node_t node, int action_code, const time_point_t &start_time):
+			node(node), action_code(action_code), start_time(start_time) {}
+
+		lock_free_call_tree_t::p_node_t node;
+		int action_code;
+		time_point_t start_time;
+	};
+
+	static int64_t to_microseconds(const time_point_t &time) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+	}
+
+	/*!
+	 * \brief Target tree
+	 */
+	lock_free_call_tree_t &call_tree;
+
+	/*!
+	 * \brief Started actions with their start times
+	 */
+	std::vector<frame_t> stack;
+};
+
+} // namespace react
+
+#endif // REACT_LOCK_FREE_CALL_TREE_HPP
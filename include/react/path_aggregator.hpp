@@ -0,0 +1,343 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_PATH_AGGREGATOR_HPP
+#define REACT_PATH_AGGREGATOR_HPP
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "aggregator.hpp"
+#include "histogram.hpp"
+
+namespace react {
+
+/*!
+ * \brief Node of path tree, represents all calls of action reached by the same path from root
+ */
+struct path_node_t {
+	/*!
+	 * \brief Initializes node with \a action_code and empty histogram
+	 */
+	path_node_t(int action_code): action_code(action_code) {}
+
+	/*!
+	 * \brief Code of the last action of the path
+	 */
+	int action_code;
+
+	/*!
+	 * \brief Durations of all calls of the path
+	 */
+	histogram_t histogram;
+
+	/*!
+	 * \brief Child nodes by action code
+	 */
+	std::map<int, size_t> links;
+};
+
+/*!
+ * \brief Trie of call paths, where path is sequence of action codes from the root
+ *
+ *  Unlike call_tree_t it has single node per path, so its size does not depend on number of calls.
+ */
+class path_tree_t {
+public:
+	typedef size_t p_node_t;
+
+	/*!
+	 * \brief Value for representing null node pointer
+	 */
+	static const p_node_t NO_NODE = -1;
+
+	/*!
+	 * \brief Pointer to the root of path tree
+	 */
+	static const p_node_t root = 0;
+
+	/*!
+	 * \brief Initializes path tree with single root node
+	 * \param actions_set Set of actions used to resolve names on json export
+	 */
+	path_tree_t(const actions_set_t &actions_set): actions_set(actions_set) {
+		nodes.push_back(path_node_t(+actions_set_t::NO_ACTION));
+	}
+
+	/*!
+	 * \brief Returns child of \a node with \a action_code, creating it if needed
+	 */
+	p_node_t add_link(p_node_t node, int action_code) {
+		auto it = nodes[node].links.find(action_code);
+		if (it != nodes[node].links.end()) {
+			return it->second;
+		}
+
+		p_node_t child = nodes.size();
+		nodes.push_back(path_node_t(action_code));
+		nodes[node].links.insert(std::make_pair(action_code, child));
+		return child;
+	}
+
+	/*!
+	 * \brief Returns child of \a node with \a action_code or NO_NODE
+	 */
+	p_node_t find_link(p_node_t node, int action_code) const {
+		auto it = nodes[node].links.find(action_code);
+		return it != nodes[node].links.end() ? it->second : NO_NODE;
+	}
+
+	/*!
+	 * \brief Returns node reached from the root by \a path or NO_NODE
+	 */
+	p_node_t find_path(const std::vector<int> &path) const {
+		p_node_t node = root;
+		for (auto it = path.begin(); it != path.end() && node != NO_NODE; ++it) {
+			node = find_link(node, *it);
+		}
+		return node;
+	}
+
+	/*!
+	 * \brief Returns action code of the last action of path represented by \a node
+	 */
+	int get_node_action_code(p_node_t node) const {
+		return nodes[node].action_code;
+	}
+
+	/*!
+	 * \brief Returns durations histogram of \a node
+	 */
+	const histogram_t &get_histogram(p_node_t node) const {
+		return nodes[node].histogram;
+	}
+
+	/*!
+	 * \brief Returns durations histogram of \a node
+	 */
+	histogram_t &get_histogram(p_node_t node) {
+		return nodes[node].histogram;
+	}
+
+	/*!
+	 * \brief Returns child nodes of \a node by action code
+	 */
+	const std::map<int, size_t> &get_node_links(p_node_t node) const {
+		return nodes[node].links;
+	}
+
+	/*!
+	 * \brief Returns number of distinct paths
+	 */
+	size_t size() const {
+		return nodes.size() - 1;
+	}
+
+	/*!
+	 * \brief Adds durations of all actions of \a call_tree to their paths
+	 */
+	void add_call_tree(const call_tree_t &call_tree) {
+		add_call_tree(call_tree, call_tree.root, root);
+	}
+
+	/*!
+	 * \brief Adds histograms of all paths of \a other tree
+	 */
+	void merge(const path_tree_t &other) {
+		merge(other, other.root, root);
+	}
+
+	/*!
+	 * \brief Drops all paths
+	 */
+	void clear() {
+		nodes.resize(1, path_node_t(+actions_set_t::NO_ACTION));
+		nodes[root].links.clear();
+	}
+
+	/*!
+	 * \brief Converts path tree to json in call tree layout with statistics instead of times
+	 */
+	rapidjson::Value& to_json(rapidjson::Value &value, rapidjson::Document::AllocatorType &allocator) const {
+		return to_json(root, value, allocator);
+	}
+
+private:
+	void add_call_tree(const call_tree_t &call_tree, call_tree_t::p_node_t tree_node, p_node_t node) {
+		const auto &links = call_tree.get_node_links(tree_node);
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			p_node_t child = add_link(node, it->first);
+			nodes[child].histogram.add(call_tree.get_node_stop_time(it->second) -
+									   call_tree.get_node_start_time(it->second));
+			add_call_tree(call_tree, it->second, child);
+		}
+	}
+
+	void merge(const path_tree_t &other, p_node_t other_node, p_node_t node) {
+		const auto &links = other.nodes[other_node].links;
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			p_node_t child = add_link(node, it->first);
+			nodes[child].histogram.merge(other.nodes[it->second].histogram);
+			merge(other, it->second, child);
+		}
+	}
+
+	rapidjson::Value& to_json(p_node_t node, rapidjson::Value &value,
+							  rapidjson::Document::AllocatorType &allocator) const {
+		if (node != root) {
+			std::string name = actions_set.get_action_name(nodes[node].action_code);
+			rapidjson::Value name_value(name.c_str(), name.size(), allocator);
+			value.AddMember("name", name_value, allocator);
+			nodes[node].histogram.to_json(value, allocator);
+		}
+
+		if (!nodes[node].links.empty()) {
+			rapidjson::Value subtree_actions(rapidjson::kArrayType);
+			for (auto it = nodes[node].links.begin(); it != nodes[node].links.end(); ++it) {
+				rapidjson::Value subtree_value(rapidjson::kObjectType);
+				to_json(it->second, subtree_value, allocator);
+				subtree_actions.PushBack(subtree_value, allocator);
+			}
+			value.AddMember("actions", subtree_actions, allocator);
+		}
+
+		return value;
+	}
+
+	/*!
+	 * \brief Set of actions used to resolve names on json export
+	 */
+	const actions_set_t &actions_set;
+
+	/*!
+	 * \brief Tree nodes, root is the first one
+	 */
+	std::vector<path_node_t> nodes;
+};
+
+/*!
+ * \brief Aggregator that merges call trees by call path into trie of latency histograms
+ *
+ *  Answers quantiles per path over all aggregated requests with memory proportional to number of paths.
+ *  Concurrent callers update different shards chosen by thread, shards are merged on query.
+ */
+class path_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Default number of independently locked shards
+	 */
+	static const size_t DEFAULT_SHARDS_COUNT = 16;
+
+	/*!
+	 * \brief Constructs empty aggregator
+	 * \param actions_set Actions set of aggregated trees
+	 * \param shards_count Number of independently locked shards
+	 */
+	path_aggregator_t(const actions_set_t &actions_set, size_t shards_count = DEFAULT_SHARDS_COUNT):
+		actions_set(actions_set) {
+		for (size_t i = 0; i < std::max<size_t>(shards_count, 1); ++i) {
+			shards.push_back(std::unique_ptr<shard_t>(new shard_t(actions_set)));
+		}
+	}
+
+	/*!
+	 * \brief Frees memory consumed by path_aggregator
+	 */
+	~path_aggregator_t() {}
+
+	/*!
+	 * \brief Adds durations of all actions of \a call_tree to shard of calling thread
+	 * \param call_tree Tree that will be aggregated
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		shard_t &shard = *shards[std::hash<std::thread::id>()(std::this_thread::get_id()) % shards.size()];
+		std::lock_guard<std::mutex> guard(shard.mutex);
+		shard.path_tree.add_call_tree(call_tree);
+	}
+
+	/*!
+	 * \brief Returns all shards merged into single path tree
+	 */
+	path_tree_t get_path_tree() const {
+		path_tree_t path_tree(actions_set);
+		for (auto it = shards.begin(); it != shards.end(); ++it) {
+			std::lock_guard<std::mutex> guard((*it)->mutex);
+			path_tree.merge((*it)->path_tree);
+		}
+		return path_tree;
+	}
+
+	/*!
+	 * \brief Returns histogram of durations of action reached by \a path
+	 * \param path Action codes from the root
+	 */
+	histogram_t get_histogram(const std::vector<int> &path) const {
+		histogram_t histogram;
+		for (auto it = shards.begin(); it != shards.end(); ++it) {
+			std::lock_guard<std::mutex> guard((*it)->mutex);
+			path_tree_t::p_node_t node = (*it)->path_tree.find_path(path);
+			if (node != path_tree_t::NO_NODE) {
+				histogram.merge((*it)->path_tree.get_histogram(node));
+			}
+		}
+		return histogram;
+	}
+
+	/*!
+	 * \brief Drops all aggregated paths
+	 */
+	void clear() {
+		for (auto it = shards.begin(); it != shards.end(); ++it) {
+			std::lock_guard<std::mutex> guard((*it)->mutex);
+			(*it)->path_tree.clear();
+		}
+	}
+
+	/*!
+	 * \brief Converts merged path tree to json
+	 */
+	rapidjson::Value& to_json(rapidjson::Value &value, rapidjson::Document::AllocatorType &allocator) const {
+		return get_path_tree().to_json(value, allocator);
+	}
+
+private:
+	/*!
+	 * \brief Independently locked part of aggregated paths
+	 */
+	struct shard_t {
+		shard_t(const actions_set_t &actions_set): path_tree(actions_set) {}
+
+		std::mutex mutex;
+		path_tree_t path_tree;
+	};
+
+	/*!
+	 * \brief Actions set of aggregated trees
+	 */
+	const actions_set_t &actions_set;
+
+	/*!
+	 * \brief Independently locked shards
+	 */
+	std::vector<std::unique_ptr<shard_t>> shards;
+};
+
+} // namespace react
+
+#endif // REACT_PATH_AGGREGATOR_HPP
@@ -0,0 +1,443 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_PATH_RECORDER_HPP
+#define REACT_PATH_RECORDER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <sched.h>
+#include <unistd.h>
+
+#include "path_aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Collects action durations directly into path trees, merging all calls of the same path
+ *
+ *  Every thread records into its own path tree through path_cursor_t, so memory is bounded
+ *  by number of distinct paths per thread instead of number of calls.
+ *  Trees of finished threads are merged into single retired tree.
+ */
+class path_recorder_t {
+public:
+	/*!
+	 * \brief Path tree of single thread with its lock
+	 */
+	struct thread_paths_t {
+		thread_paths_t(const actions_set_t &actions_set): path_tree(actions_set) {}
+
+		/*!
+		 * \brief Path tree access synchronization, contended only by readers
+		 */
+		std::mutex mutex;
+
+		/*!
+		 * \brief Paths recorded by thread
+		 */
+		path_tree_t path_tree;
+	};
+
+	/*!
+	 * \brief Constructs empty recorder
+	 * \param actions_set Actions of recorded paths
+	 */
+	path_recorder_t(const actions_set_t &actions_set): actions_set(actions_set), retired_paths(actions_set) {}
+
+	/*!
+	 * \brief Returns actions of recorded paths
+	 */
+	const actions_set_t &get_actions_set() const {
+		return actions_set;
+	}
+
+	/*!
+	 * \brief Creates path tree for new thread
+	 */
+	std::shared_ptr<thread_paths_t> register_thread() {
+		std::shared_ptr<thread_paths_t> paths = std::make_shared<thread_paths_t>(actions_set);
+		std::lock_guard<std::mutex> guard(mutex);
+		threads_paths.push_back(paths);
+		return paths;
+	}
+
+	/*!
+	 * \brief Merges path tree of finished thread into retired tree
+	 */
+	void unregister_thread(const std::shared_ptr<thread_paths_t> &paths) {
+		std::lock_guard<std::mutex> guard(mutex);
+		auto it = std::find(threads_paths.begin(), threads_paths.end(), paths);
+		if (it == threads_paths.end()) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> paths_guard(paths->mutex);
+			retired_paths.merge(paths->path_tree);
+		}
+		threads_paths.erase(it);
+	}
+
+	/*!
+	 * \brief Returns paths of all threads merged into single tree
+	 */
+	path_tree_t get_path_tree() const {
+		path_tree_t path_tree(actions_set);
+		std::lock_guard<std::mutex> guard(mutex);
+		path_tree.merge(retired_paths);
+		for (auto it = threads_paths.begin(); it != threads_paths.end(); ++it) {
+			std::lock_guard<std::mutex> paths_guard((*it)->mutex);
+			path_tree.merge((*it)->path_tree);
+		}
+		return path_tree;
+	}
+
+	/*!
+	 * \brief Drops all recorded paths, started actions are recorded on stop
+	 */
+	void clear() {
+		std::lock_guard<std::mutex> guard(mutex);
+		retired_paths.clear();
+		for (auto it = threads_paths.begin(); it != threads_paths.end(); ++it) {
+			std::lock_guard<std::mutex> paths_guard((*it)->mutex);
+			clear_histograms((*it)->path_tree, path_tree_t::root);
+		}
+	}
+
+	/*!
+	 * \brief Converts merged path tree to json
+	 */
+	rapidjson::Value& to_json(rapidjson::Value &value, rapidjson::Document::AllocatorType &allocator) const {
+		return get_path_tree().to_json(value, allocator);
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Clears histograms keeping nodes, since cursors of running threads point into the tree
+	 */
+	static void clear_histograms(path_tree_t &path_tree, path_tree_t::p_node_t node) {
+		path_tree.get_histogram(node).clear();
+		const auto &links = path_tree.get_node_links(node);
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			clear_histograms(path_tree, it->second);
+		}
+	}
+
+	/*!
+	 * \brief Actions of recorded paths
+	 */
+	const actions_set_t &actions_set;
+
+	/*!
+	 * \brief Trees of running threads
+	 */
+	std::vector<std::shared_ptr<thread_paths_t>> threads_paths;
+
+	/*!
+	 * \brief Paths of finished threads
+	 */
+	path_tree_t retired_paths;
+
+	/*!
+	 * \brief Threads list and retired tree access synchronization
+	 */
+	mutable std::mutex mutex;
+};
+
+/*!
+ * \brief Per-thread position in thread path tree
+ *
+ *  Meant to be thread-local, start() and stop() must be called by the owning thread only.
+ */
+class path_cursor_t {
+public:
+	/*!
+	 * \brief Time point type
+	 */
+	typedef std::chrono::time_point<std::chrono::system_clock> time_point_t;
+
+	/*!
+	 * \brief Registers new thread path tree in \a recorder
+	 */
+	path_cursor_t(path_recorder_t &recorder): recorder(recorder), paths(recorder.register_thread()) {
+		stack.push_back(std::make_pair(+path_tree_t::root, time_point_t()));
+	}
+
+	/*!
+	 * \brief Retires thread path tree
+	 */
+	~path_cursor_t() {
+		recorder.unregister_thread(paths);
+	}
+
+	/*!
+	 * \brief Moves cursor to child path with \a action_code
+	 * \throw std::invalid_argument if action code is invalid
+	 */
+	void start(int action_code) {
+		if (!recorder.get_actions_set().code_is_valid(action_code) || action_code == actions_set_t::NO_ACTION) {
+			throw std::invalid_argument("Can't start action: action code is invalid: "
+										+ std::to_string(static_cast<long long>(action_code)));
+		}
+
+		path_tree_t::p_node_t node;
+		{
+			std::lock_guard<std::mutex> guard(paths->mutex);
+			node = paths->path_tree.add_link(stack.back().first, action_code);
+		}
+		stack.push_back(std::make_pair(node, std::chrono::system_clock::now()));
+	}
+
+	/*!
+	 * \brief Records duration of the last started action and moves cursor to parent path
+	 * \throw std::logic_error if \a action_code is not the last started action
+	 */
+	void stop(int action_code) {
+		time_point_t stop_time = std::chrono::system_clock::now();
+		if (stack.size() == 1) {
+			throw std::logic_error("Can't stop action: no action was started");
+		}
+
+		std::lock_guard<std::mutex> guard(paths->mutex);
+		path_tree_t::p_node_t node = stack.back().first;
+		if (paths->path_tree.get_node_action_code(node) != action_code) {
+			throw std::logic_error("Stopping wrong action. Expected: "
+								   + recorder.get_actions_set().get_action_name(paths->path_tree.get_node_action_code(node))
+								   + ", Found: " + recorder.get_actions_set().get_action_name(action_code));
+		}
+
+		paths->path_tree.get_histogram(node).add(
+					std::chrono::duration_cast<std::chrono::microseconds>(stop_time - stack.back().second).count());
+		stack.pop_back();
+	}
+
+	/*!
+	 * \brief Returns number of started and not stopped actions
+	 */
+	size_t get_depth() const {
+		return stack.size() - 1;
+	}
+
+private:
+	/*!
+	 * \brief Recorder owning thread path tree
+	 */
+	path_recorder_t &recorder;
+
+	/*!
+	 * \brief Path tree of the thread
+	 */
+	std::shared_ptr<path_recorder_t::thread_paths_t> paths;
+
+	/*!
+	 * \brief Nodes of started actions with their start times, root is the first one
+	 */
+	std::vector<std::pair<path_tree_t::p_node_t, time_point_t>> stack;
+};
+
+/*!
+ * \brief Collects action durations into path trees sharded by CPU
+ *
+ *  Calls are recorded into shard of CPU the calling thread runs on, so memory is bounded
+ *  by number of CPUs and paths regardless of number of threads, as long as threads share action codes.
+ *  Shard locks are rarely contended.
+ *  Shards are merged on query.
+ */
+class per_cpu_recorder_t {
+public:
+	/*!
+	 * \brief Constructs empty recorder
+	 * \param actions_set Actions of recorded paths
+	 * \param shards_count Number of shards, number of configured CPUs if zero
+	 */
+	per_cpu_recorder_t(const actions_set_t &actions_set, size_t shards_count = 0): actions_set(actions_set) {
+		if (shards_count == 0) {
+			long cpus_count = sysconf(_SC_NPROCESSORS_CONF);
+			shards_count = cpus_count > 0 ? cpus_count : 1;
+		}
+		for (size_t i = 0; i < shards_count; ++i) {
+			shards.push_back(std::unique_ptr<shard_t>(new shard_t(actions_set)));
+		}
+	}
+
+	/*!
+	 * \brief Returns actions of recorded paths
+	 */
+	const actions_set_t &get_actions_set() const {
+		return actions_set;
+	}
+
+	/*!
+	 * \brief Returns number of shards
+	 */
+	size_t get_shards_count() const {
+		return shards.size();
+	}
+
+	/*!
+	 * \brief Adds \a duration of action reached by \a path to shard of current CPU
+	 * \param path Action codes from the root
+	 * \param duration Duration in microseconds
+	 */
+	void add(const std::vector<int> &path, int64_t duration) {
+		int cpu = sched_getcpu();
+		shard_t &shard = *shards[cpu > 0 ? cpu % shards.size() : 0];
+		std::lock_guard<std::mutex> guard(shard.mutex);
+		path_tree_t::p_node_t node = path_tree_t::root;
+		for (auto it = path.begin(); it != path.end(); ++it) {
+			node = shard.path_tree.add_link(node, *it);
+		}
+		shard.path_tree.get_histogram(node).add(duration);
+	}
+
+	/*!
+	 * \brief Returns all shards merged into single path tree
+	 */
+	path_tree_t get_path_tree() const {
+		path_tree_t path_tree(actions_set);
+		for (auto it = shards.begin(); it != shards.end(); ++it) {
+			std::lock_guard<std::mutex> guard((*it)->mutex);
+			path_tree.merge((*it)->path_tree);
+		}
+		return path_tree;
+	}
+
+	/*!
+	 * \brief Drops all recorded paths
+	 */
+	void clear() {
+		for (auto it = shards.begin(); it != shards.end(); ++it) {
+			std::lock_guard<std::mutex> guard((*it)->mutex);
+			(*it)->path_tree.clear();
+		}
+	}
+
+	/*!
+	 * \brief Converts merged path tree to json
+	 */
+	rapidjson::Value& to_json(rapidjson::Value &value, rapidjson::Document::AllocatorType &allocator) const {
+		return get_path_tree().to_json(value, allocator);
+	}
+
+private:
+	/*!
+	 * \brief Paths recorded on single CPU, allocated separately from neighbour shards
+	 */
+	struct shard_t {
+		shard_t(const actions_set_t &actions_set): path_tree(actions_set) {}
+
+		std::mutex mutex;
+		path_tree_t path_tree;
+	};
+
+	/*!
+	 * \brief Actions of recorded paths
+	 */
+	const actions_set_t &actions_set;
+
+	/*!
+	 * \brief Per-CPU shards
+	 */
+	std::vector<std::unique_ptr<shard_t>> shards;
+};
+
+/*!
+ * \brief Per-thread stack of started actions recorded into per_cpu_recorder_t
+ *
+ *  Keeps only action codes and start times, so idle and finished threads cost no tree memory.
+ *  Meant to be thread-local, start() and stop() must be called by the owning thread only.
+ */
+class per_cpu_cursor_t {
+public:
+	/*!
+	 * \brief Time point type
+	 */
+	typedef std::chrono::time_point<std::chrono::system_clock> time_point_t;
+
+	/*!
+	 * \brief Initializes cursor recording into \a recorder
+	 */
+	per_cpu_cursor_t(per_cpu_recorder_t &recorder): recorder(recorder) {}
+
+	/*!
+	 * \brief Starts action with \a action_code
+	 * \throw std::invalid_argument if action code is invalid
+	 */
+	void start(int action_code) {
+		if (!recorder.get_actions_set().code_is_valid(action_code) || action_code == actions_set_t::NO_ACTION) {
+			throw std::invalid_argument("Can't start action: action code is invalid: "
+										+ std::to_string(static_cast<long long>(action_code)));
+		}
+
+		path.push_back(action_code);
+		start_times.push_back(std::chrono::system_clock::now());
+	}
+
+	/*!
+	 * \brief Records duration of the last started action into shard of current CPU
+	 * \throw std::logic_error if \a action_code is not the last started action
+	 */
+	void stop(int action_code) {
+		time_point_t stop_time = std::chrono::system_clock::now();
+		if (path.empty()) {
+			throw std::logic_error("Can't stop action: no action was started");
+		}
+		if (path.back() != action_code) {
+			throw std::logic_error("Stopping wrong action. Expected: "
+								   + recorder.get_actions_set().get_action_name(path.back())
+								   + ", Found: " + recorder.get_actions_set().get_action_name(action_code));
+		}
+
+		recorder.add(path, std::chrono::duration_cast<std::chrono::microseconds>(stop_time - start_times.back()).count());
+		path.pop_back();
+		start_times.pop_back();
+	}
+
+	/*!
+	 * \brief Returns number of started and not stopped actions
+	 */
+	size_t get_depth() const {
+		return path.size();
+	}
+
+private:
+	/*!
+	 * \brief Recorder of finished actions
+	 */
+	per_cpu_recorder_t &recorder;
+
+	/*!
+	 * \brief Action codes of started actions from the root
+	 */
+	std::vector<int> path;
+
+	/*!
+	 * \brief Start times of started actions
+	 */
+	std::vector<time_point_t> start_times;
+};
+
+} // namespace react
+
+#endif // REACT_PATH_RECORDER_HPP
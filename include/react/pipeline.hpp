@@ -0,0 +1,364 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_PIPELINE_HPP
+#define REACT_PIPELINE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Aggregator that passes every call tree to several aggregators
+ *
+ *  Handle of the tree is shared between all sinks, so the tree is not copied.
+ */
+class tee_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Constructs aggregator with \a aggregators as sinks
+	 */
+	tee_aggregator_t(const std::vector<std::shared_ptr<aggregator_t>> &aggregators = {}) {
+		for (auto it = aggregators.begin(); it != aggregators.end(); ++it) {
+			add_aggregator(*it);
+		}
+	}
+
+	/*!
+	 * \brief Frees memory consumed by tee_aggregator
+	 */
+	~tee_aggregator_t() {}
+
+	/*!
+	 * \brief Adds sink, must not be called concurrently with aggregation
+	 */
+	void add_aggregator(std::shared_ptr<aggregator_t> aggregator) {
+		if (!aggregator) {
+			throw std::invalid_argument("Can't add aggregator to tee: aggregator is NULL");
+		}
+		aggregators.push_back(aggregator);
+	}
+
+	/*!
+	 * \brief Passes \a call_tree to all sinks
+	 * \param call_tree Tree that will be aggregated
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		for (auto it = aggregators.begin(); it != aggregators.end(); ++it) {
+			(*it)->aggregate(call_tree);
+		}
+	}
+
+	/*!
+	 * \brief Passes handle of \a call_tree to all sinks
+	 * \param call_tree Handle of tree that will be aggregated
+	 */
+	void aggregate_handle(call_tree_handle_t call_tree) {
+		for (auto it = aggregators.begin(); it != aggregators.end(); ++it) {
+			(*it)->aggregate_handle(call_tree);
+		}
+	}
+
+private:
+	/*!
+	 * \brief Sinks of call trees
+	 */
+	std::vector<std::shared_ptr<aggregator_t>> aggregators;
+};
+
+/*!
+ * \brief Base class of pipeline stages that pass call trees to single next aggregator
+ */
+class stage_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Constructs stage that passes trees to \a aggregator
+	 */
+	stage_aggregator_t(std::shared_ptr<aggregator_t> aggregator): aggregator(aggregator) {
+		if (!aggregator) {
+			throw std::invalid_argument("Can't create pipeline stage: next aggregator is NULL");
+		}
+	}
+
+	/*!
+	 * \brief Frees memory consumed by stage
+	 */
+	virtual ~stage_aggregator_t() {}
+
+protected:
+	/*!
+	 * \brief Next aggregator of the pipeline
+	 */
+	std::shared_ptr<aggregator_t> aggregator;
+};
+
+/*!
+ * \brief Stage that passes only call trees satisfying predicate
+ */
+class filter_aggregator_t : public stage_aggregator_t {
+public:
+	/*!
+	 * \brief Type of call tree predicate
+	 */
+	typedef std::function<bool (const call_tree_t &)> predicate_t;
+
+	/*!
+	 * \brief Constructs stage
+	 * \param aggregator Next aggregator of the pipeline
+	 * \param predicate Trees for which predicate returns true are passed further
+	 */
+	filter_aggregator_t(std::shared_ptr<aggregator_t> aggregator, predicate_t predicate):
+		stage_aggregator_t(aggregator), predicate(predicate) {}
+
+	/*!
+	 * \brief Frees memory consumed by filter_aggregator
+	 */
+	~filter_aggregator_t() {}
+
+	/*!
+	 * \brief Passes \a call_tree further if it satisfies predicate
+	 * \param call_tree Tree that will be checked
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		if (predicate(call_tree)) {
+			aggregator->aggregate(call_tree);
+		}
+	}
+
+	/*!
+	 * \brief Passes handle of \a call_tree further if it satisfies predicate
+	 * \param call_tree Handle of tree that will be checked
+	 */
+	void aggregate_handle(call_tree_handle_t call_tree) {
+		if (predicate(*call_tree)) {
+			aggregator->aggregate_handle(std::move(call_tree));
+		}
+	}
+
+	/*!
+	 * \brief Returns predicate that checks presence of stat \a key
+	 */
+	static predicate_t has_stat(const std::string &key) {
+		return [key](const call_tree_t &call_tree) {
+			return call_tree.has_stat(key);
+		};
+	}
+
+	/*!
+	 * \brief Returns predicate that checks that stat \a key is equal to \a value
+	 */
+	static predicate_t stat_equals(const std::string &key, const stat_value_t &value) {
+		return [key, value](const call_tree_t &call_tree) {
+			const auto &stats = call_tree.get_stats();
+			auto it = stats.find(key);
+			return it != stats.end() && it->second == value;
+		};
+	}
+
+	/*!
+	 * \brief Returns predicate that checks that some root action of tree has \a action_code
+	 */
+	static predicate_t root_action_is(int action_code) {
+		return [action_code](const call_tree_t &call_tree) {
+			const auto &links = call_tree.get_node_links(call_tree.root);
+			for (auto it = links.begin(); it != links.end(); ++it) {
+				if (it->first == action_code) {
+					return true;
+				}
+			}
+			return false;
+		};
+	}
+
+private:
+	/*!
+	 * \brief Trees for which predicate returns true are passed further
+	 */
+	predicate_t predicate;
+};
+
+/*!
+ * \brief Stage that passes evenly spaced fraction of call trees
+ *
+ *  Tree number N is passed when floor((N + 1) * rate) > floor(N * rate),
+ *  so with rate 0.25 every fourth tree is passed.
+ */
+class sampling_aggregator_t : public stage_aggregator_t {
+public:
+	/*!
+	 * \brief Constructs stage
+	 * \param aggregator Next aggregator of the pipeline
+	 * \param rate Fraction of trees passed further from [0, 1]
+	 */
+	sampling_aggregator_t(std::shared_ptr<aggregator_t> aggregator, double rate):
+		stage_aggregator_t(aggregator), rate(std::min(std::max(rate, 0.), 1.)), trees_count(0) {}
+
+	/*!
+	 * \brief Frees memory consumed by sampling_aggregator
+	 */
+	~sampling_aggregator_t() {}
+
+	/*!
+	 * \brief Passes \a call_tree further if it is sampled
+	 * \param call_tree Tree that will be sampled
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		if (is_sampled()) {
+			aggregator->aggregate(call_tree);
+		}
+	}
+
+	/*!
+	 * \brief Passes handle of \a call_tree further if it is sampled
+	 * \param call_tree Handle of tree that will be sampled
+	 */
+	void aggregate_handle(call_tree_handle_t call_tree) {
+		if (is_sampled()) {
+			aggregator->aggregate_handle(std::move(call_tree));
+		}
+	}
+
+private:
+	bool is_sampled() {
+		uint64_t number = trees_count++;
+		return std::floor((number + 1) * rate) > std::floor(number * rate);
+	}
+
+	/*!
+	 * \brief Fraction of trees passed further
+	 */
+	const double rate;
+
+	/*!
+	 * \brief Number of trees seen by stage
+	 */
+	std::atomic<uint64_t> trees_count;
+};
+
+/*!
+ * \brief Stage that passes reduced copy of call tree
+ *
+ *  Actions deeper than max_depth and actions shorter than min_duration are removed
+ *  together with their subtrees. Number of removed actions is stored in "pruned_actions" stat.
+ */
+class transform_aggregator_t : public stage_aggregator_t {
+public:
+	/*!
+	 * \brief Parameters of tree reduction
+	 */
+	struct options_t {
+		/*!
+		 * \brief Initializes options that keep the whole tree
+		 */
+		options_t(): max_depth(0), min_duration(0) {}
+
+		/*!
+		 * \brief Maximum depth of kept actions, root actions have depth 1, 0 disables trimming
+		 */
+		size_t max_depth;
+
+		/*!
+		 * \brief Minimum duration of kept actions in microseconds, 0 disables pruning
+		 */
+		int64_t min_duration;
+	};
+
+	/*!
+	 * \brief Constructs stage
+	 * \param aggregator Next aggregator of the pipeline
+	 * \param options Parameters of tree reduction
+	 */
+	transform_aggregator_t(std::shared_ptr<aggregator_t> aggregator, const options_t &options):
+		stage_aggregator_t(aggregator), options(options) {}
+
+	/*!
+	 * \brief Frees memory consumed by transform_aggregator
+	 */
+	~transform_aggregator_t() {}
+
+	/*!
+	 * \brief Passes reduced copy of \a call_tree further
+	 * \param call_tree Tree that will be reduced
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		aggregator->aggregate_handle(transform(call_tree, options));
+	}
+
+	/*!
+	 * \brief Builds reduced copy of \a call_tree
+	 */
+	static call_tree_handle_t transform(const call_tree_t &call_tree, const options_t &options) {
+		std::shared_ptr<call_tree_t> result = std::make_shared<call_tree_t>(call_tree.get_actions_set());
+		const auto &stats = call_tree.get_stats();
+		for (auto it = stats.begin(); it != stats.end(); ++it) {
+			result->add_stat(it->first, it->second);
+		}
+
+		int pruned_actions = 0;
+		copy_links(call_tree, call_tree.root, *result, result->root, 1, options, pruned_actions);
+		if (pruned_actions > 0) {
+			result->add_stat("pruned_actions", pruned_actions);
+		}
+		return result;
+	}
+
+private:
+	static void copy_links(const call_tree_t &call_tree, call_tree_t::p_node_t node,
+						   call_tree_t &result, call_tree_t::p_node_t result_node, size_t depth,
+						   const options_t &options, int &pruned_actions) {
+		const auto &links = call_tree.get_node_links(node);
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			int64_t start_time = call_tree.get_node_start_time(it->second);
+			int64_t stop_time = call_tree.get_node_stop_time(it->second);
+
+			if ((options.max_depth > 0 && depth > options.max_depth) ||
+					stop_time - start_time < options.min_duration) {
+				pruned_actions += count_actions(call_tree, it->second);
+				continue;
+			}
+
+			call_tree_t::p_node_t child = result.add_new_link(result_node, it->first);
+			result.set_node_start_time(child, start_time);
+			result.set_node_stop_time(child, stop_time);
+			copy_links(call_tree, it->second, result, child, depth + 1, options, pruned_actions);
+		}
+	}
+
+	static int count_actions(const call_tree_t &call_tree, call_tree_t::p_node_t node) {
+		int count = 1;
+		const auto &links = call_tree.get_node_links(node);
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			count += count_actions(call_tree, it->second);
+		}
+		return count;
+	}
+
+	/*!
+	 * \brief Parameters of tree reduction
+	 */
+	const options_t options;
+};
+
+} // namespace react
+
+#endif // REACT_PIPELINE_HPP
@@ -54,6 +54,26 @@ Q_EXTERN_C int react_activate(void *react_aggregator);
  */
 Q_EXTERN_C int react_deactivate();
 
+/*!
+ * \brief Creates react thread context that only records events into per-thread buffer
+ *
+ *  Call tree is built and sent to aggregator on deactivation only if request took at least
+ *  \a threshold microseconds or was flagged with react_flag_request(), otherwise buffer is discarded.
+ *  Subthread aggregators and react_submit_progress() are not supported in this mode.
+ * \param react_aggregator Aggregator that will be used to collect react trace
+ * \param threshold Minimal duration of request in microseconds which tree is aggregated
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_activate_flight_recorder(void *react_aggregator, long long threshold);
+
+/*!
+ * \brief Marks current request, so its call tree is aggregated by flight recorder regardless of duration
+ *
+ *  Also adds "flagged" stat to current call tree.
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_flag_request();
+
 /*!
  * \brief Starts new action with action code \a action_code in thread_local context
  * \param action_code Code of action which will be started
@@ -76,6 +96,36 @@ Q_EXTERN_C int react_add_stat_int(const char *key, int value);
 Q_EXTERN_C int react_add_stat_double(const char *key, double value);
 Q_EXTERN_C int react_add_stat_string(const char *key, const char *value);
 
+/*!
+ * \brief Detaches current context from thread without copying, so it can be resumed later on any thread
+ *
+ *  Allows event loops to keep separate call tree per request across its asynchronous steps.
+ *  Started actions stay started, thread becomes inactive until context is resumed or new one is activated.
+ *  Flight recorder contexts can't be suspended, they stay active.
+ * \param react_context Receives suspended context or NULL if React is not active
+ * \return Returns error code, -ENOTSUP for flight recorder context
+ */
+Q_EXTERN_C int react_suspend_context(void **react_context);
+
+/*!
+ * \brief Attaches context suspended by react_suspend_context() to current thread
+ *
+ *  Context must be resumed exactly once, NULL context is ignored.
+ * \param react_context Suspended context
+ * \return Returns error code, fails if React is already active in current thread
+ */
+Q_EXTERN_C int react_resume_context(void *react_context);
+
+/*!
+ * \brief Frees context suspended by react_suspend_context() that will never be resumed
+ *
+ *  Call tree of abandoned request is not aggregated and its started actions are dropped silently.
+ *  NULL context is ignored.
+ * \param react_context Suspended context
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_discard_context(void *react_context);
+
 /*!
  * \brief Submits current context to aggregator
  */
@@ -84,6 +134,9 @@ Q_EXTERN_C int react_submit_progress();
 /*!
  * \brief Creates aggregator that can be passed to subthread in order to monitor it
  *          and merge result of monitoring with current thread context
+ *
+ *  Complete subthread trees are queued without locking and grafted under the node that was current
+ *  on creation when current thread submits progress or deactivates.
  * \return Returns pointer to newly created aggregator for subthread
  */
 Q_EXTERN_C void *react_create_subthread_aggregator();
@@ -95,4 +148,58 @@ Q_EXTERN_C void *react_create_subthread_aggregator();
  */
 Q_EXTERN_C int react_destroy_subthread_aggregator(void *subthread_aggregator);
 
+/*!
+ * \brief Starts span of action \a action_code that overlaps with other actions of current context
+ *
+ *  Span is recorded as a child of the current node and does not affect started actions stack.
+ * \param action_code Code of span action
+ * \return Returns span or NULL if React is not active
+ */
+Q_EXTERN_C void *react_start_async(int action_code);
+
+/*!
+ * \brief Stops \a span and destroys it, can be called in any order and from any thread
+ *
+ *  Stop time is applied on react_submit_progress() or react_deactivate() of context owner.
+ * \param span Span returned by react_start_async(), NULL is ignored
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_stop_async(void *span);
+
+/*!
+ * \brief Captures current context and node for handoff of work item to another thread
+ *
+ *  Token must be attached and then detached on worker thread exactly once,
+ *  or released with react_release_context() if work item is dropped.
+ * \return Returns token or NULL if React is not active, NULL token is ignored by attach and detach
+ */
+Q_EXTERN_C void *react_capture_context();
+
+/*!
+ * \brief Starts recording actions of current thread for context captured in \a token
+ *
+ *  Time since capture is recorded as "queue_wait" action, current context is suspended until detach.
+ * \param token Token returned by react_capture_context()
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_attach_context(void *token);
+
+/*!
+ * \brief Hands subtree recorded since attach back to captured context and destroys \a token
+ *
+ *  Subtree is grafted under captured node on react_submit_progress() or react_deactivate() of context owner.
+ * \param token Token passed to react_attach_context()
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_detach_context(void *token);
+
+/*!
+ * \brief Destroys \a token that was never attached, e.g. when work item is cancelled
+ *
+ *  Nothing is recorded for released token. Attached tokens must be detached instead.
+ * \param token Token returned by react_capture_context(), NULL is ignored
+ * \return Returns error code, fails if token is attached
+ */
+Q_EXTERN_C int react_release_context(void *token);
+
 #endif // REACT_H
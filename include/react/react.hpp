@@ -16,6 +16,7 @@
 #ifndef REACT_HPP
 #define REACT_HPP
 
+#include <chrono>
 #include <memory>
 
 #include "react/call_tree.hpp"
@@ -56,6 +57,11 @@ private:
 	 * \brief Wrapped action_guard_t
 	 */
 	std::unique_ptr<react::action_guard_t> m_action_guard;
+
+	/*!
+	 * \brief Code of action recorded by flight recorder or NO_ACTION
+	 */
+	int m_flight_action_code;
 };
 
 /*!
@@ -89,10 +95,117 @@ void add_stat(const std::string &key, const char *value);
 /*!
  * \brief Creates aggregator that can be passed to subthread in order to monitor it
  *          and merge result of monitoring with current thread context
+ *
+ *  Complete subthread trees are queued without locking and grafted under the node that was current
+ *  on creation when current thread submits progress or deactivates.
  * \return Returns shared_ptr to newly created aggregator for subthread
  */
 std::shared_ptr<aggregator_t> create_subthread_aggregator();
 
+/*!
+ * \brief Opaque handle of asynchronous span
+ */
+class async_span_t;
+
+/*!
+ * \brief Starts span of action \a action_code that is not nested into updater's call stack
+ *
+ *  Span is recorded as a child of the current node and may overlap with other actions.
+ * \return Returns span handle or empty pointer if React is not active
+ * \throw std::invalid_argument if action code is invalid
+ */
+std::shared_ptr<async_span_t> start_async(int action_code);
+
+/*!
+ * \brief Stops \a span, can be called in any order and from any thread
+ *
+ *  Stop time is applied by the context owner on react_submit_progress() or react_deactivate(),
+ *  spans stopped after deactivation are dropped. Empty span is ignored.
+ * \throw std::logic_error if span is already stopped
+ */
+void stop_async(const std::shared_ptr<async_span_t> &span);
+
+/*!
+ * \brief Opaque handle of context captured for handoff to another thread
+ */
+class context_token_t;
+
+/*!
+ * \brief Captures current context and node, so work item can be continued on another thread
+ *
+ *  Time between capture and attach is recorded as "queue_wait" action.
+ * \return Returns token that must be attached and detached once
+ * \throw std::runtime_error if React is not active
+ */
+std::shared_ptr<context_token_t> capture_context();
+
+/*!
+ * \brief Starts recording actions of current thread for context captured in \a token
+ *
+ *  Context of current thread, if any, is suspended until detach.
+ * \throw std::logic_error if token was already attached
+ */
+void attach_context(const std::shared_ptr<context_token_t> &token);
+
+/*!
+ * \brief Stops recording for \a token and hands recorded subtree back to captured context
+ *
+ *  Subtree is grafted under captured node by the owner of the context on react_submit_progress()
+ *  or react_deactivate(), so owner's actions are never blocked by workers.
+ * \throw std::logic_error if token is not attached to current thread or actions are not stopped
+ */
+void detach_context(const std::shared_ptr<context_token_t> &token);
+
+/*!
+ * \brief Carries react context of coroutine between its suspension and resumption
+ *
+ *  On suspend current thread context with its started actions is detached, on resume it is attached
+ *  to the resuming thread, which may differ. Time spent suspended is recorded as "suspended" action
+ *  under the action that was running, so it is separated from running time.
+ *  Awaiter helpers for C++20 coroutines are in react/coroutine.hpp.
+ */
+class coroutine_context_t {
+public:
+	coroutine_context_t();
+
+	coroutine_context_t(const coroutine_context_t &other) = delete;
+
+	/*!
+	 * \brief Drops context if coroutine is destroyed while suspended
+	 */
+	~coroutine_context_t();
+
+	coroutine_context_t &operator =(const coroutine_context_t &other) = delete;
+
+	/*!
+	 * \brief Detaches context of current thread, does nothing if React is not active
+	 * \throw std::logic_error if context is already suspended
+	 */
+	void suspend();
+
+	/*!
+	 * \brief Attaches suspended context to current thread and records suspended time
+	 * \throw std::logic_error if React is already active in current thread
+	 */
+	void resume();
+
+	/*!
+	 * \brief Checks whether context is detached
+	 */
+	bool is_suspended() const;
+
+private:
+	/*!
+	 * \brief Suspended context or NULL
+	 */
+	void *m_context;
+
+	/*!
+	 * \brief Time of the last suspension
+	 */
+	std::chrono::system_clock::time_point m_suspend_time;
+};
+
 } // namespace react
 
 #endif // REACT_HPP
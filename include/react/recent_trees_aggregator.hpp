@@ -0,0 +1,101 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_RECENT_TREES_AGGREGATOR_HPP
+#define REACT_RECENT_TREES_AGGREGATOR_HPP
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Aggregator that keeps handles of the last call trees
+ *
+ *  Trees are only stored, serialization is left to reader of get_trees().
+ */
+class recent_trees_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Default number of kept trees
+	 */
+	static const size_t DEFAULT_CAPACITY = 100;
+
+	/*!
+	 * \brief Constructs empty aggregator
+	 * \param capacity Number of kept trees
+	 */
+	recent_trees_aggregator_t(size_t capacity = DEFAULT_CAPACITY): capacity(std::max<size_t>(capacity, 1)) {}
+
+	/*!
+	 * \brief Frees memory consumed by recent_trees_aggregator
+	 */
+	~recent_trees_aggregator_t() {}
+
+	/*!
+	 * \brief Keeps copy of \a call_tree
+	 * \param call_tree Tree that will be kept
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		aggregate_handle(std::make_shared<const call_tree_t>(call_tree));
+	}
+
+	/*!
+	 * \brief Keeps handle of \a call_tree, dropping the oldest tree if needed
+	 * \param call_tree Handle of tree that will be kept
+	 */
+	void aggregate_handle(call_tree_handle_t call_tree) {
+		call_tree_handle_t dropped_tree;
+		std::lock_guard<std::mutex> guard(mutex);
+		if (trees.size() == capacity) {
+			// Tree is freed after unlock
+			dropped_tree = std::move(trees.front());
+			trees.pop_front();
+		}
+		trees.push_back(std::move(call_tree));
+	}
+
+	/*!
+	 * \brief Returns kept trees from the oldest to the newest
+	 */
+	std::vector<call_tree_handle_t> get_trees() const {
+		std::lock_guard<std::mutex> guard(mutex);
+		return std::vector<call_tree_handle_t>(trees.begin(), trees.end());
+	}
+
+private:
+	/*!
+	 * \brief Number of kept trees
+	 */
+	const size_t capacity;
+
+	/*!
+	 * \brief Kept trees from the oldest to the newest
+	 */
+	std::deque<call_tree_handle_t> trees;
+
+	/*!
+	 * \brief Trees access synchronization
+	 */
+	mutable std::mutex mutex;
+};
+
+} // namespace react
+
+#endif // REACT_RECENT_TREES_AGGREGATOR_HPP
@@ -0,0 +1,195 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_SHM_RING_HPP
+#define REACT_SHM_RING_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "aggregator.hpp"
+
+namespace react {
+
+struct shm_ring_header_t;
+
+/*!
+ * \brief Aggregator that publishes call trees into ring buffer in POSIX shared memory
+ *
+ *  Trees are encoded with tree_codec_t into fixed-size slots of segment "/dev/shm/<name>".
+ *  Every slot is guarded by sequence number: writer of tree number N marks slot with 2N + 1,
+ *  copies record and marks it with 2N + 2, so readers can detect records overwritten while copying.
+ *  Writer that finds its slot still busy drops the tree and marks the slot as abandoned for N,
+ *  so readers skip it instead of waiting for the slot to be reused.
+ *  Writers never wait for readers: oldest records are overwritten and counted as overruns,
+ *  trees larger than slot are dropped.
+ */
+class shm_ring_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Default number of slots in ring
+	 */
+	static const size_t DEFAULT_SLOTS_COUNT = 1024;
+
+	/*!
+	 * \brief Default maximum size of encoded tree in bytes
+	 */
+	static const size_t DEFAULT_SLOT_SIZE = 64 * 1024;
+
+	/*!
+	 * \brief Creates shared memory segment \a name and maps it
+	 * \param name Name of segment, leading slash is added if missing
+	 * \param slots_count Number of trees kept in ring
+	 * \param slot_size Maximum size of encoded tree in bytes
+	 */
+	shm_ring_aggregator_t(const std::string &name, size_t slots_count = DEFAULT_SLOTS_COUNT,
+						  size_t slot_size = DEFAULT_SLOT_SIZE);
+
+	/*!
+	 * \brief Unmaps and unlinks shared memory segment
+	 *
+	 *  Readers that have already mapped the segment can still read it.
+	 */
+	~shm_ring_aggregator_t();
+
+	/*!
+	 * \brief Encodes call tree and publishes it into the next slot
+	 * \param call_tree Tree that will be published
+	 */
+	void aggregate(const call_tree_t &call_tree);
+
+	/*!
+	 * \brief Returns number of trees published into ring
+	 */
+	uint64_t get_written_count() const;
+
+	/*!
+	 * \brief Returns number of trees overwritten before reader consumed them
+	 */
+	uint64_t get_overruns_count() const;
+
+	/*!
+	 * \brief Returns number of trees that were too large or lost slot to another writer
+	 */
+	uint64_t get_dropped_count() const;
+
+private:
+	shm_ring_aggregator_t(const shm_ring_aggregator_t &);
+	shm_ring_aggregator_t &operator =(const shm_ring_aggregator_t &);
+
+	/*!
+	 * \brief Name of shared memory segment
+	 */
+	const std::string name;
+
+	/*!
+	 * \brief Mapped segment
+	 */
+	shm_ring_header_t *header;
+
+	/*!
+	 * \brief Size of mapped segment in bytes
+	 */
+	size_t mapping_size;
+};
+
+/*!
+ * \brief Consumer of call trees published by shm_ring_aggregator_t, possibly in another process
+ *
+ *  Reader starts from the oldest tree still present in ring and publishes its position,
+ *  so writer can count overruns. Only single reader per segment should publish position.
+ */
+class shm_ring_reader_t {
+public:
+	/*!
+	 * \brief Opens and maps existing shared memory segment \a name
+	 * \throw std::runtime_error if segment does not exist or has unknown format
+	 */
+	shm_ring_reader_t(const std::string &name);
+
+	/*!
+	 * \brief Unmaps shared memory segment
+	 */
+	~shm_ring_reader_t();
+
+	/*!
+	 * \brief Copies next encoded tree into \a record
+	 * \return Whether new tree was available
+	 */
+	bool read_record(std::string &record);
+
+	/*!
+	 * \brief Reads and decodes next tree
+	 *
+	 *  Decoded tree refers to actions set owned by reader.
+	 * \return Next tree or empty pointer if no new tree is available
+	 */
+	std::unique_ptr<call_tree_t> read_call_tree();
+
+	/*!
+	 * \brief Returns actions set where names of read trees actions are defined
+	 */
+	const actions_set_t &get_actions_set() const {
+		return actions_set;
+	}
+
+	/*!
+	 * \brief Returns number of trees that were overwritten before this reader copied them
+	 *
+	 *  Trees dropped by writers because their slot was busy are skipped and counted here too.
+	 */
+	uint64_t get_lost_count() const {
+		return lost_count;
+	}
+
+	/*!
+	 * \brief Returns number of trees dropped by writers
+	 */
+	uint64_t get_dropped_count() const;
+
+private:
+	shm_ring_reader_t(const shm_ring_reader_t &);
+	shm_ring_reader_t &operator =(const shm_ring_reader_t &);
+
+	/*!
+	 * \brief Mapped segment
+	 */
+	shm_ring_header_t *header;
+
+	/*!
+	 * \brief Size of mapped segment in bytes
+	 */
+	size_t mapping_size;
+
+	/*!
+	 * \brief Number of the next tree to read
+	 */
+	uint64_t next_index;
+
+	/*!
+	 * \brief Number of trees missed by reader
+	 */
+	uint64_t lost_count;
+
+	/*!
+	 * \brief Names of actions of decoded trees
+	 */
+	actions_set_t actions_set;
+};
+
+} // namespace react
+
+#endif // REACT_SHM_RING_HPP
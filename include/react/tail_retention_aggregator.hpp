@@ -0,0 +1,274 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_TAIL_RETENTION_AGGREGATOR_HPP
+#define REACT_TAIL_RETENTION_AGGREGATOR_HPP
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Aggregator that forwards only slow call trees to downstream aggregator
+ *
+ *  Tree duration is either span of root actions or the longest call of chosen action.
+ *  Trees not shorter than threshold are forwarded immediately, other trees compete for
+ *  top_k places of their time window and the winners are forwarded when window is over.
+ *  Duration is checked before tree is copied, so discarded trees cost a single tree walk.
+ */
+class tail_retention_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Parameters of tail retention
+	 */
+	struct options_t {
+		/*!
+		 * \brief Initializes default options
+		 */
+		options_t(): threshold(0), top_k(10), window_width(1), action_code(+actions_set_t::NO_ACTION) {}
+
+		/*!
+		 * \brief Trees with duration not less than this value in microseconds are always kept, 0 disables
+		 */
+		int64_t threshold;
+
+		/*!
+		 * \brief Number of the slowest trees kept per window, 0 disables
+		 */
+		size_t top_k;
+
+		/*!
+		 * \brief Width of window in seconds
+		 */
+		int window_width;
+
+		/*!
+		 * \brief Action which duration is checked, NO_ACTION for duration of the whole tree
+		 */
+		int action_code;
+	};
+
+	/*!
+	 * \brief Constructs aggregator
+	 * \param aggregator Downstream aggregator which receives kept trees
+	 * \param options Retention parameters
+	 */
+	tail_retention_aggregator_t(std::shared_ptr<aggregator_t> aggregator, const options_t &options = options_t()):
+		aggregator(aggregator), options(options), window_number(-1), forwarded_count(0), discarded_count(0) {
+		if (!aggregator) {
+			throw std::invalid_argument("Can't create tail retention aggregator: aggregator is NULL");
+		}
+	}
+
+	/*!
+	 * \brief Forwards trees kept for the current window
+	 */
+	~tail_retention_aggregator_t() {
+		try {
+			flush();
+		} catch (std::exception &e) {
+			std::cerr << e.what() << std::endl;
+		}
+	}
+
+	/*!
+	 * \brief Checks duration of \a call_tree and copies it only if it is kept
+	 * \param call_tree Tree that will be checked
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		process(call_tree, call_tree_handle_t());
+	}
+
+	/*!
+	 * \brief Checks duration of \a call_tree and keeps handle if it is slow enough
+	 * \param call_tree Handle of tree that will be checked
+	 */
+	void aggregate_handle(call_tree_handle_t call_tree) {
+		process(*call_tree, call_tree);
+	}
+
+	/*!
+	 * \brief Forwards trees kept for the current window without waiting for its end
+	 */
+	void flush() {
+		std::vector<call_tree_handle_t> trees;
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			take_window(trees);
+		}
+		forward(trees);
+	}
+
+	/*!
+	 * \brief Returns number of trees passed to downstream aggregator
+	 */
+	size_t get_forwarded_count() const {
+		std::lock_guard<std::mutex> guard(mutex);
+		return forwarded_count;
+	}
+
+	/*!
+	 * \brief Returns number of trees that were not kept
+	 */
+	size_t get_discarded_count() const {
+		std::lock_guard<std::mutex> guard(mutex);
+		return discarded_count;
+	}
+
+	/*!
+	 * \brief Returns duration of \a call_tree checked by this aggregator
+	 * \return Duration in microseconds or -1 if tree does not contain checked action
+	 */
+	int64_t get_duration(const call_tree_t &call_tree) const {
+		if (options.action_code == actions_set_t::NO_ACTION) {
+			const auto &links = call_tree.get_node_links(call_tree.root);
+			if (links.empty()) {
+				return -1;
+			}
+
+			int64_t start_time = call_tree.get_node_start_time(links.front().second);
+			int64_t stop_time = call_tree.get_node_stop_time(links.front().second);
+			for (auto it = links.begin(); it != links.end(); ++it) {
+				start_time = std::min(start_time, call_tree.get_node_start_time(it->second));
+				stop_time = std::max(stop_time, call_tree.get_node_stop_time(it->second));
+			}
+			return stop_time - start_time;
+		}
+
+		return get_action_duration(call_tree, call_tree.root);
+	}
+
+private:
+	typedef std::pair<int64_t, call_tree_handle_t> entry_t;
+
+	static bool compare_entries(const entry_t &lhs, const entry_t &rhs) {
+		return lhs.first > rhs.first;
+	}
+
+	int64_t get_action_duration(const call_tree_t &call_tree, call_tree_t::p_node_t node) const {
+		int64_t duration = -1;
+		const auto &links = call_tree.get_node_links(node);
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			if (it->first == options.action_code) {
+				duration = std::max(duration, call_tree.get_node_stop_time(it->second) -
+									call_tree.get_node_start_time(it->second));
+			}
+			duration = std::max(duration, get_action_duration(call_tree, it->second));
+		}
+		return duration;
+	}
+
+	static int64_t get_start_time(const call_tree_t &call_tree) {
+		const auto &links = call_tree.get_node_links(call_tree.root);
+		return links.empty() ? 0 : call_tree.get_node_start_time(links.front().second);
+	}
+
+	void process(const call_tree_t &call_tree, call_tree_handle_t handle) {
+		int64_t duration = get_duration(call_tree);
+		std::vector<call_tree_handle_t> trees;
+
+		if (duration >= 0 && options.threshold > 0 && duration >= options.threshold) {
+			trees.push_back(handle ? handle : std::make_shared<const call_tree_t>(call_tree));
+			{
+				std::lock_guard<std::mutex> guard(mutex);
+				++forwarded_count;
+			}
+			forward(trees);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			int64_t number = get_start_time(call_tree) / (std::max(options.window_width, 1) * int64_t(1000000));
+			if (number > window_number) {
+				take_window(trees);
+				window_number = number;
+			}
+
+			if (duration < 0 || options.top_k == 0) {
+				++discarded_count;
+			} else if (window.size() < options.top_k) {
+				keep(duration, handle, call_tree);
+			} else if (duration > window.front().first) {
+				std::pop_heap(window.begin(), window.end(), compare_entries);
+				window.pop_back();
+				++discarded_count;
+				keep(duration, handle, call_tree);
+			} else {
+				++discarded_count;
+			}
+		}
+
+		forward(trees);
+	}
+
+	void keep(int64_t duration, const call_tree_handle_t &handle, const call_tree_t &call_tree) {
+		window.push_back(entry_t(duration, handle ? handle : std::make_shared<const call_tree_t>(call_tree)));
+		std::push_heap(window.begin(), window.end(), compare_entries);
+	}
+
+	void take_window(std::vector<call_tree_handle_t> &trees) {
+		std::sort_heap(window.begin(), window.end(), compare_entries);
+		for (auto it = window.begin(); it != window.end(); ++it) {
+			trees.push_back(it->second);
+		}
+		forwarded_count += window.size();
+		window.clear();
+	}
+
+	void forward(std::vector<call_tree_handle_t> &trees) {
+		for (auto it = trees.begin(); it != trees.end(); ++it) {
+			aggregator->aggregate_handle(std::move(*it));
+		}
+	}
+
+	/*!
+	 * \brief Downstream aggregator which receives kept trees
+	 */
+	std::shared_ptr<aggregator_t> aggregator;
+
+	/*!
+	 * \brief Retention parameters
+	 */
+	const options_t options;
+
+	/*!
+	 * \brief Number of the current window
+	 */
+	int64_t window_number;
+
+	/*!
+	 * \brief Min-heap of the slowest trees of the current window by duration
+	 */
+	std::vector<entry_t> window;
+
+	size_t forwarded_count;
+	size_t discarded_count;
+
+	/*!
+	 * \brief Window access synchronization
+	 */
+	mutable std::mutex mutex;
+};
+
+} // namespace react
+
+#endif // REACT_TAIL_RETENTION_AGGREGATOR_HPP
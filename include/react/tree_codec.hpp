@@ -0,0 +1,221 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_TREE_CODEC_HPP
+#define REACT_TREE_CODEC_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "call_tree.hpp"
+
+namespace react {
+
+/*!
+ * \brief Compact binary representation of call tree
+ *
+ *  All integers are stored in host byte order, record is intended for processes on the same host.
+ *  Layout:
+ *  - u32 names count, then names of actions used by the tree as u32 length and bytes
+ *  - u32 stats count, then stats as key string, u8 type (index in stat_value_t) and value
+ *  - nodes in pre-order starting with root children count:
+ *    u32 index in names table, i64 start time, i64 stop time, u32 children count
+ */
+class tree_codec_t {
+public:
+	/*!
+	 * \brief Appends binary representation of \a call_tree to \a buffer
+	 */
+	static void encode(const call_tree_t &call_tree, std::string &buffer) {
+		std::unordered_map<int, uint32_t> names;
+		std::vector<int> codes;
+		collect_names(call_tree, call_tree.root, names, codes);
+
+		const actions_set_t &actions_set = call_tree.get_actions_set();
+		put<uint32_t>(buffer, codes.size());
+		for (auto it = codes.begin(); it != codes.end(); ++it) {
+			put_string(buffer, actions_set.get_action_name(*it));
+		}
+
+		const auto &stats = call_tree.get_stats();
+		put<uint32_t>(buffer, stats.size());
+		for (auto it = stats.begin(); it != stats.end(); ++it) {
+			put_string(buffer, it->first);
+			put<uint8_t>(buffer, it->second.which());
+			boost::apply_visitor(stat_encoder_t(buffer), it->second);
+		}
+
+		put<uint32_t>(buffer, call_tree.get_node_links(call_tree.root).size());
+		encode_links(call_tree, call_tree.root, names, buffer);
+	}
+
+	/*!
+	 * \brief Restores call tree from binary representation
+	 *
+	 *  Action names are defined in \a actions_set, which must outlive returned tree.
+	 * \throw std::runtime_error if record is truncated or malformed
+	 */
+	static call_tree_t decode(const char *data, size_t size, actions_set_t &actions_set) {
+		reader_t reader(data, size);
+		call_tree_t call_tree(actions_set);
+
+		uint32_t names_count = reader.get<uint32_t>();
+		std::vector<int> codes;
+		for (uint32_t i = 0; i < names_count; ++i) {
+			codes.push_back(actions_set.define_new_action(reader.get_string()));
+		}
+
+		uint32_t stats_count = reader.get<uint32_t>();
+		for (uint32_t i = 0; i < stats_count; ++i) {
+			std::string key = reader.get_string();
+			switch (reader.get<uint8_t>()) {
+			case 0:
+				call_tree.add_stat(key, reader.get<uint8_t>() != 0);
+				break;
+			case 1:
+				call_tree.add_stat(key, static_cast<int>(reader.get<int32_t>()));
+				break;
+			case 2:
+				call_tree.add_stat(key, reader.get<double>());
+				break;
+			case 3:
+				call_tree.add_stat(key, reader.get_string());
+				break;
+			default:
+				throw std::runtime_error("Can't decode call tree: unknown stat type");
+			}
+		}
+
+		decode_links(call_tree, call_tree.root, reader.get<uint32_t>(), codes, reader);
+
+		if (!reader.empty()) {
+			throw std::runtime_error("Can't decode call tree: trailing data");
+		}
+		return call_tree;
+	}
+
+private:
+	struct stat_encoder_t : boost::static_visitor<> {
+		stat_encoder_t(std::string &buffer): buffer(buffer) {}
+
+		void operator () (bool value) const {
+			put<uint8_t>(buffer, value ? 1 : 0);
+		}
+
+		void operator () (int value) const {
+			put<int32_t>(buffer, value);
+		}
+
+		void operator () (double value) const {
+			put<double>(buffer, value);
+		}
+
+		void operator () (const std::string &value) const {
+			put_string(buffer, value);
+		}
+
+		std::string &buffer;
+	};
+
+	class reader_t {
+	public:
+		reader_t(const char *data, size_t size): data(data), size(size) {}
+
+		template<typename T>
+		T get() {
+			T value;
+			memcpy(&value, take(sizeof(T)), sizeof(T));
+			return value;
+		}
+
+		std::string get_string() {
+			uint32_t length = get<uint32_t>();
+			return std::string(take(length), length);
+		}
+
+		bool empty() const {
+			return size == 0;
+		}
+
+	private:
+		const char *take(size_t length) {
+			if (length > size) {
+				throw std::runtime_error("Can't decode call tree: record is truncated");
+			}
+			const char *result = data;
+			data += length;
+			size -= length;
+			return result;
+		}
+
+		const char *data;
+		size_t size;
+	};
+
+	template<typename T>
+	static void put(std::string &buffer, T value) {
+		buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+	}
+
+	static void put_string(std::string &buffer, const std::string &value) {
+		put<uint32_t>(buffer, value.size());
+		buffer.append(value);
+	}
+
+	static void collect_names(const call_tree_t &call_tree, call_tree_t::p_node_t node,
+							  std::unordered_map<int, uint32_t> &names, std::vector<int> &codes) {
+		const auto &links = call_tree.get_node_links(node);
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			if (names.insert(std::make_pair(it->first, codes.size())).second) {
+				codes.push_back(it->first);
+			}
+			collect_names(call_tree, it->second, names, codes);
+		}
+	}
+
+	static void encode_links(const call_tree_t &call_tree, call_tree_t::p_node_t node,
+							 const std::unordered_map<int, uint32_t> &names, std::string &buffer) {
+		const auto &links = call_tree.get_node_links(node);
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			call_tree_t::p_node_t child = it->second;
+			put<uint32_t>(buffer, names.at(it->first));
+			put<int64_t>(buffer, call_tree.get_node_start_time(child));
+			put<int64_t>(buffer, call_tree.get_node_stop_time(child));
+			put<uint32_t>(buffer, call_tree.get_node_links(child).size());
+			encode_links(call_tree, child, names, buffer);
+		}
+	}
+
+	static void decode_links(call_tree_t &call_tree, call_tree_t::p_node_t node, uint32_t links_count,
+							 const std::vector<int> &codes, reader_t &reader) {
+		for (uint32_t i = 0; i < links_count; ++i) {
+			uint32_t name_index = reader.get<uint32_t>();
+			if (name_index >= codes.size()) {
+				throw std::runtime_error("Can't decode call tree: invalid action index");
+			}
+			call_tree_t::p_node_t child = call_tree.add_new_link(node, codes[name_index]);
+			call_tree.set_node_start_time(child, reader.get<int64_t>());
+			call_tree.set_node_stop_time(child, reader.get<int64_t>());
+			decode_links(call_tree, child, reader.get<uint32_t>(), codes, reader);
+		}
+	}
+};
+
+} // namespace react
+
+#endif // REACT_TREE_CODEC_HPP
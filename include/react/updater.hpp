@@ -90,6 +90,19 @@ public:
 		trace_depth = 0;
 	}
 
+	/*!
+	 * \brief Drops started actions without recording their stop, call tree keeps their nodes
+	 *
+	 *  Allows to destroy updater of abandoned request without reporting extra measurements.
+	 */
+	void discard_started_actions() {
+		while (measurements.size() > 1) {
+			measurements.pop();
+		}
+		current_node = call_tree ? call_tree->get_call_tree().root : +call_tree_t::NO_NODE;
+		trace_depth = 0;
+	}
+
 	/*!
 	 * \brief Resets current call tree
 	 */
@@ -0,0 +1,227 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_WINDOWED_AGGREGATOR_HPP
+#define REACT_WINDOWED_AGGREGATOR_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "aggregator.hpp"
+#include "histogram.hpp"
+
+namespace react {
+
+/*!
+ * \brief Aggregator that keeps per-action latency histograms in ring of fixed-width time windows
+ *
+ *  Every action is counted in window of its start time. Window is reused when action from
+ *  windows_count widths later arrives, actions older than the oldest window are dropped.
+ *  Memory is bounded by windows_count * number of actions.
+ */
+class windowed_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Default width of window in seconds
+	 */
+	static const int DEFAULT_WINDOW_WIDTH = 1;
+
+	/*!
+	 * \brief Default number of windows in ring
+	 */
+	static const size_t DEFAULT_WINDOWS_COUNT = 300;
+
+	/*!
+	 * \brief Constructs empty aggregator
+	 * \param actions_set Actions set used to resolve action names on json export
+	 * \param window_width Width of window in seconds
+	 * \param windows_count Number of windows in ring
+	 */
+	windowed_aggregator_t(const actions_set_t &actions_set, int window_width = DEFAULT_WINDOW_WIDTH,
+						  size_t windows_count = DEFAULT_WINDOWS_COUNT):
+		actions_set(actions_set),
+		window_width(std::max(window_width, 1) * int64_t(1000000)),
+		windows(std::max<size_t>(windows_count, 1)),
+		dropped_count(0) {}
+
+	/*!
+	 * \brief Frees memory consumed by windowed_aggregator
+	 */
+	~windowed_aggregator_t() {}
+
+	/*!
+	 * \brief Adds durations of all actions of \a call_tree to windows of their start times
+	 * \param call_tree Tree that will be aggregated
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		std::lock_guard<std::mutex> guard(mutex);
+		aggregate(call_tree, call_tree.root);
+	}
+
+	/*!
+	 * \brief Returns histogram of durations of \a action_code started during last \a seconds
+	 * \param action_code Action which durations are requested
+	 * \param seconds Length of interval, rounded up to window width, current window is included
+	 * \param now Current time in microseconds since epoch
+	 */
+	histogram_t get_histogram(int action_code, int seconds, int64_t now) const {
+		histogram_t histogram;
+		int64_t last_window = now / window_width;
+		int64_t first_window = last_window - (seconds * int64_t(1000000) + window_width - 1) / window_width + 1;
+
+		std::lock_guard<std::mutex> guard(mutex);
+		for (auto it = windows.begin(); it != windows.end(); ++it) {
+			if (it->number < first_window || it->number > last_window) {
+				continue;
+			}
+			auto action = it->actions.find(action_code);
+			if (action != it->actions.end()) {
+				histogram.merge(action->second);
+			}
+		}
+		return histogram;
+	}
+
+	/*!
+	 * \brief Returns histogram of durations of \a action_code started during last \a seconds until now
+	 */
+	histogram_t get_histogram(int action_code, int seconds) const {
+		return get_histogram(action_code, seconds, std::chrono::duration_cast<std::chrono::microseconds>(
+								 std::chrono::system_clock::now().time_since_epoch()).count());
+	}
+
+	/*!
+	 * \brief Returns number of actions that were older than the oldest window
+	 */
+	size_t get_dropped_count() const {
+		std::lock_guard<std::mutex> guard(mutex);
+		return dropped_count;
+	}
+
+	/*!
+	 * \brief Converts windows to stacked histogram series
+	 *
+	 *  Every action name is mapped to array of measurements ordered by time:
+	 *  {"READ":[{"timestamp":1400000000000,"calls":10,...,"50%":100,...,"99%":900}, ...], ...},
+	 *  where timestamp is window start in milliseconds.
+	 */
+	rapidjson::Value& to_json(rapidjson::Value &value, rapidjson::Document::AllocatorType &allocator) const {
+		std::lock_guard<std::mutex> guard(mutex);
+
+		std::map<int64_t, const window_t *> ordered_windows;
+		for (auto it = windows.begin(); it != windows.end(); ++it) {
+			if (it->number >= 0) {
+				ordered_windows[it->number] = &*it;
+			}
+		}
+
+		std::map<int, rapidjson::Value> series;
+		for (auto it = ordered_windows.begin(); it != ordered_windows.end(); ++it) {
+			const window_t &window = *it->second;
+			for (auto action = window.actions.begin(); action != window.actions.end(); ++action) {
+				rapidjson::Value &action_series = series[action->first];
+				if (!action_series.IsArray()) {
+					action_series.SetArray();
+				}
+
+				rapidjson::Value measurement(rapidjson::kObjectType);
+				measurement.AddMember("timestamp", window.number * window_width / 1000, allocator);
+				action->second.to_json(measurement, allocator);
+				action_series.PushBack(measurement, allocator);
+			}
+		}
+
+		for (auto it = series.begin(); it != series.end(); ++it) {
+			std::string name = actions_set.get_action_name(it->first);
+			rapidjson::Value name_value(name.c_str(), name.size(), allocator);
+			value.AddMember(name_value, it->second, allocator);
+		}
+		return value;
+	}
+
+private:
+	/*!
+	 * \brief Histograms of actions started during single window
+	 */
+	struct window_t {
+		window_t(): number(-1) {}
+
+		/*!
+		 * \brief Start time of window divided by window width, -1 for unused window
+		 */
+		int64_t number;
+
+		/*!
+		 * \brief Durations histograms by action code
+		 */
+		std::map<int, histogram_t> actions;
+	};
+
+	void aggregate(const call_tree_t &call_tree, call_tree_t::p_node_t node) {
+		const auto &links = call_tree.get_node_links(node);
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			int64_t start_time = call_tree.get_node_start_time(it->second);
+			int64_t number = start_time / window_width;
+			window_t *window = start_time >= 0 ? &get_window(number) : NULL;
+			if (window && window->number == number) {
+				window->actions[it->first].add(call_tree.get_node_stop_time(it->second) - start_time);
+			} else {
+				++dropped_count;
+			}
+			aggregate(call_tree, it->second);
+		}
+	}
+
+	window_t &get_window(int64_t number) {
+		window_t &window = windows[number % windows.size()];
+		if (window.number < number) {
+			window.number = number;
+			window.actions.clear();
+		}
+		return window;
+	}
+
+	/*!
+	 * \brief Actions set used to resolve action names on json export
+	 */
+	const actions_set_t &actions_set;
+
+	/*!
+	 * \brief Width of window in microseconds
+	 */
+	const int64_t window_width;
+
+	/*!
+	 * \brief Ring of windows
+	 */
+	std::vector<window_t> windows;
+
+	/*!
+	 * \brief Number of actions older than the oldest window
+	 */
+	size_t dropped_count;
+
+	/*!
+	 * \brief Windows access synchronization
+	 */
+	mutable std::mutex mutex;
+};
+
+} // namespace react
+
+#endif // REACT_WINDOWED_AGGREGATOR_HPP
@@ -0,0 +1,270 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#include "react/file_aggregator.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace react {
+
+file_aggregator_t::file_aggregator_t(const std::string &path, const options_t &options)
+	: path(path)
+	, options(options)
+	, file_opened(false)
+	, file_number(0)
+	, file_size(0)
+	, has_unflushed_data(false)
+	, is_stopping(false)
+{
+	if (options.buffer_size == 0) {
+		throw std::invalid_argument("Can't create file aggregator: buffer size is zero");
+	}
+
+	writer = file_writer_t::create(options.backend, options.buffer_size);
+	file_number = find_next_file_number();
+	open_file();
+
+	if (options.flush_interval > 0 || options.rotation_interval > 0) {
+		flush_thread = std::thread(&file_aggregator_t::flush_loop, this);
+	}
+}
+
+file_aggregator_t::~file_aggregator_t()
+{
+	if (flush_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			is_stopping = true;
+		}
+		flush_condition.notify_all();
+		flush_thread.join();
+	}
+
+	try {
+		close_file();
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+	}
+}
+
+void file_aggregator_t::aggregate(const call_tree_t &call_tree)
+{
+	rapidjson::StringBuffer record;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(record);
+	call_tree.write_json(writer);
+	record.Put('\n');
+
+	std::lock_guard<std::mutex> guard(mutex);
+	rotate_if_needed(record.Size());
+
+	offsets.push_back(file_size);
+	file_size += record.Size();
+	this->writer->append(record.GetString(), record.Size());
+	if (!has_unflushed_data) {
+		has_unflushed_data = true;
+		flush_time = clock_t::now();
+		flush_condition.notify_all();
+	}
+
+	if (options.flush_interval > 0 &&
+			clock_t::now() - flush_time >= std::chrono::milliseconds(options.flush_interval)) {
+		flush_buffer();
+	}
+}
+
+void file_aggregator_t::flush()
+{
+	std::lock_guard<std::mutex> guard(mutex);
+	flush_buffer();
+}
+
+std::string file_aggregator_t::get_current_file_name() const
+{
+	std::lock_guard<std::mutex> guard(mutex);
+	return get_file_name(file_number);
+}
+
+file_writer_t::backend_t file_aggregator_t::get_backend() const
+{
+	return writer->get_backend();
+}
+
+size_t file_aggregator_t::get_in_flight_bytes() const
+{
+	return writer->get_in_flight_bytes();
+}
+
+std::string file_aggregator_t::get_file_name(size_t number) const
+{
+	return path + "." + std::to_string(static_cast<unsigned long long>(number));
+}
+
+size_t file_aggregator_t::find_next_file_number() const
+{
+	size_t separator = path.rfind('/');
+	std::string directory = separator == std::string::npos ? "." : path.substr(0, separator + 1);
+	std::string prefix = (separator == std::string::npos ? path : path.substr(separator + 1)) + ".";
+
+	DIR *dir = opendir(directory.c_str());
+	if (!dir) {
+		return 0;
+	}
+
+	size_t next_number = 0;
+	while (dirent *entry = readdir(dir)) {
+		std::string name = entry->d_name;
+		if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) {
+			continue;
+		}
+
+		const char *number = name.c_str() + prefix.size();
+		char *end = NULL;
+		unsigned long long value = strtoull(number, &end, 10);
+		if (*number >= '0' && *number <= '9' && *end == '\0') {
+			next_number = std::max<size_t>(next_number, value + 1);
+		}
+	}
+	closedir(dir);
+	return next_number;
+}
+
+void file_aggregator_t::open_file()
+{
+	// File may have been created by another process since numbering was chosen
+	struct stat file_stat;
+	while (stat(get_file_name(file_number).c_str(), &file_stat) == 0) {
+		++file_number;
+	}
+
+	writer->open(get_file_name(file_number));
+	file_opened = true;
+
+	file_size = 0;
+	offsets.clear();
+	file_open_time = clock_t::now();
+	flush_time = file_open_time;
+	has_unflushed_data = false;
+}
+
+void file_aggregator_t::close_file()
+{
+	if (!file_opened) {
+		return;
+	}
+	file_opened = false;
+
+	rapidjson::StringBuffer index;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(index);
+	writer.StartObject();
+	writer.String("react_index").StartObject();
+	writer.String("trees").Uint64(offsets.size());
+	writer.String("offsets").StartArray();
+	for (auto it = offsets.begin(); it != offsets.end(); ++it) {
+		writer.Uint64(*it);
+	}
+	writer.EndArray();
+	writer.EndObject();
+	writer.EndObject();
+	index.Put('\n');
+
+	try {
+		this->writer->append(index.GetString(), index.Size());
+		if (options.sync_policy != NO_SYNC) {
+			this->writer->sync();
+		}
+	} catch (...) {
+		this->writer->close();
+		throw;
+	}
+	this->writer->close();
+}
+
+void file_aggregator_t::rotate_if_needed(size_t record_size)
+{
+	if (offsets.empty()) {
+		return;
+	}
+
+	bool size_exceeded = options.max_file_size > 0 && file_size + record_size > options.max_file_size;
+	bool time_exceeded = options.rotation_interval > 0 &&
+			clock_t::now() - file_open_time >= std::chrono::seconds(options.rotation_interval);
+
+	if (size_exceeded || time_exceeded) {
+		close_file();
+		++file_number;
+		open_file();
+	}
+}
+
+void file_aggregator_t::flush_loop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!is_stopping) {
+		clock_t::time_point now = clock_t::now();
+		clock_t::time_point deadline = clock_t::time_point::max();
+
+		if (options.flush_interval > 0 && has_unflushed_data) {
+			clock_t::time_point flush_deadline = flush_time + std::chrono::milliseconds(options.flush_interval);
+			if (now >= flush_deadline) {
+				try {
+					flush_buffer();
+				} catch (std::exception &e) {
+					std::cerr << "react: can't flush file aggregator: " << e.what() << std::endl;
+				}
+				continue;
+			}
+			deadline = std::min(deadline, flush_deadline);
+		}
+
+		if (options.rotation_interval > 0 && !offsets.empty()) {
+			clock_t::time_point rotation_deadline = file_open_time + std::chrono::seconds(options.rotation_interval);
+			if (now >= rotation_deadline) {
+				try {
+					rotate_if_needed(0);
+				} catch (std::exception &e) {
+					std::cerr << "react: can't rotate file aggregator: " << e.what() << std::endl;
+				}
+				continue;
+			}
+			deadline = std::min(deadline, rotation_deadline);
+		}
+
+		if (deadline == clock_t::time_point::max()) {
+			flush_condition.wait(lock);
+		} else {
+			flush_condition.wait_until(lock, deadline);
+		}
+	}
+}
+
+void file_aggregator_t::flush_buffer()
+{
+	flush_time = clock_t::now();
+	has_unflushed_data = false;
+
+	if (options.sync_policy == SYNC_ON_FLUSH) {
+		writer->sync();
+	} else {
+		writer->flush();
+	}
+}
+
+} // namespace react
@@ -0,0 +1,171 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#include "react/file_writer.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace react {
+
+#ifdef HAVE_IO_URING
+std::unique_ptr<file_writer_t> create_io_uring_file_writer(size_t buffer_size);
+#endif
+
+/*!
+ * \brief Writer that flushes single buffer with blocking pwrite()
+ */
+class posix_file_writer_t : public file_writer_t {
+public:
+	posix_file_writer_t(size_t buffer_size): buffer_size(buffer_size), fd(-1), offset(0) {
+		buffer.reserve(buffer_size);
+	}
+
+	~posix_file_writer_t() {
+		try {
+			close();
+		} catch (std::exception &e) {
+			std::cerr << e.what() << std::endl;
+		}
+	}
+
+	backend_t get_backend() const {
+		return POSIX_BACKEND;
+	}
+
+	void open(const std::string &file_name) {
+		close();
+
+		fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+		if (fd < 0) {
+			throw std::runtime_error("Can't open react output file " + file_name + ": " + strerror(errno));
+		}
+		offset = 0;
+	}
+
+	void append(const char *data, size_t size) {
+		if (buffer.size() + size > buffer_size) {
+			flush();
+		}
+
+		if (size >= buffer_size) {
+			write_all(data, size);
+			return;
+		}
+
+		buffer.insert(buffer.end(), data, data + size);
+	}
+
+	void flush() {
+		if (buffer.empty()) {
+			return;
+		}
+
+		write_all(buffer.data(), buffer.size());
+		buffer.clear();
+	}
+
+	void sync() {
+		flush();
+		if (fd >= 0 && fdatasync(fd) != 0) {
+			throw std::runtime_error(std::string("Can't sync react output file: ") + strerror(errno));
+		}
+	}
+
+	void close() {
+		if (fd < 0) {
+			return;
+		}
+
+		try {
+			flush();
+		} catch (...) {
+			::close(fd);
+			fd = -1;
+			buffer.clear();
+			throw;
+		}
+		::close(fd);
+		fd = -1;
+	}
+
+	size_t get_in_flight_bytes() const {
+		return 0;
+	}
+
+private:
+	void write_all(const char *data, size_t size) {
+		while (size > 0) {
+			ssize_t written = pwrite(fd, data, size, offset);
+			if (written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw std::runtime_error(std::string("Can't write react output file: ") + strerror(errno));
+			}
+			data += written;
+			size -= written;
+			offset += written;
+		}
+	}
+
+	const size_t buffer_size;
+	std::vector<char> buffer;
+	int fd;
+	off_t offset;
+};
+
+std::unique_ptr<file_writer_t> file_writer_t::create(backend_t backend, size_t buffer_size)
+{
+	if (buffer_size == 0) {
+		throw std::invalid_argument("Can't create file writer: buffer size is zero");
+	}
+
+#ifdef HAVE_IO_URING
+	if (backend == IO_URING_BACKEND) {
+		try {
+			return create_io_uring_file_writer(buffer_size);
+		} catch (std::exception &) {
+			// io_uring is not permitted or not supported by running kernel, fall back to pwrite()
+		}
+	}
+#else
+	(void) backend;
+#endif
+
+	return std::unique_ptr<file_writer_t>(new posix_file_writer_t(buffer_size));
+}
+
+bool file_writer_t::is_io_uring_available()
+{
+#ifdef HAVE_IO_URING
+	try {
+		create_io_uring_file_writer(1);
+		return true;
+	} catch (std::exception &) {
+		return false;
+	}
+#else
+	return false;
+#endif
+}
+
+} // namespace react
@@ -14,12 +14,33 @@
  */
 
 #include "react/global_profiler.hpp"
+#include "react/folded_stack_aggregator.hpp"
 
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include <sstream>
 
 namespace react {
 
-global_profiler_t global_profiler_t::m_profiler("log.react");
+global_profiler_t global_profiler_t::m_profiler(global_profiler_t::read_environment(global_profiler_t::options_t()));
+
+/*!
+ * \brief Set by dump signal handler, polled by profiler thread.
+ */
+static volatile std::sig_atomic_t dump_signal_received = 0;
+
+/*!
+ * \brief Period of dump signal polling.
+ */
+static const std::chrono::milliseconds SIGNAL_POLL_INTERVAL(100);
+
+static void dump_signal_handler(int)
+{
+	dump_signal_received = 1;
+}
 
 std::string get_thread_id() {
 	std::ostringstream ss;
@@ -28,43 +49,353 @@ std::string get_thread_id() {
 	return id_str;
 }
 
-global_profiler_t::global_profiler_t(const std::string &file_name)
+global_profiler_t::global_profiler_t(const options_t &options)
 	: m_call_tree(m_actions_set)
+	, m_path_recorder(m_actions_set)
+	, m_merge_paths(options.merge_paths)
+	, m_per_cpu_recorder(m_actions_set)
+	, m_per_cpu(options.per_cpu)
+	, m_lock_free(false)
 	, m_aggregator(m_output)
-	, m_output(file_name)
-	, m_name(file_name)
-	, m_refresh_interval(1000)
-	, m_active(CONTINUOUS_REACT_OUTPUT)
+	, m_options(options)
+	, m_active(false)
+	, m_dump_requested(false)
+	, m_signal_installed(false)
+	, m_signal_number(0)
+	, m_dumps_count(0)
+	, m_compaction_period(60)
+	, m_deltas_count(0)
 {
-	if (CONTINUOUS_REACT_OUTPUT) {
-		m_profile_thread = std::thread(&global_profiler_t::profile_loop, this);
+	if (m_options.refresh_interval <= 0) {
+		m_options.refresh_interval = options_t().refresh_interval;
+	}
+
+	if (m_options.lock_free) {
+		m_lock_free_tree.reset(new react::lock_free_call_tree_t(m_actions_set));
+		m_lock_free.store(true, std::memory_order_release);
+	}
+
+	if (m_options.continuous) {
+		std::lock_guard<std::mutex> guard(m_mutex);
+		start_thread();
 	}
 }
 
 global_profiler_t::~global_profiler_t()
 {
-	if (CONTINUOUS_REACT_OUTPUT) {
-		m_active = false;
-		m_profile_thread.join();
+	stop_thread();
+	write_call_tree(m_options);
+}
+
+void global_profiler_t::configure(const options_t &options)
+{
+	if (options.refresh_interval <= 0) {
+		throw std::invalid_argument("Can't configure global profiler: refresh interval must be positive");
+	}
+
+	// Dump requests can't restart the thread with old options while it is stopped
+	std::lock_guard<std::mutex> thread_guard(m_thread_mutex);
+	stop_thread();
+
+	std::lock_guard<std::mutex> guard(m_mutex);
+	m_options = options;
+	m_merge_paths = options.merge_paths;
+	m_per_cpu = options.per_cpu;
+	if (options.lock_free && !m_lock_free_tree) {
+		m_lock_free_tree.reset(new react::lock_free_call_tree_t(m_actions_set));
+	}
+	m_lock_free.store(options.lock_free, std::memory_order_release);
+	if (m_options.continuous || m_signal_installed) {
+		start_thread();
+	}
+}
+
+global_profiler_t::options_t global_profiler_t::get_options() const
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+	return m_options;
+}
+
+global_profiler_t::options_t global_profiler_t::read_environment(const options_t &options)
+{
+	options_t result = options;
+
+	if (const char *output = getenv("REACT_OUTPUT")) {
+		if (*output) {
+			result.output_path = output;
+		} else {
+			std::cerr << "react: ignoring empty REACT_OUTPUT" << std::endl;
+		}
+	}
+
+	if (const char *interval = getenv("REACT_INTERVAL")) {
+		char *end = NULL;
+		long value = strtol(interval, &end, 10);
+		if (end != interval && *end == '\0' && value > 0 && value <= INT_MAX) {
+			result.refresh_interval = value;
+		} else {
+			std::cerr << "react: ignoring invalid REACT_INTERVAL: " << interval << std::endl;
+		}
+	}
+
+	if (const char *continuous = getenv("REACT_CONTINUOUS")) {
+		std::string value = continuous;
+		if (value == "1" || value == "true" || value == "on") {
+			result.continuous = true;
+		} else if (value == "0" || value == "false" || value == "off") {
+			result.continuous = false;
+		} else {
+			std::cerr << "react: ignoring invalid REACT_CONTINUOUS: " << value << std::endl;
+		}
+	}
+
+	if (const char *format = getenv("REACT_FORMAT")) {
+		std::string value = format;
+		if (value == "json") {
+			result.format = JSON_OUTPUT;
+		} else if (value == "folded") {
+			result.format = FOLDED_OUTPUT;
+		} else if (value == "all") {
+			result.format = ALL_OUTPUT;
+		} else {
+			std::cerr << "react: ignoring invalid REACT_FORMAT: " << value << std::endl;
+		}
+	}
+
+	if (const char *merge = getenv("REACT_MERGE")) {
+		std::string value = merge;
+		if (value == "1" || value == "true" || value == "on") {
+			result.merge_paths = true;
+		} else if (value == "0" || value == "false" || value == "off") {
+			result.merge_paths = false;
+		} else {
+			std::cerr << "react: ignoring invalid REACT_MERGE: " << value << std::endl;
+		}
+	}
+
+	if (const char *lock_free = getenv("REACT_LOCK_FREE")) {
+		std::string value = lock_free;
+		if (value == "1" || value == "true" || value == "on") {
+			result.lock_free = true;
+		} else if (value == "0" || value == "false" || value == "off") {
+			result.lock_free = false;
+		} else {
+			std::cerr << "react: ignoring invalid REACT_LOCK_FREE: " << value << std::endl;
+		}
+	}
+
+	if (const char *per_cpu = getenv("REACT_PER_CPU")) {
+		std::string value = per_cpu;
+		if (value == "1" || value == "true" || value == "on") {
+			result.per_cpu = true;
+		} else if (value == "0" || value == "false" || value == "off") {
+			result.per_cpu = false;
+		} else {
+			std::cerr << "react: ignoring invalid REACT_PER_CPU: " << value << std::endl;
+		}
+	}
+
+	return result;
+}
+
+void global_profiler_t::request_dump()
+{
+	std::lock_guard<std::mutex> thread_guard(m_thread_mutex);
+	std::lock_guard<std::mutex> guard(m_mutex);
+	m_dump_requested = true;
+	start_thread();
+	m_condition.notify_all();
+}
+
+void global_profiler_t::install_dump_signal(int signal_number)
+{
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = dump_signal_handler;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+
+	std::lock_guard<std::mutex> thread_guard(m_thread_mutex);
+	std::lock_guard<std::mutex> guard(m_mutex);
+	if (m_signal_installed) {
+		restore_dump_signal();
+	}
+
+	struct sigaction previous_action;
+	if (sigaction(signal_number, &action, &previous_action) != 0) {
+		throw std::runtime_error("Can't install global profiler dump signal " +
+								 std::to_string(static_cast<long long>(signal_number)) + ": " + strerror(errno));
+	}
+
+	m_signal_installed = true;
+	m_signal_number = signal_number;
+	m_previous_signal_action = previous_action;
+	start_thread();
+	m_condition.notify_all();
+}
+
+void global_profiler_t::uninstall_dump_signal()
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+	if (m_signal_installed) {
+		restore_dump_signal();
+		m_condition.notify_all();
+	}
+}
+
+void global_profiler_t::restore_dump_signal()
+{
+	if (sigaction(m_signal_number, &m_previous_signal_action, NULL) != 0) {
+		throw std::runtime_error("Can't restore global profiler dump signal " +
+								 std::to_string(static_cast<long long>(m_signal_number)) + ": " + strerror(errno));
 	}
+	m_signal_installed = false;
+}
+
+size_t global_profiler_t::get_dumps_count() const
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+	return m_dumps_count;
+}
 
-	write_call_tree();
+void global_profiler_t::start_thread()
+{
+	if (m_active) {
+		return;
+	}
+
+	if (m_options.continuous && !m_options.merge_paths && !m_options.lock_free) {
+		try {
+			m_delta_log.reset(new react::call_tree_log_t(m_options.output_path + ".delta", m_actions_set));
+		} catch (std::exception &e) {
+			std::cerr << "react: continuous output is disabled: " << e.what() << std::endl;
+		}
+		m_deltas_count = 0;
+	}
+	m_active = true;
+	m_profile_thread = std::thread(&global_profiler_t::profile_loop, this);
+}
+
+void global_profiler_t::stop_thread()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (!m_active) {
+			return;
+		}
+		m_active = false;
+		m_condition.notify_all();
+	}
+	m_profile_thread.join();
+	m_delta_log.reset();
 }
 
 void global_profiler_t::profile_loop()
 {
+	typedef std::chrono::steady_clock clock_t;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	clock_t::time_point next_output = clock_t::now() + std::chrono::milliseconds(m_options.refresh_interval);
+
 	while (m_active) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(m_refresh_interval));
-		write_call_tree();
+		if (!m_dump_requested && !dump_signal_received) {
+			if (m_signal_installed) {
+				clock_t::time_point wake_time = clock_t::now() + SIGNAL_POLL_INTERVAL;
+				m_condition.wait_until(lock, m_options.continuous ? std::min(wake_time, next_output) : wake_time);
+			} else if (m_options.continuous) {
+				m_condition.wait_until(lock, next_output);
+			} else {
+				m_condition.wait(lock);
+			}
+		}
+
+		if (!m_active) {
+			break;
+		}
+
+		bool is_dumping = m_dump_requested || dump_signal_received;
+		m_dump_requested = false;
+		dump_signal_received = 0;
+
+		bool is_writing_delta = m_options.continuous && clock_t::now() >= next_output;
+		if (is_writing_delta) {
+			next_output = clock_t::now() + std::chrono::milliseconds(m_options.refresh_interval);
+		}
+
+		options_t options = m_options;
+		lock.unlock();
+		try {
+			if (is_dumping) {
+				write_call_tree(options);
+			}
+			if (is_writing_delta && (options.merge_paths || options.lock_free)) {
+				write_call_tree(options);
+			} else if (is_writing_delta) {
+				write_call_tree_delta();
+			}
+		} catch (std::exception &e) {
+			std::cerr << "react: can't write global profiler output: " << e.what() << std::endl;
+		}
+		lock.lock();
+
+		if (is_dumping) {
+			++m_dumps_count;
+		}
 	}
 }
 
-void global_profiler_t::write_call_tree()
+void global_profiler_t::write_call_tree(const options_t &options)
 {
-	react::call_tree_t output_tree = m_call_tree.copy_call_tree();
-	m_output.close();
-	m_output.open(m_name, std::ios_base::out | std::ios_base::trunc);
-	m_aggregator.aggregate(output_tree);
+	if (options.merge_paths) {
+		write_path_tree(options);
+		return;
+	}
+
+	react::call_tree_t output_tree = copy_call_tree();
+
+	if (options.format & JSON_OUTPUT) {
+		m_output.close();
+		m_output.open(options.output_path, std::ios_base::out | std::ios_base::trunc);
+		m_aggregator.aggregate(output_tree);
+		m_output.flush();
+	}
+
+	if (options.format & FOLDED_OUTPUT) {
+		react::folded_stack_aggregator_t folded_aggregator(m_actions_set);
+		folded_aggregator.aggregate(output_tree);
+		std::ofstream folded_output(options.output_path + ".folded", std::ios_base::out | std::ios_base::trunc);
+		folded_aggregator.dump(folded_output);
+	}
+}
+
+void global_profiler_t::write_path_tree(const options_t &options)
+{
+	react::path_tree_t path_tree = copy_path_tree();
+
+	if (options.format & JSON_OUTPUT) {
+		m_output.close();
+		m_output.open(options.output_path, std::ios_base::out | std::ios_base::trunc);
+		m_output << print_json_to_string(path_tree) << std::endl;
+	}
+
+	if (options.format & FOLDED_OUTPUT) {
+		react::folded_stack_aggregator_t folded_aggregator(m_actions_set);
+		folded_aggregator.aggregate_paths(path_tree);
+		std::ofstream folded_output(options.output_path + ".folded", std::ios_base::out | std::ios_base::trunc);
+		folded_aggregator.dump(folded_output);
+	}
+}
+
+void global_profiler_t::write_call_tree_delta()
+{
+	if (!m_delta_log) {
+		return;
+	}
+
+	if (m_deltas_count++ % m_compaction_period == 0) {
+		m_delta_log->compact(m_call_tree.take_snapshot());
+	} else {
+		m_delta_log->append(m_call_tree.take_changes());
+	}
 }
 
 
@@ -74,6 +405,41 @@ react::call_tree_updater_t* global_profiler_t::get_updater()
 	return &updater;
 }
 
+react::path_cursor_t* global_profiler_t::get_path_cursor()
+{
+	static thread_local react::path_cursor_t cursor(get_profiler().m_path_recorder);
+	return &cursor;
+}
+
+react::per_cpu_cursor_t* global_profiler_t::get_per_cpu_cursor()
+{
+	static thread_local react::per_cpu_cursor_t cursor(get_profiler().m_per_cpu_recorder);
+	return &cursor;
+}
+
+react::lock_free_updater_t* global_profiler_t::get_lock_free_updater()
+{
+	static thread_local react::lock_free_updater_t updater(*get_profiler().m_lock_free_tree);
+	return &updater;
+}
+
+react::call_tree_t global_profiler_t::copy_call_tree() const
+{
+	if (is_lock_free()) {
+		react::call_tree_t call_tree(m_actions_set);
+		m_lock_free_tree->copy_to(call_tree);
+		return call_tree;
+	}
+	return m_call_tree.copy_call_tree();
+}
+
+react::path_tree_t global_profiler_t::copy_path_tree() const
+{
+	react::path_tree_t path_tree = m_path_recorder.get_path_tree();
+	path_tree.merge(m_per_cpu_recorder.get_path_tree());
+	return path_tree;
+}
+
 react::actions_set_t& global_profiler_t::get_action_set() {
 	return m_actions_set;
 }
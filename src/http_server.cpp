@@ -0,0 +1,363 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#include "react/http_server.hpp"
+#include "react/global_profiler.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace react {
+
+static std::string error_string(const std::string &message, int err) {
+	return message + ": " + strerror(err);
+}
+
+/*!
+ * \brief State of single client connection
+ */
+struct http_server_t::connection_t {
+	connection_t(int fd): fd(fd), written(0), is_responding(false) {}
+
+	int fd;
+	std::string input;
+	std::string output;
+	size_t written;
+	bool is_responding;
+};
+
+http_server_t::http_server_t(const options_t &options)
+	: options(options)
+	, listen_fd(-1)
+	, epoll_fd(-1)
+	, event_fd(-1)
+	, port(0)
+{
+	try {
+		listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (listen_fd < 0) {
+			throw std::runtime_error(error_string("Can't create http server socket", errno));
+		}
+
+		int reuse = 1;
+		setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(options.port);
+		if (inet_pton(AF_INET, options.address.c_str(), &address.sin_addr) != 1) {
+			throw std::invalid_argument("Can't create http server: invalid address " + options.address);
+		}
+
+		if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+			throw std::runtime_error(error_string("Can't bind http server to " + options.address, errno));
+		}
+		if (listen(listen_fd, options.backlog) != 0) {
+			throw std::runtime_error(error_string("Can't listen http server socket", errno));
+		}
+
+		socklen_t address_size = sizeof(address);
+		getsockname(listen_fd, reinterpret_cast<sockaddr *>(&address), &address_size);
+		port = ntohs(address.sin_port);
+
+		event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (event_fd < 0) {
+			throw std::runtime_error(error_string("Can't create http server eventfd", errno));
+		}
+
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0) {
+			throw std::runtime_error(error_string("Can't create http server epoll", errno));
+		}
+
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.fd = listen_fd;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) != 0) {
+			throw std::runtime_error(error_string("Can't add http server socket to epoll", errno));
+		}
+		event.data.fd = event_fd;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event) != 0) {
+			throw std::runtime_error(error_string("Can't add http server eventfd to epoll", errno));
+		}
+
+		server_thread = std::thread(&http_server_t::serve_loop, this);
+	} catch (...) {
+		if (epoll_fd >= 0) close(epoll_fd);
+		if (event_fd >= 0) close(event_fd);
+		if (listen_fd >= 0) close(listen_fd);
+		throw;
+	}
+}
+
+http_server_t::~http_server_t()
+{
+	uint64_t value = 1;
+	if (write(event_fd, &value, sizeof(value)) != sizeof(value)) {
+		std::cerr << error_string("Can't wake http server up", errno) << std::endl;
+	}
+	server_thread.join();
+
+	for (auto it = connections.begin(); it != connections.end(); ++it) {
+		close(it->first);
+	}
+	close(epoll_fd);
+	close(event_fd);
+	close(listen_fd);
+}
+
+int http_server_t::get_port() const
+{
+	return port;
+}
+
+void http_server_t::add_route(const std::string &path, handler_t handler)
+{
+	std::lock_guard<std::mutex> guard(routes_mutex);
+	routes[path] = handler;
+}
+
+void http_server_t::serve_global_profiler(const std::string &path)
+{
+	add_route(path, []() {
+		global_profiler_t &profiler = global_profiler_t::get_profiler();
+		if (profiler.is_merging_paths()) {
+			return print_json_to_string(profiler.copy_path_tree());
+		}
+		return print_json_to_string(profiler.copy_call_tree());
+	});
+}
+
+void http_server_t::serve_recent_trees(std::shared_ptr<recent_trees_aggregator_t> aggregator,
+									   const std::string &path)
+{
+	add_route(path, [aggregator]() {
+		std::vector<call_tree_handle_t> trees = aggregator->get_trees();
+
+		rapidjson::StringBuffer buffer;
+		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+		writer.StartObject();
+		writer.String("call_tree").StartObject();
+		writer.String("react_aggregator").StartArray();
+		for (auto it = trees.begin(); it != trees.end(); ++it) {
+			(*it)->write_json(writer);
+		}
+		writer.EndArray();
+		writer.EndObject();
+		writer.EndObject();
+		return std::string(buffer.GetString(), buffer.Size());
+	});
+}
+
+void http_server_t::serve_path_statistics(std::shared_ptr<path_aggregator_t> aggregator,
+										  const std::string &path)
+{
+	add_route(path, [aggregator]() {
+		return print_json_to_string(*aggregator);
+	});
+}
+
+void http_server_t::serve_loop()
+{
+	static const int MAX_EVENTS = 64;
+	epoll_event events[MAX_EVENTS];
+
+	for (;;) {
+		int events_count = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+		if (events_count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			std::cerr << error_string("http server epoll_wait failed", errno) << std::endl;
+			return;
+		}
+
+		for (int i = 0; i < events_count; ++i) {
+			int fd = events[i].data.fd;
+			if (fd == event_fd) {
+				return;
+			}
+
+			if (fd == listen_fd) {
+				accept_connections();
+				continue;
+			}
+
+			auto it = connections.find(fd);
+			if (it == connections.end()) {
+				continue;
+			}
+
+			connection_t &connection = *it->second;
+			if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+				close_connection(fd);
+				continue;
+			}
+
+			if (!connection.is_responding && !handle_input(connection)) {
+				close_connection(fd);
+				continue;
+			}
+			if (connection.is_responding && !handle_output(connection)) {
+				close_connection(fd);
+			}
+		}
+	}
+}
+
+void http_server_t::accept_connections()
+{
+	for (;;) {
+		int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				std::cerr << error_string("http server accept failed", errno) << std::endl;
+			}
+			return;
+		}
+
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN | EPOLLRDHUP;
+		event.data.fd = fd;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+			close(fd);
+			continue;
+		}
+		connections[fd].reset(new connection_t(fd));
+	}
+}
+
+bool http_server_t::handle_input(connection_t &connection)
+{
+	char buffer[4096];
+	bool is_peer_closed = false;
+	for (;;) {
+		ssize_t size = read(connection.fd, buffer, sizeof(buffer));
+		if (size < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			return false;
+		}
+		if (size == 0) {
+			is_peer_closed = true;
+			break;
+		}
+		connection.input.append(buffer, size);
+		if (connection.input.size() > options.max_request_size) {
+			break;
+		}
+	}
+
+	size_t headers_end = connection.input.find("\r\n\r\n");
+	bool is_too_large = connection.input.size() > options.max_request_size ||
+			(headers_end != std::string::npos && headers_end > options.max_request_size);
+	if (headers_end == std::string::npos && !is_too_large) {
+		// Level-triggered epoll keeps reporting closed peer, so incomplete request is dropped
+		return !is_peer_closed;
+	}
+
+	connection.is_responding = true;
+	connection.output = build_response(is_too_large ? std::string() : connection.input.substr(0, headers_end));
+
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLOUT;
+	event.data.fd = connection.fd;
+	return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection.fd, &event) == 0;
+}
+
+bool http_server_t::handle_output(connection_t &connection)
+{
+	while (connection.written < connection.output.size()) {
+		ssize_t size = send(connection.fd, connection.output.data() + connection.written,
+							connection.output.size() - connection.written, MSG_NOSIGNAL);
+		if (size < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		connection.written += size;
+	}
+	return false;
+}
+
+static std::string make_response(const std::string &status, const std::string &content_type,
+								 const std::string &body)
+{
+	return "HTTP/1.1 " + status + "\r\n"
+			"Content-Type: " + content_type + "\r\n"
+			"Content-Length: " + std::to_string(static_cast<unsigned long long>(body.size())) + "\r\n"
+			"Connection: close\r\n"
+			"\r\n" + body;
+}
+
+std::string http_server_t::build_response(const std::string &request)
+{
+	size_t method_end = request.find(' ');
+	size_t path_end = method_end == std::string::npos ? std::string::npos : request.find(' ', method_end + 1);
+	if (path_end == std::string::npos) {
+		return make_response("400 Bad Request", "text/plain", "Bad request\n");
+	}
+
+	if (request.compare(0, method_end, "GET") != 0) {
+		return make_response("405 Method Not Allowed", "text/plain", "Only GET is supported\n");
+	}
+
+	std::string path = request.substr(method_end + 1, path_end - method_end - 1);
+	path = path.substr(0, path.find('?'));
+
+	handler_t handler;
+	{
+		std::lock_guard<std::mutex> guard(routes_mutex);
+		auto it = routes.find(path);
+		if (it == routes.end()) {
+			return make_response("404 Not Found", "text/plain", "Not found\n");
+		}
+		handler = it->second;
+	}
+
+	try {
+		return make_response("200 OK", "application/json", handler());
+	} catch (std::exception &e) {
+		return make_response("500 Internal Server Error", "text/plain", std::string(e.what()) + "\n");
+	}
+}
+
+void http_server_t::close_connection(int fd)
+{
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	close(fd);
+	connections.erase(fd);
+}
+
+} // namespace react
@@ -0,0 +1,445 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifdef HAVE_IO_URING
+
+#include "react/file_writer.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+namespace react {
+
+static std::string error_string(const std::string &message, int err) {
+	return message + ": " + strerror(err);
+}
+
+/*!
+ * \brief Writer that submits filled registered buffers to io_uring
+ *
+ *  Aggregation thread only copies data into buffer and puts write request into submission ring,
+ *  it waits for kernel only when all buffers are in flight.
+ */
+class io_uring_file_writer_t : public file_writer_t {
+public:
+	io_uring_file_writer_t(size_t buffer_size);
+	~io_uring_file_writer_t();
+
+	backend_t get_backend() const {
+		return IO_URING_BACKEND;
+	}
+
+	void open(const std::string &file_name);
+	void append(const char *data, size_t size);
+	void flush();
+	void sync();
+	void close();
+
+	size_t get_in_flight_bytes() const {
+		return in_flight_bytes.load(std::memory_order_relaxed);
+	}
+
+private:
+	/*!
+	 * \brief Number of registered buffers
+	 */
+	static const unsigned BUFFERS_COUNT = 4;
+
+	/*!
+	 * \brief State of single registered buffer
+	 */
+	struct buffer_t {
+		buffer_t(): data(NULL), size(0), written(0), offset(0) {}
+
+		char *data;
+		/*!
+		 * \brief Number of bytes filled
+		 */
+		size_t size;
+		/*!
+		 * \brief Number of bytes already written by kernel
+		 */
+		size_t written;
+		/*!
+		 * \brief File offset of buffer beginning
+		 */
+		off_t offset;
+	};
+
+	void setup_ring();
+	void release_ring();
+	void submit_buffer(unsigned index);
+	void queue_write(unsigned index);
+	void enter(unsigned to_submit, unsigned min_complete);
+	void reap_completions();
+	void wait_for_free_buffer();
+	void wait_for_all();
+
+	const size_t buffer_size;
+	int ring_fd;
+	int fd;
+	off_t offset;
+
+	std::vector<buffer_t> buffers;
+	std::vector<unsigned> free_buffers;
+	/*!
+	 * \brief Buffer currently filled or BUFFERS_COUNT if there is none
+	 */
+	unsigned current_buffer;
+	unsigned pending_submissions;
+	unsigned in_flight_requests;
+	std::atomic<size_t> in_flight_bytes;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	io_uring_cqe *cqes;
+};
+
+io_uring_file_writer_t::io_uring_file_writer_t(size_t buffer_size)
+	: buffer_size(buffer_size)
+	, ring_fd(-1)
+	, fd(-1)
+	, offset(0)
+	, buffers(BUFFERS_COUNT)
+	, current_buffer(BUFFERS_COUNT)
+	, pending_submissions(0)
+	, in_flight_requests(0)
+	, in_flight_bytes(0)
+	, sq_ring(MAP_FAILED)
+	, sq_ring_size(0)
+	, cq_ring(MAP_FAILED)
+	, cq_ring_size(0)
+	, sqes(static_cast<io_uring_sqe *>(MAP_FAILED))
+	, sqes_size(0)
+{
+	try {
+		setup_ring();
+	} catch (...) {
+		release_ring();
+		throw;
+	}
+}
+
+io_uring_file_writer_t::~io_uring_file_writer_t()
+{
+	try {
+		close();
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+	}
+	release_ring();
+}
+
+void io_uring_file_writer_t::setup_ring()
+{
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	ring_fd = syscall(__NR_io_uring_setup, BUFFERS_COUNT, &params);
+	if (ring_fd < 0) {
+		throw std::runtime_error(error_string("Can't setup io_uring", errno));
+	}
+
+	sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		sq_ring_size = std::max(sq_ring_size, cq_ring_size);
+	}
+
+	sq_ring = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				   ring_fd, IORING_OFF_SQ_RING);
+	if (sq_ring == MAP_FAILED) {
+		throw std::runtime_error(error_string("Can't map io_uring submission ring", errno));
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		cq_ring = sq_ring;
+	} else {
+		cq_ring = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					   ring_fd, IORING_OFF_CQ_RING);
+		if (cq_ring == MAP_FAILED) {
+			throw std::runtime_error(error_string("Can't map io_uring completion ring", errno));
+		}
+	}
+
+	sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	sqes = static_cast<io_uring_sqe *>(mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+											ring_fd, IORING_OFF_SQES));
+	if (sqes == MAP_FAILED) {
+		throw std::runtime_error(error_string("Can't map io_uring submission entries", errno));
+	}
+
+	char *sq = static_cast<char *>(sq_ring);
+	sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+	sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+	sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+	sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+	char *cq = static_cast<char *>(cq_ring);
+	cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+	cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+	cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+	std::vector<iovec> iovecs(BUFFERS_COUNT);
+	for (unsigned i = 0; i < BUFFERS_COUNT; ++i) {
+		void *data = NULL;
+		int err = posix_memalign(&data, sysconf(_SC_PAGESIZE), buffer_size);
+		if (err != 0) {
+			throw std::runtime_error(error_string("Can't allocate io_uring buffer", err));
+		}
+		buffers[i].data = static_cast<char *>(data);
+		iovecs[i].iov_base = data;
+		iovecs[i].iov_len = buffer_size;
+		free_buffers.push_back(BUFFERS_COUNT - 1 - i);
+	}
+
+	if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, iovecs.data(), BUFFERS_COUNT) < 0) {
+		throw std::runtime_error(error_string("Can't register io_uring buffers", errno));
+	}
+}
+
+void io_uring_file_writer_t::release_ring()
+{
+	if (sqes != MAP_FAILED) {
+		munmap(sqes, sqes_size);
+	}
+	if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+		munmap(cq_ring, cq_ring_size);
+	}
+	if (sq_ring != MAP_FAILED) {
+		munmap(sq_ring, sq_ring_size);
+	}
+	if (ring_fd >= 0) {
+		::close(ring_fd);
+		ring_fd = -1;
+	}
+	for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+		free(it->data);
+		it->data = NULL;
+	}
+}
+
+void io_uring_file_writer_t::open(const std::string &file_name)
+{
+	close();
+
+	fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		throw std::runtime_error(error_string("Can't open react output file " + file_name, errno));
+	}
+	offset = 0;
+}
+
+void io_uring_file_writer_t::append(const char *data, size_t size)
+{
+	reap_completions();
+
+	while (size > 0) {
+		if (current_buffer == BUFFERS_COUNT) {
+			wait_for_free_buffer();
+			current_buffer = free_buffers.back();
+			free_buffers.pop_back();
+			buffers[current_buffer].size = 0;
+			buffers[current_buffer].written = 0;
+			buffers[current_buffer].offset = offset;
+		}
+
+		buffer_t &buffer = buffers[current_buffer];
+		size_t chunk_size = std::min(size, buffer_size - buffer.size);
+		memcpy(buffer.data + buffer.size, data, chunk_size);
+		buffer.size += chunk_size;
+		offset += chunk_size;
+		data += chunk_size;
+		size -= chunk_size;
+
+		if (buffer.size == buffer_size) {
+			submit_buffer(current_buffer);
+			current_buffer = BUFFERS_COUNT;
+		}
+	}
+}
+
+void io_uring_file_writer_t::flush()
+{
+	if (current_buffer != BUFFERS_COUNT && buffers[current_buffer].size != 0) {
+		submit_buffer(current_buffer);
+		current_buffer = BUFFERS_COUNT;
+	}
+	reap_completions();
+}
+
+void io_uring_file_writer_t::sync()
+{
+	flush();
+	wait_for_all();
+	if (fd >= 0 && fdatasync(fd) != 0) {
+		throw std::runtime_error(error_string("Can't sync react output file", errno));
+	}
+}
+
+void io_uring_file_writer_t::close()
+{
+	if (fd < 0) {
+		return;
+	}
+
+	try {
+		flush();
+		wait_for_all();
+	} catch (...) {
+		::close(fd);
+		fd = -1;
+		throw;
+	}
+	::close(fd);
+	fd = -1;
+}
+
+void io_uring_file_writer_t::submit_buffer(unsigned index)
+{
+	in_flight_bytes += buffers[index].size;
+	queue_write(index);
+	enter(pending_submissions, 0);
+}
+
+void io_uring_file_writer_t::queue_write(unsigned index)
+{
+	buffer_t &buffer = buffers[index];
+
+	unsigned tail = *sq_tail;
+	unsigned sq_index = tail & *sq_mask;
+	io_uring_sqe *sqe = &sqes[sq_index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_WRITE_FIXED;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<uint64_t>(buffer.data + buffer.written);
+	sqe->len = buffer.size - buffer.written;
+	sqe->off = buffer.offset + buffer.written;
+	sqe->buf_index = index;
+	sqe->user_data = index;
+
+	sq_array[sq_index] = sq_index;
+	__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+	++pending_submissions;
+	++in_flight_requests;
+}
+
+void io_uring_file_writer_t::enter(unsigned to_submit, unsigned min_complete)
+{
+	unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+	for (;;) {
+		int submitted = syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+		if (submitted >= 0) {
+			pending_submissions -= std::min<unsigned>(submitted, pending_submissions);
+			return;
+		}
+		if (errno != EINTR) {
+			throw std::runtime_error(error_string("Can't submit io_uring writes", errno));
+		}
+	}
+}
+
+void io_uring_file_writer_t::reap_completions()
+{
+	unsigned head = *cq_head;
+	unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+	std::string error;
+
+	for (; head != tail; ++head) {
+		io_uring_cqe *cqe = &cqes[head & *cq_mask];
+		unsigned index = static_cast<unsigned>(cqe->user_data);
+		buffer_t &buffer = buffers[index];
+		--in_flight_requests;
+
+		if (cqe->res < 0) {
+			error = error_string("Can't write react output file", -cqe->res);
+			in_flight_bytes -= buffer.size - buffer.written;
+			free_buffers.push_back(index);
+			continue;
+		}
+
+		buffer.written += cqe->res;
+		in_flight_bytes -= cqe->res;
+		if (buffer.written < buffer.size && cqe->res > 0) {
+			// Short write, resubmit the rest of the buffer
+			queue_write(index);
+		} else {
+			if (buffer.written < buffer.size) {
+				error = "Can't write react output file: no progress";
+				in_flight_bytes -= buffer.size - buffer.written;
+			}
+			free_buffers.push_back(index);
+		}
+	}
+	__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+	if (pending_submissions > 0) {
+		enter(pending_submissions, 0);
+	}
+
+	if (!error.empty()) {
+		throw std::runtime_error(error);
+	}
+}
+
+void io_uring_file_writer_t::wait_for_free_buffer()
+{
+	while (free_buffers.empty()) {
+		enter(pending_submissions, 1);
+		reap_completions();
+	}
+}
+
+void io_uring_file_writer_t::wait_for_all()
+{
+	while (in_flight_requests > 0) {
+		enter(pending_submissions, 1);
+		reap_completions();
+	}
+}
+
+std::unique_ptr<file_writer_t> create_io_uring_file_writer(size_t buffer_size)
+{
+	return std::unique_ptr<file_writer_t>(new io_uring_file_writer_t(buffer_size));
+}
+
+} // namespace react
+
+#endif // HAVE_IO_URING
@@ -16,12 +16,17 @@
 #define REACT_CPP
 
 #include "react/react.hpp"
+#include "react/flight_recorder.hpp"
 #include "react/utils.hpp"
 
+#include <atomic>
 #include <stdexcept>
 #include <iostream>
 #include <mutex>
 
+#include <unistd.h>
+#include <sys/syscall.h>
+
 using namespace react;
 
 actions_set_t &actions_set() {
@@ -38,20 +43,111 @@ int react_define_new_action(const char *action_name) {
 	}
 }
 
+/*!
+ * \brief Lock-free inbox of subtrees recorded by subthreads and workers with handed off context
+ *          and of stop times of async spans, applied by the context owner
+ *
+ *  Producers push entries onto Treiber stack, owner takes the whole stack at once,
+ *  so pushes never wait for owner's call tree lock.
+ */
+class react_handoff_inbox_t {
+public:
+	/*!
+	 * \brief Subtree to be grafted under \a node or, if \a call_tree is empty, stop time of span \a node
+	 */
+	struct entry_t {
+		entry_t(call_tree_t::p_node_t node, call_tree_handle_t call_tree, int64_t stop_time):
+			node(node), call_tree(std::move(call_tree)), stop_time(stop_time), next(NULL) {}
+
+		call_tree_t::p_node_t node;
+		call_tree_handle_t call_tree;
+		int64_t stop_time;
+		entry_t *next;
+	};
+
+	react_handoff_inbox_t(): head(NULL) {}
+
+	~react_handoff_inbox_t() {
+		delete_entries(head.load(std::memory_order_acquire));
+	}
+
+	void push_tree(call_tree_t::p_node_t node, call_tree_handle_t call_tree) {
+		push(new entry_t(node, std::move(call_tree), 0));
+	}
+
+	void push_stop_time(call_tree_t::p_node_t node, int64_t stop_time) {
+		push(new entry_t(node, call_tree_handle_t(), stop_time));
+	}
+
+	/*!
+	 * \brief Takes all entries in order they were pushed, caller frees them with delete_entries()
+	 */
+	entry_t *take_all() {
+		entry_t *entries = head.exchange(NULL, std::memory_order_acquire);
+		entry_t *reversed = NULL;
+		while (entries) {
+			entry_t *next = entries->next;
+			entries->next = reversed;
+			reversed = entries;
+			entries = next;
+		}
+		return reversed;
+	}
+
+	static void delete_entries(entry_t *entries) {
+		while (entries) {
+			entry_t *next = entries->next;
+			delete entries;
+			entries = next;
+		}
+	}
+
+private:
+	void push(entry_t *entry) {
+		entry_t *current_head = head.load(std::memory_order_relaxed);
+		do {
+			entry->next = current_head;
+		} while (!head.compare_exchange_weak(current_head, entry,
+					std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	std::atomic<entry_t *> head;
+};
+
 struct react_context_t {
 	react_context_t(react::aggregator_t *aggregator):
-		call_tree(actions_set()), updater(call_tree), aggregator(aggregator) {}
+		call_tree(actions_set()), updater(call_tree), aggregator(aggregator),
+		inbox(std::make_shared<react_handoff_inbox_t>()), refcount(0) {}
 
 	concurrent_call_tree_t call_tree;
 	call_tree_updater_t updater;
 	react::aggregator_t *aggregator;
+	std::shared_ptr<react_handoff_inbox_t> inbox;
+
+	/*!
+	 * \brief Activations count kept while context is suspended
+	 */
+	int refcount;
+};
+
+struct react_flight_context_t {
+	react_flight_context_t(): aggregator(NULL), threshold(0), is_flagged(false), recorder(actions_set()) {}
+
+	react::aggregator_t *aggregator;
+	int64_t threshold;
+	bool is_flagged;
+	flight_recorder_t recorder;
 };
 
 static __thread react_context_t *thread_react_context = NULL;
+static __thread react_flight_context_t *thread_flight_context = NULL;
 static __thread int thread_react_context_refcount = 0;
 
+// Flight recorder buffer is allocated once per thread and reused by all its requests
+static thread_local std::unique_ptr<react_flight_context_t> thread_flight_context_storage;
+
 int react_is_active() {
-	return thread_react_context != NULL;
+	return thread_react_context != NULL || thread_flight_context != NULL;
 }
 
 const size_t ID_LENGTH = 64;
@@ -72,6 +168,27 @@ int react_activate(void *react_aggregator) {
 			);
 			react::add_stat("complete", false);
 			react::add_stat("id", generate_random_id());
+			react::add_stat("thread_id", static_cast<int>(syscall(SYS_gettid)));
+		}
+		++thread_react_context_refcount;
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+int react_activate_flight_recorder(void *react_aggregator, long long threshold) {
+	try {
+		if (!thread_react_context_refcount) {
+			if (!thread_flight_context_storage) {
+				thread_flight_context_storage.reset(new react_flight_context_t());
+			}
+			thread_flight_context = thread_flight_context_storage.get();
+			thread_flight_context->aggregator = static_cast<react::aggregator_t*>(react_aggregator);
+			thread_flight_context->threshold = threshold;
+			thread_flight_context->is_flagged = false;
+			thread_flight_context->recorder.reset();
 		}
 		++thread_react_context_refcount;
 	} catch (std::exception &e) {
@@ -81,6 +198,61 @@ int react_activate(void *react_aggregator) {
 	return 0;
 }
 
+/*!
+ * \brief Merges subtrees handed back by workers into context call tree
+ */
+static void graft_handed_off_trees(react_context_t *context) {
+	react_handoff_inbox_t::entry_t *entries = context->inbox->take_all();
+	if (!entries) {
+		return;
+	}
+
+	std::unique_ptr<react_handoff_inbox_t::entry_t, void (*)(react_handoff_inbox_t::entry_t *)>
+			entries_guard(entries, &react_handoff_inbox_t::delete_entries);
+	std::lock_guard<concurrent_call_tree_t> guard(context->call_tree);
+	for (react_handoff_inbox_t::entry_t *entry = entries; entry; entry = entry->next) {
+		if (entry->call_tree) {
+			entry->call_tree->merge_into(entry->node, context->call_tree.get_call_tree());
+		} else {
+			context->call_tree.get_call_tree().set_node_stop_time(entry->node, entry->stop_time);
+		}
+	}
+}
+
+static void deactivate_flight_recorder() {
+	react_flight_context_t *context = thread_flight_context;
+	thread_flight_context = NULL;
+
+	if (!context->aggregator ||
+			(!context->is_flagged && context->recorder.get_elapsed_time() < context->threshold)) {
+		return;
+	}
+
+	std::shared_ptr<call_tree_t> call_tree = std::make_shared<call_tree_t>(actions_set());
+	call_tree->add_stat("complete", true);
+	call_tree->add_stat("id", generate_random_id());
+	call_tree->add_stat("thread_id", static_cast<int>(syscall(SYS_gettid)));
+	context->recorder.build_call_tree(*call_tree);
+	context->aggregator->aggregate_handle(std::move(call_tree));
+}
+
+int react_flag_request() {
+	try {
+		if (!react_is_active()) {
+			return 0;
+		}
+
+		if (thread_flight_context) {
+			thread_flight_context->is_flagged = true;
+		}
+		react::add_stat("flagged", true);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return -EINVAL;
+	}
+	return 0;
+}
+
 int react_deactivate() {
 	try {
 		if (thread_react_context_refcount == 0) {
@@ -91,10 +263,25 @@ int react_deactivate() {
 			throw std::runtime_error(error_message);
 		}
 
+		if (thread_react_context_refcount == 1 && thread_flight_context) {
+			--thread_react_context_refcount;
+			deactivate_flight_recorder();
+			return 0;
+		}
+
 		if (thread_react_context_refcount == 1) {
+			graft_handed_off_trees(thread_react_context);
 			react::add_stat("complete", true);
 			if (thread_react_context->aggregator) {
-				thread_react_context->aggregator->aggregate(thread_react_context->call_tree.get_call_tree());
+				call_tree_t &call_tree = thread_react_context->call_tree.get_call_tree();
+				if (thread_react_context->updater.get_trace_depth() == 0) {
+					// Context is being torn down, so call tree is moved to aggregator instead of copying
+					thread_react_context->aggregator->aggregate_handle(
+								std::make_shared<call_tree_t>(std::move(call_tree))
+					);
+				} else {
+					thread_react_context->aggregator->aggregate(call_tree);
+				}
 			}
 			delete thread_react_context;
 			thread_react_context = NULL;
@@ -113,6 +300,11 @@ int react_start_action(int action_code) {
 			return 0;
 		}
 
+		if (thread_flight_context) {
+			thread_flight_context->recorder.start(action_code);
+			return 0;
+		}
+
 		thread_react_context->updater.start(action_code);
 	} catch (std::exception& e) {
 		std::cerr << e.what() << std::endl;
@@ -127,6 +319,11 @@ int react_stop_action(int action_code) {
 			return 0;
 		}
 
+		if (thread_flight_context) {
+			thread_flight_context->recorder.stop(action_code);
+			return 0;
+		}
+
 		thread_react_context->updater.stop(action_code);
 	} catch (std::exception& e) {
 		std::cerr << e.what() << std::endl;
@@ -154,13 +351,85 @@ DEFINE_STAT_TYPE(int,    int)
 DEFINE_STAT_TYPE(double, double)
 DEFINE_STAT_TYPE(string, const char *)
 
+/*!
+ * \brief Detaches current context from thread, returns NULL if there is none
+ */
+static react_context_t *suspend_thread_context() {
+	if (!thread_react_context) {
+		if (thread_flight_context) {
+			throw std::runtime_error("Can't suspend context: flight recorder context can't be suspended");
+		}
+		return NULL;
+	}
+
+	react_context_t *context = thread_react_context;
+	context->refcount = thread_react_context_refcount;
+	thread_react_context = NULL;
+	thread_react_context_refcount = 0;
+	return context;
+}
+
+/*!
+ * \brief Attaches suspended \a context to current thread
+ */
+static void resume_thread_context(react_context_t *context) {
+	if (react_is_active()) {
+		throw std::logic_error("Can't resume context: React is already active in current thread");
+	}
+
+	thread_react_context = context;
+	thread_react_context_refcount = context->refcount;
+	context->refcount = 0;
+}
+
+int react_suspend_context(void **react_context) {
+	*react_context = NULL;
+	try {
+		if (!thread_react_context && thread_flight_context) {
+			return -ENOTSUP;
+		}
+
+		*react_context = suspend_thread_context();
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return -EINVAL;
+	}
+	return 0;
+}
+
+int react_resume_context(void *react_context) {
+	try {
+		if (!react_context) {
+			return 0;
+		}
+
+		resume_thread_context(static_cast<react_context_t*>(react_context));
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return -EINVAL;
+	}
+	return 0;
+}
+
+int react_discard_context(void *react_context) {
+	if (!react_context) {
+		return 0;
+	}
+
+	react_context_t *context = static_cast<react_context_t*>(react_context);
+	context->updater.discard_started_actions();
+	delete context;
+	return 0;
+}
+
 int react_submit_progress() {
 	try {
 		if (!react_is_active()) {
 			return 0;
 		}
 
-		if (thread_react_context->aggregator) {
+		if (thread_react_context && thread_react_context->aggregator) {
+			graft_handed_off_trees(thread_react_context);
 			thread_react_context->aggregator->aggregate(thread_react_context->call_tree.get_call_tree());
 		}
 	} catch (std::exception& e) {
@@ -172,20 +441,34 @@ int react_submit_progress() {
 
 namespace react {
 
-action_guard::action_guard(int action_code) {
-	if (react_is_active()) {
+action_guard::action_guard(int action_code): m_flight_action_code(actions_set_t::NO_ACTION) {
+	if (thread_flight_context) {
+		thread_flight_context->recorder.start(action_code);
+		m_flight_action_code = action_code;
+	} else if (react_is_active()) {
 		m_action_guard.reset(
 					new action_guard_t(&thread_react_context->updater, action_code)
 		);
 	}
 }
 
-action_guard::~action_guard() {}
+action_guard::~action_guard() {
+	if (m_flight_action_code != actions_set_t::NO_ACTION && thread_flight_context) {
+		thread_flight_context->recorder.stop(m_flight_action_code);
+	}
+}
 
 void react::action_guard::stop() {
 	if (m_action_guard) {
 		m_action_guard->stop();
 	}
+
+	if (m_flight_action_code != actions_set_t::NO_ACTION) {
+		if (thread_flight_context) {
+			thread_flight_context->recorder.stop(m_flight_action_code);
+		}
+		m_flight_action_code = actions_set_t::NO_ACTION;
+	}
 }
 
 const actions_set_t &get_actions_set() {
@@ -197,7 +480,9 @@ void add_stat(const std::string &key, const char *value) {
 }
 
 void add_stat_impl(const std::string &key, const react::stat_value_t &value) {
-	if (thread_react_context) {
+	if (thread_flight_context) {
+		thread_flight_context->recorder.add_stat(key, value);
+	} else if (thread_react_context) {
 		thread_react_context->call_tree.get_call_tree().add_stat(key, value);
 	}
 }
@@ -207,6 +492,7 @@ public:
 	subthread_aggregator_t(): parent_context(thread_react_context) {
 		if (parent_context) {
 			parent_node = parent_context->updater.get_current_node();
+			parent_inbox = parent_context->inbox;
 		}
 	}
 	~subthread_aggregator_t() {}
@@ -216,33 +502,225 @@ public:
 			return;
 
 		if (call_tree.get_stat<bool>("complete") == false) {
-			parent_context->aggregator->aggregate(call_tree);
+			if (parent_context->aggregator) {
+				parent_context->aggregator->aggregate(call_tree);
+			}
 		} else {
-			std::lock_guard<concurrent_call_tree_t> guard(parent_context->call_tree);
-			thread_react_context->call_tree.get_call_tree().merge_into(
-				parent_node, parent_context->call_tree.get_call_tree()
-			);
+			parent_inbox->push_tree(parent_node, std::make_shared<call_tree_t>(call_tree));
+		}
+	}
+
+	void aggregate_handle(call_tree_handle_t call_tree) {
+		if (!parent_context)
+			return;
+
+		if (call_tree->get_stat<bool>("complete") == false) {
+			if (parent_context->aggregator) {
+				parent_context->aggregator->aggregate_handle(std::move(call_tree));
+			}
+		} else {
+			parent_inbox->push_tree(parent_node, std::move(call_tree));
 		}
 	}
 
 private:
 	react_context_t *parent_context;
 	call_tree_t::p_node_t parent_node;
+
+	/*!
+	 * \brief Inbox of parent context, complete subthread trees are grafted by parent thread
+	 */
+	std::shared_ptr<react_handoff_inbox_t> parent_inbox;
 };
 
 std::shared_ptr<aggregator_t> create_subthread_aggregator() {
-	if (!react_is_active()) {
+	if (!thread_react_context) {
 		throw std::runtime_error("Can't create subthread aggregator: React is not active");
 	}
 
 	return std::make_shared<subthread_aggregator_t>();
 }
 
+class context_token_t {
+public:
+	context_token_t(): inbox(thread_react_context->inbox),
+		parent_node(thread_react_context->updater.get_current_node()),
+		capture_time(std::chrono::system_clock::now()), is_used(false), context(NULL),
+		previous_context(NULL), previous_flight_context(NULL), previous_refcount(0) {}
+
+	~context_token_t() {
+		if (context) {
+			std::cerr << "~context_token_t(): token is destroyed while attached" << std::endl;
+		}
+	}
+
+	void attach() {
+		if (is_used) {
+			throw std::logic_error("Can't attach context: token was already attached");
+		}
+
+		std::chrono::system_clock::time_point attach_time = std::chrono::system_clock::now();
+		context = new react_context_t(NULL);
+		is_used = true;
+
+		static const int queue_wait_action = actions_set().define_new_action("queue_wait");
+		call_tree_t &call_tree = context->call_tree.get_call_tree();
+		call_tree_t::p_node_t wait_node = call_tree.add_new_link(call_tree.root, queue_wait_action);
+		call_tree.set_node_start_time(wait_node, to_microseconds(capture_time));
+		call_tree.set_node_stop_time(wait_node, to_microseconds(attach_time));
+
+		previous_context = thread_react_context;
+		previous_flight_context = thread_flight_context;
+		previous_refcount = thread_react_context_refcount;
+		thread_react_context = context;
+		thread_flight_context = NULL;
+		thread_react_context_refcount = 1;
+	}
+
+	void detach() {
+		if (!context || thread_react_context != context || thread_react_context_refcount != 1) {
+			throw std::logic_error("Can't detach context: token is not attached to current context");
+		}
+		if (context->updater.get_trace_depth() != 0) {
+			throw std::logic_error("Can't detach context: not all actions are stopped");
+		}
+
+		// Spans and subtrees handed back to the worker context belong to the moved tree
+		graft_handed_off_trees(context);
+		call_tree_handle_t call_tree = std::make_shared<call_tree_t>(std::move(context->call_tree.get_call_tree()));
+		inbox->push_tree(parent_node, std::move(call_tree));
+
+		delete context;
+		context = NULL;
+		thread_react_context = previous_context;
+		thread_flight_context = previous_flight_context;
+		thread_react_context_refcount = previous_refcount;
+	}
+
+	bool is_attached() const {
+		return context != NULL;
+	}
+
+private:
+	static int64_t to_microseconds(const std::chrono::system_clock::time_point &time) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+	}
+
+	std::shared_ptr<react_handoff_inbox_t> inbox;
+	call_tree_t::p_node_t parent_node;
+	std::chrono::system_clock::time_point capture_time;
+	bool is_used;
+
+	react_context_t *context;
+	react_context_t *previous_context;
+	react_flight_context_t *previous_flight_context;
+	int previous_refcount;
+};
+
+coroutine_context_t::coroutine_context_t(): m_context(NULL) {}
+
+coroutine_context_t::~coroutine_context_t() {
+	if (m_context) {
+		std::cerr << "~coroutine_context_t(): context is destroyed while suspended" << std::endl;
+		delete static_cast<react_context_t*>(m_context);
+	}
+}
+
+void coroutine_context_t::suspend() {
+	if (m_context) {
+		throw std::logic_error("Can't suspend coroutine context: context is already suspended");
+	}
+
+	m_context = suspend_thread_context();
+	m_suspend_time = std::chrono::system_clock::now();
+}
+
+void coroutine_context_t::resume() {
+	if (!m_context) {
+		return;
+	}
+
+	react_context_t *context = static_cast<react_context_t*>(m_context);
+	resume_thread_context(context);
+	m_context = NULL;
+
+	static const int suspended_action = actions_set().define_new_action("suspended");
+	context->updater.start(suspended_action, m_suspend_time, true);
+	context->updater.stop(suspended_action);
+}
+
+bool coroutine_context_t::is_suspended() const {
+	return m_context != NULL;
+}
+
+class async_span_t {
+public:
+	async_span_t(int action_code): inbox(thread_react_context->inbox), is_stopped(false) {
+		if (!actions_set().code_is_valid(action_code)) {
+			throw std::invalid_argument("Can't start async span: action code is invalid: "
+										+ std::to_string(static_cast<long long>(action_code)));
+		}
+
+		int64_t start_time = std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::system_clock::now().time_since_epoch()).count();
+		concurrent_call_tree_t &call_tree = thread_react_context->call_tree;
+		std::lock_guard<concurrent_call_tree_t> guard(call_tree);
+		node = call_tree.get_call_tree().add_new_link(thread_react_context->updater.get_current_node(), action_code);
+		call_tree.get_call_tree().set_node_start_time(node, start_time);
+	}
+
+	void stop() {
+		if (is_stopped) {
+			throw std::logic_error("Can't stop async span: span is already stopped");
+		}
+
+		int64_t stop_time = std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::system_clock::now().time_since_epoch()).count();
+		inbox->push_stop_time(node, stop_time);
+		is_stopped = true;
+	}
+
+private:
+	std::shared_ptr<react_handoff_inbox_t> inbox;
+	call_tree_t::p_node_t node;
+	bool is_stopped;
+};
+
+std::shared_ptr<async_span_t> start_async(int action_code) {
+	if (!thread_react_context) {
+		return std::shared_ptr<async_span_t>();
+	}
+
+	return std::make_shared<async_span_t>(action_code);
+}
+
+void stop_async(const std::shared_ptr<async_span_t> &span) {
+	if (span) {
+		span->stop();
+	}
+}
+
+std::shared_ptr<context_token_t> capture_context() {
+	if (!thread_react_context) {
+		throw std::runtime_error("Can't capture context: React is not active");
+	}
+
+	return std::make_shared<context_token_t>();
+}
+
+void attach_context(const std::shared_ptr<context_token_t> &token) {
+	token->attach();
+}
+
+void detach_context(const std::shared_ptr<context_token_t> &token) {
+	token->detach();
+}
+
 } // namespace react
 
 void *react_create_subthread_aggregator() {
 	try {
-		if (!react_is_active()) {
+		if (!thread_react_context) {
 			return NULL;
 		}
 
@@ -262,3 +740,90 @@ int react_destroy_subthread_aggregator(void *subthread_aggregator) {
 	}
 	return 0;
 }
+
+void *react_capture_context() {
+	try {
+		if (!thread_react_context) {
+			return NULL;
+		}
+
+		return new react::context_token_t();
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return NULL;
+	}
+}
+
+int react_attach_context(void *token) {
+	try {
+		if (!token) {
+			return 0;
+		}
+
+		static_cast<react::context_token_t*>(token)->attach();
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return -EINVAL;
+	}
+	return 0;
+}
+
+int react_detach_context(void *token) {
+	try {
+		if (!token) {
+			return 0;
+		}
+
+		static_cast<react::context_token_t*>(token)->detach();
+		delete static_cast<react::context_token_t*>(token);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return -EINVAL;
+	}
+	return 0;
+}
+
+int react_release_context(void *token) {
+	try {
+		if (!token) {
+			return 0;
+		}
+
+		if (static_cast<react::context_token_t*>(token)->is_attached()) {
+			throw std::logic_error("Can't release context token: token is attached, detach it instead");
+		}
+		delete static_cast<react::context_token_t*>(token);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return -EINVAL;
+	}
+	return 0;
+}
+
+void *react_start_async(int action_code) {
+	try {
+		if (!thread_react_context) {
+			return NULL;
+		}
+
+		return new react::async_span_t(action_code);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return NULL;
+	}
+}
+
+int react_stop_async(void *span) {
+	try {
+		if (!span) {
+			return 0;
+		}
+
+		static_cast<react::async_span_t*>(span)->stop();
+		delete static_cast<react::async_span_t*>(span);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return -EINVAL;
+	}
+	return 0;
+}
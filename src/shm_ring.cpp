@@ -0,0 +1,320 @@
+/*
+* 2014+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#include "react/shm_ring.hpp"
+#include "react/tree_codec.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace react {
+
+static const uint64_t SHM_RING_MAGIC = 0x474e525443414552ULL; // "REACTRNG"
+static const uint32_t SHM_RING_VERSION = 2;
+static const size_t CACHE_LINE_SIZE = 64;
+
+/*!
+ * \brief Counter placed in its own cache line
+ */
+struct shm_ring_counter_t {
+	std::atomic<uint64_t> value;
+	char pad[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+};
+
+/*!
+ * \brief Layout of the beginning of shared memory segment, slots follow it
+ */
+struct shm_ring_header_t {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t slots_count;
+	uint64_t slot_size;
+	uint64_t slot_stride;
+	char pad[CACHE_LINE_SIZE - 32];
+
+	/*!
+	 * \brief Number of the next tree to be written
+	 */
+	shm_ring_counter_t write_index;
+
+	/*!
+	 * \brief Number of the next tree to be read, published by reader
+	 */
+	shm_ring_counter_t read_index;
+
+	shm_ring_counter_t overruns;
+	shm_ring_counter_t dropped;
+};
+
+/*!
+ * \brief Layout of slot header, encoded tree follows it
+ */
+struct shm_ring_slot_t {
+	std::atomic<uint64_t> sequence;
+
+	/*!
+	 * \brief Highest 2N + 2 of tree number N whose writer dropped it because slot was busy
+	 */
+	std::atomic<uint64_t> abandoned;
+	uint64_t size;
+};
+
+static_assert(sizeof(shm_ring_header_t) % CACHE_LINE_SIZE == 0, "Unexpected shm ring header size");
+
+static std::string error_string(const std::string &message, int err) {
+	return message + ": " + strerror(err);
+}
+
+static std::string segment_name(const std::string &name) {
+	if (!name.empty() && name[0] == '/') {
+		return name;
+	}
+	return "/" + name;
+}
+
+static shm_ring_slot_t *get_slot(shm_ring_header_t *header, uint64_t index) {
+	char *slots = reinterpret_cast<char *>(header + 1);
+	return reinterpret_cast<shm_ring_slot_t *>(slots + (index % header->slots_count) * header->slot_stride);
+}
+
+static void mark_abandoned(shm_ring_slot_t *slot, uint64_t index) {
+	uint64_t abandoned = slot->abandoned.load(std::memory_order_relaxed);
+	while (abandoned < 2 * index + 2 &&
+			!slot->abandoned.compare_exchange_weak(abandoned, 2 * index + 2, std::memory_order_release)) {
+	}
+}
+
+shm_ring_aggregator_t::shm_ring_aggregator_t(const std::string &name, size_t slots_count, size_t slot_size)
+	: name(segment_name(name))
+	, header(NULL)
+	, mapping_size(0)
+{
+	if (slots_count == 0 || slot_size == 0) {
+		throw std::invalid_argument("Can't create shm ring: slots count and slot size must be positive");
+	}
+
+	size_t slot_stride = (sizeof(shm_ring_slot_t) + slot_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+	mapping_size = sizeof(shm_ring_header_t) + slots_count * slot_stride;
+
+	int fd = shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		throw std::runtime_error(error_string("Can't create shm ring " + this->name, errno));
+	}
+
+	if (ftruncate(fd, mapping_size) != 0) {
+		int err = errno;
+		close(fd);
+		shm_unlink(this->name.c_str());
+		throw std::runtime_error(error_string("Can't resize shm ring " + this->name, err));
+	}
+
+	void *mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	int err = errno;
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		shm_unlink(this->name.c_str());
+		throw std::runtime_error(error_string("Can't map shm ring " + this->name, err));
+	}
+
+	header = new (mapping) shm_ring_header_t();
+	header->version = SHM_RING_VERSION;
+	header->slots_count = slots_count;
+	header->slot_size = slot_size;
+	header->slot_stride = slot_stride;
+	header->write_index.value = 0;
+	header->read_index.value = 0;
+	header->overruns.value = 0;
+	header->dropped.value = 0;
+	for (size_t i = 0; i < slots_count; ++i) {
+		shm_ring_slot_t *slot = new (get_slot(header, i)) shm_ring_slot_t();
+		slot->sequence = 0;
+		slot->abandoned = 0;
+		slot->size = 0;
+	}
+
+	// Readers validate magic last, it is published after the whole layout is initialized
+	__atomic_store_n(&header->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+}
+
+shm_ring_aggregator_t::~shm_ring_aggregator_t()
+{
+	munmap(header, mapping_size);
+	shm_unlink(name.c_str());
+}
+
+void shm_ring_aggregator_t::aggregate(const call_tree_t &call_tree)
+{
+	std::string record;
+	tree_codec_t::encode(call_tree, record);
+
+	if (record.size() > header->slot_size) {
+		header->dropped.value.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	uint64_t index = header->write_index.value.fetch_add(1, std::memory_order_relaxed);
+	shm_ring_slot_t *slot = get_slot(header, index);
+
+	uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+	do {
+		// Slot is still written by writer lapped by the whole ring or already taken by newer one
+		if ((sequence & 1) || sequence > 2 * index) {
+			header->dropped.value.fetch_add(1, std::memory_order_relaxed);
+			mark_abandoned(slot, index);
+			return;
+		}
+	} while (!slot->sequence.compare_exchange_weak(sequence, 2 * index + 1, std::memory_order_acquire));
+
+	if (index >= header->read_index.value.load(std::memory_order_relaxed) + header->slots_count) {
+		header->overruns.value.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	slot->size = record.size();
+	memcpy(reinterpret_cast<char *>(slot + 1), record.data(), record.size());
+	slot->sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+uint64_t shm_ring_aggregator_t::get_written_count() const
+{
+	return header->write_index.value.load(std::memory_order_relaxed);
+}
+
+uint64_t shm_ring_aggregator_t::get_overruns_count() const
+{
+	return header->overruns.value.load(std::memory_order_relaxed);
+}
+
+uint64_t shm_ring_aggregator_t::get_dropped_count() const
+{
+	return header->dropped.value.load(std::memory_order_relaxed);
+}
+
+shm_ring_reader_t::shm_ring_reader_t(const std::string &name)
+	: header(NULL)
+	, mapping_size(0)
+	, next_index(0)
+	, lost_count(0)
+{
+	std::string segment = segment_name(name);
+	int fd = shm_open(segment.c_str(), O_RDWR, 0);
+	if (fd < 0) {
+		throw std::runtime_error(error_string("Can't open shm ring " + segment, errno));
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		int err = errno;
+		close(fd);
+		throw std::runtime_error(error_string("Can't stat shm ring " + segment, err));
+	}
+	mapping_size = st.st_size;
+
+	if (mapping_size < sizeof(shm_ring_header_t)) {
+		close(fd);
+		throw std::runtime_error("Can't open shm ring " + segment + ": segment is too small");
+	}
+
+	void *mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	int err = errno;
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		throw std::runtime_error(error_string("Can't map shm ring " + segment, err));
+	}
+	header = static_cast<shm_ring_header_t *>(mapping);
+
+	if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC ||
+			header->version != SHM_RING_VERSION ||
+			sizeof(shm_ring_header_t) + header->slots_count * header->slot_stride > mapping_size) {
+		munmap(header, mapping_size);
+		throw std::runtime_error("Can't open shm ring " + segment + ": unknown format");
+	}
+
+	uint64_t write_index = header->write_index.value.load(std::memory_order_acquire);
+	if (write_index > header->slots_count) {
+		next_index = write_index - header->slots_count;
+	}
+}
+
+shm_ring_reader_t::~shm_ring_reader_t()
+{
+	munmap(header, mapping_size);
+}
+
+bool shm_ring_reader_t::read_record(std::string &record)
+{
+	for (;;) {
+		uint64_t write_index = header->write_index.value.load(std::memory_order_acquire);
+		if (next_index >= write_index) {
+			return false;
+		}
+
+		if (write_index - next_index > header->slots_count) {
+			lost_count += write_index - header->slots_count - next_index;
+			next_index = write_index - header->slots_count;
+		}
+
+		shm_ring_slot_t *slot = get_slot(header, next_index);
+		uint64_t expected = 2 * next_index + 2;
+		uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+
+		if (sequence < expected &&
+				(sequence == expected - 1 || slot->abandoned.load(std::memory_order_acquire) < expected)) {
+			// Tree is still being written
+			return false;
+		}
+
+		if (sequence == expected) {
+			size_t size = std::min<uint64_t>(slot->size, header->slot_size);
+			record.assign(reinterpret_cast<const char *>(slot + 1), size);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot->sequence.load(std::memory_order_relaxed) == expected) {
+				++next_index;
+				header->read_index.value.store(next_index, std::memory_order_release);
+				return true;
+			}
+		}
+
+		// Tree was overwritten by newer one or dropped by its writer
+		++lost_count;
+		++next_index;
+		header->read_index.value.store(next_index, std::memory_order_release);
+	}
+}
+
+std::unique_ptr<call_tree_t> shm_ring_reader_t::read_call_tree()
+{
+	std::string record;
+	if (!read_record(record)) {
+		return std::unique_ptr<call_tree_t>();
+	}
+	return std::unique_ptr<call_tree_t>(
+			new call_tree_t(tree_codec_t::decode(record.data(), record.size(), actions_set)));
+}
+
+uint64_t shm_ring_reader_t::get_dropped_count() const
+{
+	return header->dropped.value.load(std::memory_order_relaxed);
+}
+
+} // namespace react
@@ -74,7 +74,7 @@ BOOST_AUTO_TEST_CASE( get_action_name_no_action_test )
 	actions_set_t actions_set;
 
 	BOOST_CHECK_THROW( actions_set.get_action_name(actions_set_t::NO_ACTION),
-					   std::invalid_argument )
+					   std::invalid_argument );
 }
 
 BOOST_AUTO_TEST_SUITE_END()
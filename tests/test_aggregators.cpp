@@ -0,0 +1,213 @@
+#include <sstream>
+
+#include "tests.hpp"
+
+#include "react/chrome_trace_aggregator.hpp"
+#include "react/folded_stack_aggregator.hpp"
+#include "react/callgrind_aggregator.hpp"
+#include "react/tail_retention_aggregator.hpp"
+
+BOOST_AUTO_TEST_SUITE( aggregators_suite )
+
+using namespace react;
+
+struct cache_read_tree {
+	cache_read_tree(): call_tree(actions_set) {
+		ACTION_READ = actions_set.define_new_action("READ");
+		ACTION_FIND = actions_set.define_new_action("FIND");
+		ACTION_LOAD_FROM_DISK = actions_set.define_new_action("LOAD FROM DISK");
+
+		call_tree_t::p_node_t read = add_node(call_tree.root, ACTION_READ, 100, 1100);
+		add_node(read, ACTION_FIND, 110, 200);
+		add_node(read, ACTION_LOAD_FROM_DISK, 200, 1000);
+		call_tree.add_stat("id", "tree");
+		call_tree.add_stat("thread_id", 42);
+	}
+
+	call_tree_t::p_node_t add_node(call_tree_t::p_node_t parent, int action_code,
+								   int64_t start_time, int64_t stop_time) {
+		call_tree_t::p_node_t node = call_tree.add_new_link(parent, action_code);
+		call_tree.set_node_start_time(node, start_time);
+		call_tree.set_node_stop_time(node, stop_time);
+		return node;
+	}
+
+	actions_set_t actions_set;
+	call_tree_t call_tree;
+	int ACTION_READ;
+	int ACTION_FIND;
+	int ACTION_LOAD_FROM_DISK;
+};
+
+size_t count_substrings(const std::string &str, const std::string &substring) {
+	size_t count = 0;
+	for (size_t pos = str.find(substring); pos != std::string::npos; pos = str.find(substring, pos + 1)) {
+		++count;
+	}
+	return count;
+}
+
+BOOST_AUTO_TEST_CASE( chrome_trace_aggregator_test )
+{
+	cache_read_tree tree;
+	std::ostringstream output;
+
+	{
+		chrome_trace_aggregator_t aggregator(output);
+		aggregator.aggregate(tree.call_tree);
+		aggregator.aggregate(tree.call_tree);
+	}
+
+	std::string trace = output.str();
+	BOOST_CHECK_EQUAL( trace.find("{\"traceEvents\":["), 0 );
+	BOOST_CHECK_EQUAL( trace.substr(trace.size() - 3), "]}\n" );
+	BOOST_CHECK_EQUAL( count_substrings(trace, "\"ph\":\"X\""), 6 );
+	BOOST_CHECK_EQUAL( count_substrings(trace, "\"ph\":\"i\""), 2 );
+	BOOST_CHECK_EQUAL( count_substrings(trace, "\"tid\":42"), 8 );
+	BOOST_CHECK_EQUAL( count_substrings(trace, "\"id\":\"tree\""), 2 );
+	BOOST_CHECK( trace.find("{\"name\":\"READ\",\"ph\":\"X\",\"ts\":100,\"dur\":1000,") != std::string::npos );
+	BOOST_CHECK( trace.find("{\"name\":\"LOAD FROM DISK\",\"ph\":\"X\",\"ts\":200,\"dur\":800,") != std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( chrome_trace_aggregator_empty_trace_test )
+{
+	std::ostringstream output;
+
+	{
+		chrome_trace_aggregator_t aggregator(output);
+	}
+
+	BOOST_CHECK_EQUAL( output.str(), "{\"traceEvents\":[\n\n]}\n" );
+}
+
+BOOST_AUTO_TEST_CASE( folded_stack_aggregator_test )
+{
+	cache_read_tree tree;
+	folded_stack_aggregator_t aggregator(tree.actions_set);
+
+	aggregator.aggregate(tree.call_tree);
+	aggregator.aggregate(tree.call_tree);
+	BOOST_CHECK_EQUAL( aggregator.size(), 3 );
+
+	std::ostringstream output;
+	aggregator.dump(output);
+	BOOST_CHECK_EQUAL( output.str(),
+					   "READ 220\n"
+					   "READ;FIND 180\n"
+					   "READ;LOAD FROM DISK 1600\n" );
+
+	aggregator.clear();
+	BOOST_CHECK_EQUAL( aggregator.size(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( callgrind_aggregator_test )
+{
+	cache_read_tree tree;
+	callgrind_aggregator_t aggregator(tree.actions_set);
+
+	aggregator.aggregate(tree.call_tree);
+	aggregator.aggregate(tree.call_tree);
+
+	std::ostringstream output;
+	aggregator.dump(output);
+	BOOST_CHECK_EQUAL( output.str(),
+					   "# callgrind format\n"
+					   "version: 1\n"
+					   "creator: react\n"
+					   "positions: line\n"
+					   "events: Time Count\n"
+					   "totals: 2000 6\n"
+					   "\n"
+					   "fn=(1) READ\n"
+					   "0 220 2\n"
+					   "cfn=(2) FIND\n"
+					   "calls=2 0\n"
+					   "0 180 2\n"
+					   "cfn=(3) LOAD FROM DISK\n"
+					   "calls=2 0\n"
+					   "0 1600 2\n"
+					   "\n"
+					   "fn=(2)\n"
+					   "0 180 2\n"
+					   "\n"
+					   "fn=(3)\n"
+					   "0 1600 2\n"
+					   "\n" );
+}
+
+BOOST_AUTO_TEST_CASE( callgrind_aggregator_without_count_test )
+{
+	cache_read_tree tree;
+	callgrind_aggregator_t aggregator(tree.actions_set, false);
+
+	aggregator.aggregate(tree.call_tree);
+
+	std::ostringstream output;
+	aggregator.dump(output);
+	BOOST_CHECK( output.str().find("events: Time\ntotals: 1000\n") != std::string::npos );
+	BOOST_CHECK( output.str().find("fn=(1) READ\n0 110\n") != std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( callgrind_aggregator_cpu_time_test )
+{
+	cache_read_tree tree;
+	tree.add_node(tree.call_tree.root, tree.ACTION_FIND, 2000, 3000);
+	tree.call_tree.add_stat("cpu_time", 600);
+	callgrind_aggregator_t aggregator(tree.actions_set, false, "cpu_time");
+
+	aggregator.aggregate(tree.call_tree);
+
+	// CPU time is split between top-level READ and FIND by their equal wall time
+	std::ostringstream output;
+	aggregator.dump(output);
+	BOOST_CHECK( output.str().find("events: Time CpuTime\ntotals: 2000 600\n") != std::string::npos );
+	BOOST_CHECK( output.str().find("fn=(1) READ\n0 110 300\n") != std::string::npos );
+	BOOST_CHECK( output.str().find("cfn=(2) FIND\ncalls=1 0\n0 90 0\n") != std::string::npos );
+	BOOST_CHECK( output.str().find("fn=(2)\n0 1090 300\n") != std::string::npos );
+}
+
+struct collecting_aggregator_t : public aggregator_t {
+	void aggregate(const call_tree_t &call_tree) {
+		durations.push_back(call_tree.get_stat<int>("duration"));
+	}
+
+	std::vector<int> durations;
+};
+
+BOOST_AUTO_TEST_CASE( tail_retention_aggregator_test )
+{
+	actions_set_t actions_set;
+	int ACTION_READ = actions_set.define_new_action("READ");
+	std::shared_ptr<collecting_aggregator_t> collector = std::make_shared<collecting_aggregator_t>();
+
+	tail_retention_aggregator_t::options_t options;
+	options.threshold = 5000;
+	options.top_k = 2;
+
+	tail_retention_aggregator_t aggregator(collector, options);
+
+	const int durations[] = {100, 300, 7000, 200, 50, 400};
+	for (int second = 0; second < 2; ++second) {
+		for (size_t i = 0; i < sizeof(durations) / sizeof(durations[0]); ++i) {
+			call_tree_t call_tree(actions_set);
+			call_tree_t::p_node_t read = call_tree.add_new_link(call_tree.root, ACTION_READ);
+			call_tree.set_node_start_time(read, second * 1000000);
+			call_tree.set_node_stop_time(read, second * 1000000 + durations[i]);
+			call_tree.add_stat("duration", durations[i]);
+			aggregator.aggregate(call_tree);
+		}
+	}
+
+	const int first_window[] = {7000, 400, 300, 7000};
+	BOOST_CHECK_EQUAL_COLLECTIONS( collector->durations.begin(), collector->durations.end(),
+								   first_window, first_window + 4 );
+
+	aggregator.flush();
+	BOOST_REQUIRE_EQUAL( collector->durations.size(), 6 );
+	BOOST_CHECK_EQUAL( collector->durations[4], 400 );
+	BOOST_CHECK_EQUAL( collector->durations[5], 300 );
+	BOOST_CHECK_EQUAL( aggregator.get_forwarded_count(), 6 );
+	BOOST_CHECK_EQUAL( aggregator.get_discarded_count(), 6 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,115 @@
+#include <atomic>
+#include <future>
+
+#include "tests.hpp"
+
+#include "react/async_aggregator.hpp"
+#include "react/recent_trees_aggregator.hpp"
+
+BOOST_AUTO_TEST_SUITE( async_aggregator_suite )
+
+using namespace react;
+
+class counting_aggregator_t : public aggregator_t {
+public:
+	counting_aggregator_t(): count(0) {}
+
+	void aggregate(const call_tree_t &) {
+		++count;
+	}
+
+	std::atomic<int> count;
+};
+
+class blocking_aggregator_t : public aggregator_t {
+public:
+	blocking_aggregator_t(std::shared_future<void> release): release(release), count(0) {}
+
+	void aggregate(const call_tree_t &) {
+		release.wait();
+		++count;
+	}
+
+	std::shared_future<void> release;
+	std::atomic<int> count;
+};
+
+BOOST_AUTO_TEST_CASE( bounded_queue_test )
+{
+	bounded_queue_t<int> queue(3);
+	BOOST_CHECK_EQUAL( queue.capacity(), 4 );
+
+	for (int i = 0; i < 4; ++i) {
+		BOOST_CHECK( queue.try_push(i) );
+	}
+	int value = 42;
+	BOOST_CHECK( !queue.try_push(value) );
+	BOOST_CHECK_EQUAL( queue.size(), 4 );
+
+	for (int i = 0; i < 4; ++i) {
+		BOOST_CHECK( queue.try_pop(value) );
+		BOOST_CHECK_EQUAL( value, i );
+	}
+	BOOST_CHECK( !queue.try_pop(value) );
+	BOOST_CHECK_EQUAL( queue.size(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( async_aggregator_aggregate_test )
+{
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+	auto counting_aggregator = std::make_shared<counting_aggregator_t>();
+
+	{
+		async_aggregator_t aggregator(counting_aggregator, 16, async_aggregator_t::BLOCK_ON_OVERFLOW, 2);
+		for (int i = 0; i < 1000; ++i) {
+			aggregator.aggregate(call_tree);
+		}
+	}
+
+	BOOST_CHECK_EQUAL( counting_aggregator->count, 1000 );
+}
+
+BOOST_AUTO_TEST_CASE( async_aggregator_handle_test )
+{
+	actions_set_t actions_set;
+	call_tree_handle_t call_tree = std::make_shared<const call_tree_t>(actions_set);
+	auto recent_trees_aggregator = std::make_shared<recent_trees_aggregator_t>();
+
+	{
+		async_aggregator_t aggregator(recent_trees_aggregator);
+		aggregator.aggregate_handle(call_tree);
+	}
+
+	// Handle is passed on to wrapped aggregator without copying tree
+	std::vector<call_tree_handle_t> trees = recent_trees_aggregator->get_trees();
+	BOOST_REQUIRE_EQUAL( trees.size(), 1 );
+	BOOST_CHECK_EQUAL( trees[0].get(), call_tree.get() );
+}
+
+BOOST_AUTO_TEST_CASE( async_aggregator_drop_test )
+{
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+	std::promise<void> release;
+	auto blocking_aggregator = std::make_shared<blocking_aggregator_t>(release.get_future().share());
+
+	std::unique_ptr<async_aggregator_t> aggregator(
+				new async_aggregator_t(blocking_aggregator, 4, async_aggregator_t::DROP_ON_OVERFLOW)
+	);
+	for (int i = 0; i < 10; ++i) {
+		aggregator->aggregate(call_tree);
+	}
+
+	// Worker may have taken at most one tree out of the queue
+	uint64_t dropped_count = aggregator->get_dropped_count();
+	BOOST_CHECK_GE( dropped_count, 5 );
+	BOOST_CHECK_LE( dropped_count, 6 );
+	BOOST_CHECK_GE( dropped_count + aggregator->get_queue_depth(), 9 );
+
+	release.set_value();
+	aggregator.reset();
+	BOOST_CHECK_EQUAL( blocking_aggregator->count, 10 - static_cast<int>(dropped_count) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -75,4 +75,63 @@ BOOST_AUTO_TEST_CASE( concurrent_call_tree_inner_tree_test )
 	BOOST_CHECK_EQUAL( tree_copy.get_node_action_code(node), action_code );
 }
 
+BOOST_AUTO_TEST_CASE( call_tree_change_tracking_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	call_tree_t call_tree(actions_set);
+	call_tree_t::p_node_t untracked = call_tree.add_new_link(call_tree.root, action_code);
+	BOOST_CHECK( call_tree.get_changes().empty() );
+
+	call_tree.set_change_tracking(true);
+	call_tree_t::p_node_t child = call_tree.add_new_link(untracked, action_code);
+	call_tree.set_node_start_time(child, 10);
+	call_tree.set_node_stop_time(untracked, 20);
+	call_tree.add_stat("key", 1);
+
+	const auto &changes = call_tree.get_changes();
+	BOOST_REQUIRE_EQUAL( changes.size(), 2 );
+	BOOST_CHECK_EQUAL( changes[0].node, child );
+	BOOST_CHECK_EQUAL( changes[0].parent, untracked );
+	BOOST_CHECK_EQUAL( changes[1].node, untracked );
+	BOOST_CHECK_EQUAL( changes[1].parent, +call_tree_t::NO_NODE );
+	BOOST_CHECK( call_tree.stats_changed() );
+
+	call_tree.clear_changes();
+	BOOST_CHECK( call_tree.get_changes().empty() );
+	BOOST_CHECK( !call_tree.stats_changed() );
+
+	call_tree.set_node_stop_time(child, 30);
+	BOOST_REQUIRE_EQUAL( changes.size(), 1 );
+	BOOST_CHECK_EQUAL( changes[0].node, child );
+}
+
+BOOST_AUTO_TEST_CASE( concurrent_call_tree_snapshot_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	concurrent_call_tree_t concurrent_call_tree(actions_set);
+	call_tree_t &call_tree = concurrent_call_tree.get_call_tree();
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree.set_node_stop_time(node, 10);
+
+	call_tree_t first_copy = concurrent_call_tree.copy_call_tree();
+	BOOST_CHECK( call_tree.is_tracking_changes() );
+	BOOST_CHECK_EQUAL( first_copy.get_node_stop_time(node), 10 );
+
+	call_tree.set_node_stop_time(node, 20);
+	call_tree_t::p_node_t child = call_tree.add_new_link(node, action_code);
+	call_tree.set_node_start_time(child, 15);
+	call_tree.add_stat("key", 1);
+	BOOST_CHECK_EQUAL( call_tree.get_changes().size(), 2 );
+
+	call_tree_t second_copy = concurrent_call_tree.copy_call_tree();
+	BOOST_CHECK( call_tree.get_changes().empty() );
+	BOOST_CHECK_EQUAL( first_copy.get_node_stop_time(node), 10 );
+	BOOST_CHECK_EQUAL( second_copy.get_node_stop_time(node), 20 );
+	BOOST_REQUIRE_EQUAL( second_copy.get_node_links(node).size(), 1 );
+	BOOST_CHECK_EQUAL( second_copy.get_node_start_time(child), 15 );
+	BOOST_CHECK_EQUAL( second_copy.get_stat<int>("key"), 1 );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <sstream>
+#include <unistd.h>
+
+#include "tests.hpp"
+
+#include "react/call_tree_log.hpp"
+#include "react/updater.hpp"
+#include "react/utils.hpp"
+
+BOOST_AUTO_TEST_SUITE( call_tree_log_suite )
+
+using namespace react;
+
+std::string log_path() {
+	return "call_tree_log_test_" + std::to_string(static_cast<long long>(getpid())) + ".delta";
+}
+
+std::string read_file(const std::string &path) {
+	std::ifstream input(path);
+	std::stringstream content;
+	content << input.rdbuf();
+	return content.str();
+}
+
+BOOST_AUTO_TEST_CASE( call_tree_delta_test )
+{
+	actions_set_t actions_set;
+	int ACTION_READ = actions_set.define_new_action("READ");
+	int ACTION_FIND = actions_set.define_new_action("FIND");
+	concurrent_call_tree_t call_tree(actions_set);
+	BOOST_CHECK( call_tree.take_changes().is_snapshot );
+
+	call_tree_updater_t updater(call_tree);
+	updater.start(ACTION_READ);
+	updater.start(ACTION_FIND);
+	updater.stop(ACTION_FIND);
+	// Snapshot taken by other reader does not steal changes
+	BOOST_CHECK_EQUAL( call_tree.copy_call_tree().get_node_links(call_tree.get_call_tree().root).size(), 1 );
+
+	call_tree_delta_t delta = call_tree.take_changes();
+	BOOST_CHECK( !delta.is_snapshot );
+	BOOST_REQUIRE_EQUAL( delta.nodes.size(), 2 );
+	BOOST_CHECK_EQUAL( delta.nodes[0].action_code, ACTION_READ );
+	BOOST_CHECK_EQUAL( delta.nodes[0].parent, call_tree.get_call_tree().root );
+	BOOST_CHECK_EQUAL( delta.nodes[1].action_code, ACTION_FIND );
+	BOOST_CHECK_EQUAL( delta.nodes[1].parent, delta.nodes[0].node );
+	BOOST_CHECK( delta.nodes[1].stop_time > 0 );
+	BOOST_CHECK( call_tree.take_changes().empty() );
+
+	updater.stop(ACTION_READ);
+	delta = call_tree.take_changes();
+	BOOST_REQUIRE_EQUAL( delta.nodes.size(), 1 );
+	BOOST_CHECK_EQUAL( delta.nodes[0].parent, +call_tree_t::NO_NODE );
+	BOOST_CHECK( delta.nodes[0].stop_time >= delta.nodes[0].start_time );
+
+	call_tree_delta_t snapshot = call_tree.take_snapshot();
+	BOOST_CHECK( snapshot.is_snapshot );
+	BOOST_CHECK_EQUAL( snapshot.nodes.size(), 2 );
+}
+
+BOOST_AUTO_TEST_CASE( call_tree_log_replay_test )
+{
+	actions_set_t actions_set;
+	int ACTION_READ = actions_set.define_new_action("READ");
+	int ACTION_FIND = actions_set.define_new_action("FIND");
+	concurrent_call_tree_t call_tree(actions_set);
+	call_tree_updater_t updater(call_tree);
+
+	std::string path = log_path();
+	std::remove(path.c_str());
+	{
+		call_tree_log_t log(path, actions_set);
+		updater.start(ACTION_READ);
+		log.compact(call_tree.take_snapshot());
+
+		updater.start(ACTION_FIND, true);
+		updater.stop(ACTION_FIND);
+		updater.start(ACTION_FIND, true);
+		updater.stop(ACTION_FIND);
+		log.append(call_tree.take_changes());
+
+		updater.stop(ACTION_READ);
+		call_tree.get_call_tree().add_stat("size", 42);
+		log.append(call_tree.take_changes());
+		log.append(call_tree.take_changes());
+		BOOST_CHECK_EQUAL( log.get_records_count(), 3 );
+	}
+
+	std::string expected = print_json_to_string(call_tree.copy_call_tree());
+	{
+		actions_set_t replayed_actions_set;
+		std::ifstream input(path);
+		std::unique_ptr<call_tree_t> replayed = call_tree_log_t::read(input, replayed_actions_set);
+		BOOST_CHECK_EQUAL( print_json_to_string(*replayed), expected );
+	}
+
+	{
+		call_tree_log_t log(path, actions_set);
+		log.compact(call_tree.take_snapshot());
+		BOOST_CHECK_EQUAL( log.get_records_count(), 1 );
+	}
+	std::string content = read_file(path);
+	BOOST_CHECK_EQUAL( std::count(content.begin(), content.end(), '\n'), 1 );
+	BOOST_CHECK_EQUAL( content.compare(0, 16, "{\"snapshot\":true"), 0 );
+
+	std::istringstream truncated("{\"snapshot\":false,\"nodes\":[]}\n");
+	actions_set_t other_actions_set;
+	BOOST_CHECK_THROW( call_tree_log_t::read(truncated, other_actions_set), std::runtime_error );
+
+	std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -240,7 +240,7 @@ BOOST_AUTO_TEST_CASE( action_guard_stop_test )
 	{
 		action_guard_t action_guard(NULL, NO_ACTION);
 		action_guard.stop();
-		BOOST_CHECK_THROW( action_guard.stop(), std::logic_error )
+		BOOST_CHECK_THROW( action_guard.stop(), std::logic_error );
 	}
 
 	{
@@ -251,7 +251,7 @@ BOOST_AUTO_TEST_CASE( action_guard_stop_test )
 
 		action_guard_t action_guard(&updater, action_code);
 		action_guard.stop();
-		BOOST_CHECK_THROW( action_guard.stop(), std::logic_error )
+		BOOST_CHECK_THROW( action_guard.stop(), std::logic_error );
 	}
 }
 
@@ -0,0 +1,120 @@
+#include <thread>
+#include <vector>
+
+#include "tests.hpp"
+
+#include "react/coroutine.hpp"
+
+BOOST_AUTO_TEST_SUITE( coroutine_suite )
+
+class handle_aggregator_t : public react::aggregator_t {
+public:
+	void aggregate(const react::call_tree_t &) {}
+
+	void aggregate_handle(react::call_tree_handle_t call_tree) {
+		handles.push_back(call_tree);
+	}
+
+	std::vector<react::call_tree_handle_t> handles;
+};
+
+/*!
+ * \brief Awaiter that keeps handle of suspended coroutine, so test can resume it on another thread
+ */
+struct handle_awaiter_t {
+	bool await_ready() {
+		return false;
+	}
+
+	void await_suspend(std::coroutine_handle<> handle) {
+		*suspended = handle;
+	}
+
+	int await_resume() {
+		return value;
+	}
+
+	std::coroutine_handle<> *suspended;
+	int value;
+};
+
+struct member_awaitable_t {
+	handle_awaiter_t operator co_await() {
+		return handle_awaiter_t{suspended, 1};
+	}
+
+	std::coroutine_handle<> *suspended;
+};
+
+struct free_awaitable_t {
+	std::coroutine_handle<> *suspended;
+};
+
+handle_awaiter_t operator co_await(free_awaitable_t awaitable) {
+	return handle_awaiter_t{awaitable.suspended, 2};
+}
+
+struct tracked_task_t {
+	struct promise_type : public react::tracked_promise_base_t {
+		tracked_task_t get_return_object() {
+			return tracked_task_t();
+		}
+
+		std::suspend_never initial_suspend() noexcept {
+			return std::suspend_never();
+		}
+
+		std::suspend_never final_suspend() noexcept {
+			return std::suspend_never();
+		}
+
+		void return_void() {}
+
+		void unhandled_exception() {
+			std::terminate();
+		}
+	};
+};
+
+tracked_task_t tracked_coroutine(std::coroutine_handle<> &suspended, int action_code, int &result) {
+	react_start_action(action_code);
+	result = co_await member_awaitable_t{&suspended};
+	result += co_await free_awaitable_t{&suspended};
+	react_stop_action(action_code);
+	react_deactivate();
+}
+
+BOOST_AUTO_TEST_CASE( tracked_coroutine_test )
+{
+	handle_aggregator_t aggregator;
+	int action_code = react_define_new_action("COROUTINE_ACTION");
+	std::coroutine_handle<> suspended;
+	int result = 0;
+
+	react_activate(&aggregator);
+	tracked_coroutine(suspended, action_code, result);
+	BOOST_REQUIRE( suspended );
+	BOOST_CHECK( !react_is_active() );
+
+	// Coroutine is resumed on different threads after every operator co_await
+	for (int i = 0; i < 2; ++i) {
+		std::coroutine_handle<> handle = suspended;
+		suspended = std::coroutine_handle<>();
+		std::thread([handle] () {
+			handle.resume();
+		}).join();
+	}
+	BOOST_CHECK_EQUAL( result, 3 );
+	BOOST_CHECK( !react_is_active() );
+
+	BOOST_REQUIRE_EQUAL( aggregator.handles.size(), 1 );
+	const react::call_tree_t &call_tree = *aggregator.handles[0];
+	const react::node_t::Container &links = call_tree.get_node_links(call_tree.root);
+	BOOST_REQUIRE_EQUAL( links.size(), 1 );
+	BOOST_CHECK_EQUAL( links[0].first, action_code );
+	const react::node_t::Container &suspended_links = call_tree.get_node_links(links[0].second);
+	BOOST_REQUIRE_EQUAL( suspended_links.size(), 1 );
+	BOOST_CHECK_EQUAL( suspended_links[0].first, react_define_new_action("suspended") );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,235 @@
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "tests.hpp"
+
+#include "react/file_aggregator.hpp"
+
+BOOST_AUTO_TEST_SUITE( file_aggregator_suite )
+
+using namespace react;
+
+struct temporary_path {
+	temporary_path(): path("/tmp/react_file_aggregator_test_" + std::to_string(static_cast<long long>(getpid()))) {}
+
+	~temporary_path() {
+		for (int i = 0; i < 16; ++i) {
+			unlink(file_name(i).c_str());
+		}
+	}
+
+	std::string file_name(int number) const {
+		return path + "." + std::to_string(static_cast<long long>(number));
+	}
+
+	std::vector<std::string> read_lines(int number) const {
+		std::ifstream input(file_name(number));
+		std::vector<std::string> lines;
+		for (std::string line; std::getline(input, line); ) {
+			lines.push_back(line);
+		}
+		return lines;
+	}
+
+	std::string path;
+};
+
+BOOST_AUTO_TEST_CASE( file_aggregator_write_test )
+{
+	temporary_path output;
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	call_tree_t call_tree(actions_set);
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree.set_node_start_time(node, 1);
+	call_tree.set_node_stop_time(node, 2);
+	call_tree.add_stat("complete", true);
+
+	{
+		file_aggregator_t aggregator(output.path);
+		BOOST_CHECK_EQUAL( aggregator.get_current_file_name(), output.file_name(0) );
+		aggregator.aggregate(call_tree);
+		aggregator.aggregate(call_tree);
+	}
+
+	std::vector<std::string> lines = output.read_lines(0);
+	BOOST_REQUIRE_EQUAL( lines.size(), 3 );
+
+	const std::string tree_json =
+			"{\"complete\":true,\"actions\":[{\"name\":\"ACTION\",\"start_time\":1,\"stop_time\":2}]}";
+	BOOST_CHECK_EQUAL( lines[0], tree_json );
+	BOOST_CHECK_EQUAL( lines[1], tree_json );
+
+	std::ostringstream index;
+	index << "{\"react_index\":{\"trees\":2,\"offsets\":[0," << tree_json.size() + 1 << "]}}";
+	BOOST_CHECK_EQUAL( lines[2], index.str() );
+}
+
+BOOST_AUTO_TEST_CASE( file_aggregator_rotation_test )
+{
+	temporary_path output;
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+	call_tree.add_stat("id", "tree");
+
+	file_aggregator_t::options_t options;
+	options.buffer_size = 16;
+	options.max_file_size = 32;
+	options.sync_policy = file_aggregator_t::SYNC_ON_ROTATE;
+
+	{
+		file_aggregator_t aggregator(output.path, options);
+		for (int i = 0; i < 5; ++i) {
+			aggregator.aggregate(call_tree);
+		}
+		BOOST_CHECK_EQUAL( aggregator.get_current_file_name(), output.file_name(2) );
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		std::vector<std::string> lines = output.read_lines(i);
+		BOOST_REQUIRE_EQUAL( lines.size(), 3 );
+		BOOST_CHECK_EQUAL( lines[0], "{\"id\":\"tree\"}" );
+		BOOST_CHECK_EQUAL( lines[2], "{\"react_index\":{\"trees\":2,\"offsets\":[0,14]}}" );
+	}
+
+	std::vector<std::string> lines = output.read_lines(2);
+	BOOST_REQUIRE_EQUAL( lines.size(), 2 );
+	BOOST_CHECK_EQUAL( lines[1], "{\"react_index\":{\"trees\":1,\"offsets\":[0]}}" );
+}
+
+BOOST_AUTO_TEST_CASE( file_aggregator_io_uring_test )
+{
+	temporary_path output;
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+	call_tree.add_stat("id", "tree");
+
+	file_aggregator_t::options_t options;
+	options.buffer_size = 64;
+	options.max_file_size = 0;
+	options.backend = file_writer_t::IO_URING_BACKEND;
+
+	{
+		file_aggregator_t aggregator(output.path, options);
+		BOOST_CHECK_EQUAL( aggregator.get_backend(), file_writer_t::is_io_uring_available()
+						   ? file_writer_t::IO_URING_BACKEND : file_writer_t::POSIX_BACKEND );
+		for (int i = 0; i < 100; ++i) {
+			aggregator.aggregate(call_tree);
+		}
+		aggregator.flush();
+	}
+
+	std::vector<std::string> lines = output.read_lines(0);
+	BOOST_REQUIRE_EQUAL( lines.size(), 101 );
+	for (int i = 0; i < 100; ++i) {
+		BOOST_CHECK_EQUAL( lines[i], "{\"id\":\"tree\"}" );
+	}
+	BOOST_CHECK_EQUAL( lines[100].find("{\"react_index\":{\"trees\":100,"), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( file_aggregator_restart_test )
+{
+	temporary_path output;
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+
+	{
+		file_aggregator_t aggregator(output.path);
+		aggregator.aggregate(call_tree);
+		BOOST_CHECK_EQUAL( aggregator.get_current_file_name(), output.file_name(0) );
+	}
+	std::ofstream(output.file_name(2)) << "foreign\n";
+
+	// Restarted aggregator continues after the highest existing file
+	{
+		file_aggregator_t aggregator(output.path);
+		BOOST_CHECK_EQUAL( aggregator.get_current_file_name(), output.file_name(3) );
+	}
+	BOOST_CHECK_EQUAL( output.read_lines(0).size(), 2 );
+	BOOST_REQUIRE_EQUAL( output.read_lines(2).size(), 1 );
+	BOOST_CHECK_EQUAL( output.read_lines(2)[0], "foreign" );
+	BOOST_CHECK_EQUAL( output.read_lines(3).size(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( file_aggregator_background_flush_test )
+{
+	temporary_path output;
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+
+	file_aggregator_t::options_t options;
+	options.flush_interval = 10;
+	file_aggregator_t aggregator(output.path, options);
+	aggregator.aggregate(call_tree);
+
+	// Buffered tree is written by time without further traffic
+	bool is_flushed = false;
+	for (int i = 0; i < 200 && !is_flushed; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		is_flushed = output.read_lines(0).size() == 1;
+	}
+	BOOST_CHECK( is_flushed );
+}
+
+BOOST_AUTO_TEST_CASE( file_aggregator_idle_rotation_test )
+{
+	temporary_path output;
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+
+	file_aggregator_t::options_t options;
+	options.rotation_interval = 1;
+	options.flush_interval = 0;
+	file_aggregator_t aggregator(output.path, options);
+	aggregator.aggregate(call_tree);
+
+	// File is closed with index by time without further traffic
+	bool is_rotated = false;
+	for (int i = 0; i < 300 && !is_rotated; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		is_rotated = aggregator.get_current_file_name() == output.file_name(1);
+	}
+	BOOST_REQUIRE( is_rotated );
+
+	std::vector<std::string> lines = output.read_lines(0);
+	BOOST_REQUIRE_EQUAL( lines.size(), 2 );
+	BOOST_CHECK_EQUAL( lines[1], "{\"react_index\":{\"trees\":1,\"offsets\":[0]}}" );
+}
+
+BOOST_AUTO_TEST_CASE( file_writer_in_flight_bytes_test )
+{
+	temporary_path output;
+	std::unique_ptr<file_writer_t> writer = file_writer_t::create(file_writer_t::IO_URING_BACKEND, 8);
+	writer->open(output.file_name(0));
+
+	bool is_io_uring_available = file_writer_t::is_io_uring_available();
+	BOOST_CHECK_EQUAL( writer->get_backend(), is_io_uring_available
+					   ? file_writer_t::IO_URING_BACKEND : file_writer_t::POSIX_BACKEND );
+
+	// Full buffer is submitted right away, its completion is reaped only by the next call
+	writer->append("0123456\n", 8);
+	BOOST_CHECK_EQUAL( writer->get_in_flight_bytes(), is_io_uring_available ? 8 : 0 );
+
+	const std::string data = "0123456789abcdefghij\n";
+	for (int i = 0; i < 10; ++i) {
+		writer->append(data.data(), data.size());
+	}
+	writer->sync();
+	BOOST_CHECK_EQUAL( writer->get_in_flight_bytes(), 0 );
+	writer->close();
+
+	std::vector<std::string> lines = output.read_lines(0);
+	BOOST_REQUIRE_EQUAL( lines.size(), 11 );
+	BOOST_CHECK_EQUAL( lines[0], "0123456" );
+	BOOST_CHECK_EQUAL( lines[10], "0123456789abcdefghij" );
+}
+
+BOOST_AUTO_TEST_CASE( file_aggregator_open_error_test )
+{
+	BOOST_CHECK_THROW( file_aggregator_t aggregator("/nonexistent_react_directory/trees"),
+					   std::runtime_error );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
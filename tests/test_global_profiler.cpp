@@ -0,0 +1,239 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+#include "tests.hpp"
+
+#include "react/global_profiler.hpp"
+
+BOOST_AUTO_TEST_SUITE( global_profiler_suite )
+
+using namespace react;
+
+bool wait_for_dumps(size_t dumps_count) {
+	for (int i = 0; i < 500; ++i) {
+		if (global_profiler_t::get_profiler().get_dumps_count() >= dumps_count) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return false;
+}
+
+std::string read_file(const std::string &path) {
+	std::ifstream input(path);
+	std::stringstream content;
+	content << input.rdbuf();
+	return content.str();
+}
+
+BOOST_AUTO_TEST_CASE( global_profiler_environment_test )
+{
+	setenv("REACT_OUTPUT", "env.react", 1);
+	setenv("REACT_INTERVAL", "250", 1);
+	setenv("REACT_CONTINUOUS", "on", 1);
+	setenv("REACT_FORMAT", "folded", 1);
+	global_profiler_t::options_t options = global_profiler_t::read_environment(global_profiler_t::options_t());
+	BOOST_CHECK_EQUAL( options.output_path, "env.react" );
+	BOOST_CHECK_EQUAL( options.refresh_interval, 250 );
+	BOOST_CHECK( options.continuous );
+	BOOST_CHECK_EQUAL( options.format, +global_profiler_t::FOLDED_OUTPUT );
+
+	setenv("REACT_INTERVAL", "often", 1);
+	setenv("REACT_FORMAT", "xml", 1);
+	options = global_profiler_t::read_environment(global_profiler_t::options_t());
+	BOOST_CHECK_EQUAL( options.refresh_interval, global_profiler_t::options_t().refresh_interval );
+	BOOST_CHECK_EQUAL( options.format, global_profiler_t::options_t().format );
+
+	unsetenv("REACT_OUTPUT");
+	unsetenv("REACT_INTERVAL");
+	unsetenv("REACT_CONTINUOUS");
+	unsetenv("REACT_FORMAT");
+}
+
+BOOST_AUTO_TEST_CASE( global_profiler_dump_test )
+{
+	global_profiler_t &profiler = global_profiler_t::get_profiler();
+	global_profiler_t::options_t default_options = profiler.get_options();
+
+	global_profiler_t::options_t options;
+	options.output_path = "global_profiler_test_" + std::to_string(static_cast<long long>(getpid())) + ".react";
+	options.format = global_profiler_t::ALL_OUTPUT;
+	profiler.configure(options);
+	BOOST_CHECK_EQUAL( profiler.get_options().output_path, options.output_path );
+
+	global_profiler_t::options_t invalid_options;
+	invalid_options.refresh_interval = 0;
+	BOOST_CHECK_THROW( profiler.configure(invalid_options), std::invalid_argument );
+
+	{
+		PROFILE_BLOCK_GLOBAL(GLOBAL_PROFILER_DUMP_TEST);
+	}
+
+	size_t dumps_count = profiler.get_dumps_count();
+	profiler.request_dump();
+	BOOST_REQUIRE( wait_for_dumps(dumps_count + 1) );
+	BOOST_CHECK( read_file(options.output_path).find("GLOBAL_PROFILER_DUMP_TEST") != std::string::npos );
+	BOOST_CHECK( read_file(options.output_path + ".folded").find("GLOBAL_PROFILER_DUMP_TEST") != std::string::npos );
+
+	std::remove(options.output_path.c_str());
+	profiler.install_dump_signal(SIGUSR2);
+	raise(SIGUSR2);
+	BOOST_REQUIRE( wait_for_dumps(dumps_count + 2) );
+	BOOST_CHECK( read_file(options.output_path).find("GLOBAL_PROFILER_DUMP_TEST") != std::string::npos );
+
+	profiler.uninstall_dump_signal();
+	struct sigaction action;
+	BOOST_REQUIRE_EQUAL( sigaction(SIGUSR2, NULL, &action), 0 );
+	BOOST_CHECK( action.sa_handler == SIG_DFL );
+
+	std::remove(options.output_path.c_str());
+	std::remove((options.output_path + ".folded").c_str());
+	profiler.configure(default_options);
+}
+
+void merged_function() {
+	PROFILE_FUNC_GLOBAL();
+	{
+		PROFILE_BLOCK_GLOBAL(MERGED_BLOCK);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( global_profiler_merge_paths_test )
+{
+	global_profiler_t &profiler = global_profiler_t::get_profiler();
+	global_profiler_t::options_t default_options = profiler.get_options();
+
+	global_profiler_t::options_t options;
+	options.output_path = "global_profiler_merge_test_" + std::to_string(static_cast<long long>(getpid())) + ".react";
+	options.merge_paths = true;
+	profiler.configure(options);
+	BOOST_CHECK( profiler.is_merging_paths() );
+
+	size_t call_tree_size = print_json_to_string(profiler.copy_call_tree()).size();
+	for (int i = 0; i < 3; ++i) {
+		merged_function();
+	}
+	std::thread([]() { merged_function(); }).join();
+
+	// Merged calls do not grow call tree
+	BOOST_CHECK_EQUAL( print_json_to_string(profiler.copy_call_tree()).size(), call_tree_size );
+
+	// Threads share paths of the same call sites
+	path_tree_t path_tree = profiler.copy_path_tree();
+	BOOST_CHECK_EQUAL( path_tree.size(), 2 );
+	const auto &links = path_tree.get_node_links(path_tree.root);
+	uint64_t calls = 0;
+	for (auto it = links.begin(); it != links.end(); ++it) {
+		calls += path_tree.get_histogram(it->second).get_count();
+		BOOST_CHECK_EQUAL( path_tree.get_node_links(it->second).size(), 1 );
+	}
+	BOOST_CHECK_EQUAL( calls, 4 );
+
+	// Short-lived threads add neither paths nor actions
+	int first_action_code = profiler.get_action_set().define_new_action("MERGE_PATHS_TEST_FIRST");
+	for (int i = 0; i < 50; ++i) {
+		std::thread([]() { merged_function(); }).join();
+	}
+	BOOST_CHECK_EQUAL( profiler.copy_path_tree().size(), 2 );
+	BOOST_CHECK_EQUAL( profiler.get_action_set().define_new_action("MERGE_PATHS_TEST_LAST"), first_action_code + 1 );
+
+	size_t dumps_count = profiler.get_dumps_count();
+	profiler.request_dump();
+	BOOST_REQUIRE( wait_for_dumps(dumps_count + 1) );
+	std::string dump = read_file(options.output_path);
+	BOOST_CHECK( dump.find("MERGED_BLOCK") != std::string::npos );
+	BOOST_CHECK( dump.find("\"calls\": 54") != std::string::npos );
+
+	std::remove(options.output_path.c_str());
+	profiler.configure(default_options);
+	BOOST_CHECK( !profiler.is_merging_paths() );
+}
+
+BOOST_AUTO_TEST_CASE( global_profiler_lock_free_test )
+{
+	global_profiler_t &profiler = global_profiler_t::get_profiler();
+	global_profiler_t::options_t default_options = profiler.get_options();
+
+	global_profiler_t::options_t options;
+	options.output_path = "global_profiler_lock_free_test_" + std::to_string(static_cast<long long>(getpid())) + ".react";
+	options.lock_free = true;
+	profiler.configure(options);
+	BOOST_CHECK( profiler.is_lock_free() );
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 4; ++i) {
+		threads.push_back(std::thread([]() { merged_function(); }));
+	}
+	for (auto it = threads.begin(); it != threads.end(); ++it) {
+		it->join();
+	}
+
+	call_tree_t call_tree = profiler.copy_call_tree();
+	BOOST_CHECK_EQUAL( call_tree.get_node_links(call_tree.root).size(), 4 );
+
+	size_t dumps_count = profiler.get_dumps_count();
+	profiler.request_dump();
+	BOOST_REQUIRE( wait_for_dumps(dumps_count + 1) );
+	BOOST_CHECK( read_file(options.output_path).find("MERGED_BLOCK") != std::string::npos );
+
+	std::remove(options.output_path.c_str());
+	profiler.configure(default_options);
+	BOOST_CHECK( !profiler.is_lock_free() );
+}
+
+BOOST_AUTO_TEST_CASE( global_profiler_per_cpu_test )
+{
+	global_profiler_t &profiler = global_profiler_t::get_profiler();
+	global_profiler_t::options_t default_options = profiler.get_options();
+
+	global_profiler_t::options_t options;
+	options.output_path = "global_profiler_per_cpu_test_" + std::to_string(static_cast<long long>(getpid())) + ".react";
+	options.merge_paths = true;
+	options.per_cpu = true;
+	profiler.configure(options);
+	BOOST_CHECK( profiler.is_per_cpu() );
+
+	uint64_t initial_calls = 0;
+	path_tree_t initial_tree = profiler.copy_path_tree();
+	const auto &initial_links = initial_tree.get_node_links(initial_tree.root);
+	for (auto it = initial_links.begin(); it != initial_links.end(); ++it) {
+		initial_calls += initial_tree.get_histogram(it->second).get_count();
+	}
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 8; ++i) {
+		threads.push_back(std::thread([]() { merged_function(); }));
+	}
+	for (auto it = threads.begin(); it != threads.end(); ++it) {
+		it->join();
+	}
+
+	// Shards are summed at snapshot
+	uint64_t calls = 0;
+	path_tree_t path_tree = profiler.copy_path_tree();
+	const auto &links = path_tree.get_node_links(path_tree.root);
+	for (auto it = links.begin(); it != links.end(); ++it) {
+		calls += path_tree.get_histogram(it->second).get_count();
+	}
+	BOOST_CHECK_EQUAL( calls - initial_calls, 8 );
+
+	// Concurrent threads share one path per call site in every shard
+	threads.clear();
+	for (int i = 0; i < 200; ++i) {
+		threads.push_back(std::thread([]() { merged_function(); }));
+	}
+	for (auto it = threads.begin(); it != threads.end(); ++it) {
+		it->join();
+	}
+	BOOST_CHECK_EQUAL( profiler.copy_path_tree().size(), path_tree.size() );
+	BOOST_CHECK_LE( path_tree.size(), 2 );
+
+	std::remove(options.output_path.c_str());
+	profiler.configure(default_options);
+	BOOST_CHECK( !profiler.is_per_cpu() );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
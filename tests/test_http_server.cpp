@@ -0,0 +1,124 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "tests.hpp"
+
+#include "react/http_server.hpp"
+
+BOOST_AUTO_TEST_SUITE( http_server_suite )
+
+using namespace react;
+
+std::string http_request(int port, const std::string &request) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	BOOST_REQUIRE( fd >= 0 );
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+	BOOST_REQUIRE( connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 );
+	BOOST_REQUIRE( write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size()) );
+
+	std::string response;
+	char buffer[4096];
+	ssize_t size;
+	while ((size = read(fd, buffer, sizeof(buffer))) > 0) {
+		response.append(buffer, size);
+	}
+	close(fd);
+	return response;
+}
+
+std::string http_get(int port, const std::string &path) {
+	return http_request(port, "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+}
+
+BOOST_AUTO_TEST_CASE( http_server_routes_test )
+{
+	actions_set_t actions_set;
+	int ACTION_READ = actions_set.define_new_action("READ");
+
+	auto recent_trees = std::make_shared<recent_trees_aggregator_t>(2);
+	auto path_aggregator = std::make_shared<path_aggregator_t>(actions_set);
+	for (int i = 0; i < 3; ++i) {
+		call_tree_t call_tree(actions_set);
+		call_tree_t::p_node_t read = call_tree.add_new_link(call_tree.root, ACTION_READ);
+		call_tree.set_node_start_time(read, 0);
+		call_tree.set_node_stop_time(read, 100 * (i + 1));
+		call_tree.add_stat("request", i);
+		recent_trees->aggregate(call_tree);
+		path_aggregator->aggregate(call_tree);
+	}
+	BOOST_CHECK_EQUAL( recent_trees->get_trees().size(), 2 );
+
+	http_server_t server;
+	BOOST_REQUIRE( server.get_port() > 0 );
+	server.serve_recent_trees(recent_trees);
+	server.serve_path_statistics(path_aggregator);
+	server.add_route("/fail", []() -> std::string { throw std::runtime_error("handler failed"); });
+
+	std::string response = http_get(server.get_port(), "/call_tree?pretty=1");
+	BOOST_CHECK_EQUAL( response.compare(0, 15, "HTTP/1.1 200 OK"), 0 );
+	BOOST_CHECK( response.find("Content-Type: application/json") != std::string::npos );
+	BOOST_CHECK( response.find("{\"call_tree\":{\"react_aggregator\":[") != std::string::npos );
+	BOOST_CHECK( response.find("\"request\":0") == std::string::npos );
+	BOOST_CHECK( response.find("\"request\":2") != std::string::npos );
+
+	response = http_get(server.get_port(), "/paths");
+	BOOST_CHECK_EQUAL( response.compare(0, 15, "HTTP/1.1 200 OK"), 0 );
+	BOOST_CHECK( response.find("\"READ\"") != std::string::npos );
+	BOOST_CHECK( response.find("\"calls\": 3") != std::string::npos );
+
+	BOOST_CHECK_EQUAL( http_get(server.get_port(), "/missing").compare(0, 12, "HTTP/1.1 404"), 0 );
+	BOOST_CHECK_EQUAL( http_get(server.get_port(), "/fail").compare(0, 12, "HTTP/1.1 500"), 0 );
+	BOOST_CHECK_EQUAL( http_request(server.get_port(), "POST /paths HTTP/1.1\r\n\r\n").compare(0, 12, "HTTP/1.1 405"), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( http_server_rejects_large_request_test )
+{
+	http_server_t::options_t options;
+	options.max_request_size = 64;
+	http_server_t server(options);
+	server.add_route("/", []() { return std::string("{}"); });
+
+	BOOST_CHECK_EQUAL( http_get(server.get_port(), "/").compare(0, 15, "HTTP/1.1 200 OK"), 0 );
+	BOOST_CHECK_EQUAL( http_get(server.get_port(), "/" + std::string(128, 'a')).compare(0, 12, "HTTP/1.1 400"), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( http_server_drops_half_closed_connection_test )
+{
+	http_server_t server;
+	server.add_route("/", []() { return std::string("{}"); });
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	BOOST_REQUIRE( fd >= 0 );
+	timeval timeout;
+	timeout.tv_sec = 2;
+	timeout.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(server.get_port());
+	inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+	BOOST_REQUIRE( connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 );
+
+	std::string request = "GET / HTTP/1.1\r\nHost: local";
+	BOOST_REQUIRE( write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size()) );
+	BOOST_REQUIRE( shutdown(fd, SHUT_WR) == 0 );
+
+	// Server closes connection instead of waiting for the rest of request forever
+	char buffer[64];
+	BOOST_CHECK_EQUAL( read(fd, buffer, sizeof(buffer)), 0 );
+	close(fd);
+
+	BOOST_CHECK_EQUAL( http_get(server.get_port(), "/").compare(0, 15, "HTTP/1.1 200 OK"), 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
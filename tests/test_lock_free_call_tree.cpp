@@ -0,0 +1,128 @@
+#include <thread>
+#include <vector>
+
+#include "tests.hpp"
+
+#include "react/lock_free_call_tree.hpp"
+
+BOOST_AUTO_TEST_SUITE( lock_free_call_tree_suite )
+
+using namespace react;
+
+BOOST_AUTO_TEST_CASE( lock_free_find_or_add_link_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	lock_free_call_tree_t call_tree(actions_set);
+
+	std::vector<lock_free_call_tree_t::p_node_t> nodes(8);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		threads.push_back(std::thread([&call_tree, &nodes, action_code, i]() {
+			for (int j = 0; j < 1000; ++j) {
+				nodes[i] = call_tree.find_or_add_link(call_tree.get_root(), action_code);
+			}
+		}));
+	}
+	for (auto it = threads.begin(); it != threads.end(); ++it) {
+		it->join();
+	}
+
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		BOOST_CHECK_EQUAL( nodes[i], nodes[0] );
+	}
+	BOOST_CHECK_EQUAL( call_tree.find_link(call_tree.get_root(), action_code), nodes[0] );
+	BOOST_CHECK( nodes[0]->next_sibling == NULL );
+	BOOST_CHECK_THROW( call_tree.find_or_add_link(call_tree.get_root(), actions_set_t::NO_ACTION),
+					   std::invalid_argument );
+}
+
+BOOST_AUTO_TEST_CASE( lock_free_add_new_link_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	lock_free_call_tree_t call_tree(actions_set);
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 4; ++i) {
+		threads.push_back(std::thread([&call_tree, action_code]() {
+			for (int j = 0; j < 3000; ++j) {
+				call_tree.add_new_link(call_tree.get_root(), action_code);
+			}
+		}));
+	}
+	for (auto it = threads.begin(); it != threads.end(); ++it) {
+		it->join();
+	}
+
+	BOOST_CHECK_EQUAL( call_tree.size(), 12001 );
+	call_tree_t copy(actions_set);
+	call_tree.copy_to(copy);
+	BOOST_CHECK_EQUAL( copy.get_node_links(copy.root).size(), 12000 );
+}
+
+BOOST_AUTO_TEST_CASE( lock_free_updater_test )
+{
+	actions_set_t actions_set;
+	int ACTION_READ = actions_set.define_new_action("READ");
+	int ACTION_FIND = actions_set.define_new_action("FIND");
+	lock_free_call_tree_t call_tree(actions_set);
+	lock_free_updater_t updater(call_tree);
+
+	for (int i = 0; i < 3; ++i) {
+		updater.start(ACTION_READ, true);
+		updater.start(ACTION_FIND);
+		updater.stop(ACTION_FIND);
+		updater.stop(ACTION_READ);
+	}
+	updater.start(ACTION_FIND, true);
+	BOOST_CHECK_THROW( updater.stop(ACTION_READ), std::logic_error );
+	BOOST_CHECK_EQUAL( updater.get_depth(), 1 );
+	updater.stop(ACTION_FIND);
+	BOOST_CHECK_THROW( updater.stop(ACTION_FIND), std::logic_error );
+
+	call_tree_t copy(actions_set);
+	call_tree.copy_to(copy);
+	const auto &links = copy.get_node_links(copy.root);
+	BOOST_REQUIRE_EQUAL( links.size(), 2 );
+	// Children are copied in creation order
+	BOOST_CHECK_EQUAL( copy.get_node_action_code(links[0].second), ACTION_READ );
+	BOOST_CHECK_EQUAL( copy.get_node_action_code(links[1].second), ACTION_FIND );
+	BOOST_CHECK_EQUAL( copy.get_node_links(links[0].second).size(), 3 );
+	BOOST_CHECK( copy.get_node_stop_time(links[0].second) >= copy.get_node_start_time(links[0].second) );
+}
+
+BOOST_AUTO_TEST_CASE( lock_free_overflow_test )
+{
+	actions_set_t actions_set;
+	int ACTION_READ = actions_set.define_new_action("READ");
+	int ACTION_FIND = actions_set.define_new_action("FIND");
+	lock_free_call_tree_t call_tree(actions_set, 3);
+	lock_free_updater_t updater(call_tree);
+
+	// Root and two links fit, the rest share overflow node
+	for (int i = 0; i < 3; ++i) {
+		updater.start(ACTION_READ);
+		updater.start(ACTION_FIND, true);
+		updater.stop(ACTION_FIND);
+		updater.stop(ACTION_READ);
+	}
+	BOOST_CHECK_EQUAL( call_tree.add_new_link(call_tree.get_root(), ACTION_READ), call_tree.get_overflow_node() );
+	BOOST_CHECK_EQUAL( call_tree.size(), 3 );
+	BOOST_CHECK_EQUAL( call_tree.get_dropped_count(), 5 );
+
+	// Actions of dropped links are still validated
+	updater.start(ACTION_READ);
+	BOOST_CHECK_THROW( updater.stop(ACTION_FIND), std::logic_error );
+	updater.stop(ACTION_READ);
+	BOOST_CHECK_EQUAL( updater.get_depth(), 0 );
+
+	call_tree_t copy(actions_set);
+	call_tree.copy_to(copy);
+	const auto &links = copy.get_node_links(copy.root);
+	BOOST_REQUIRE_EQUAL( links.size(), 1 );
+	BOOST_CHECK_EQUAL( copy.get_node_action_code(links[0].second), ACTION_READ );
+	BOOST_CHECK_EQUAL( copy.get_node_links(links[0].second).size(), 1 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,87 @@
+#include <thread>
+
+#include "tests.hpp"
+
+#include "react/path_aggregator.hpp"
+
+BOOST_AUTO_TEST_SUITE( path_aggregator_suite )
+
+using namespace react;
+
+BOOST_AUTO_TEST_CASE( histogram_test )
+{
+	histogram_t histogram;
+	BOOST_CHECK_EQUAL( histogram.get_quantile(0.5), 0 );
+
+	for (int i = 1; i <= 1000; ++i) {
+		histogram.add(i);
+	}
+
+	BOOST_CHECK_EQUAL( histogram.get_count(), 1000 );
+	BOOST_CHECK_EQUAL( histogram.get_sum(), 500500 );
+	BOOST_CHECK_EQUAL( histogram.get_min(), 1 );
+	BOOST_CHECK_EQUAL( histogram.get_max(), 1000 );
+	BOOST_CHECK_CLOSE( static_cast<double>(histogram.get_quantile(0.5)), 500, 100. / 32 );
+	BOOST_CHECK_CLOSE( static_cast<double>(histogram.get_quantile(0.99)), 990, 100. / 32 );
+	BOOST_CHECK_EQUAL( histogram.get_quantile(1), 1000 );
+
+	histogram_t other;
+	other.add(1 << 20, 1000);
+	histogram.merge(other);
+	BOOST_CHECK_EQUAL( histogram.get_count(), 2000 );
+	BOOST_CHECK_EQUAL( histogram.get_max(), 1 << 20 );
+	BOOST_CHECK_CLOSE( static_cast<double>(histogram.get_quantile(0.75)), 1 << 20, 100. / 32 );
+}
+
+BOOST_AUTO_TEST_CASE( path_aggregator_test )
+{
+	actions_set_t actions_set;
+	int ACTION_READ = actions_set.define_new_action("READ");
+	int ACTION_FIND = actions_set.define_new_action("FIND");
+
+	path_aggregator_t aggregator(actions_set, 4);
+
+	auto aggregate_trees = [&]() {
+		for (int i = 1; i <= 100; ++i) {
+			call_tree_t call_tree(actions_set);
+			call_tree_t::p_node_t read = call_tree.add_new_link(call_tree.root, ACTION_READ);
+			call_tree.set_node_start_time(read, 0);
+			call_tree.set_node_stop_time(read, 10 * i);
+			for (int j = 0; j < 2; ++j) {
+				call_tree_t::p_node_t find = call_tree.add_new_link(read, ACTION_FIND);
+				call_tree.set_node_start_time(find, 0);
+				call_tree.set_node_stop_time(find, i);
+			}
+			call_tree_t::p_node_t find = call_tree.add_new_link(call_tree.root, ACTION_FIND);
+			call_tree.set_node_stop_time(find, 1);
+			aggregator.aggregate(call_tree);
+		}
+	};
+
+	std::thread thread(aggregate_trees);
+	aggregate_trees();
+	thread.join();
+
+	histogram_t read = aggregator.get_histogram({ACTION_READ});
+	BOOST_CHECK_EQUAL( read.get_count(), 200 );
+	BOOST_CHECK_EQUAL( read.get_max(), 1000 );
+	BOOST_CHECK_CLOSE( static_cast<double>(read.get_quantile(0.5)), 500, 100. / 32 );
+
+	histogram_t read_find = aggregator.get_histogram({ACTION_READ, ACTION_FIND});
+	BOOST_CHECK_EQUAL( read_find.get_count(), 400 );
+	BOOST_CHECK_EQUAL( read_find.get_sum(), 2 * 2 * 5050 );
+
+	BOOST_CHECK_EQUAL( aggregator.get_histogram({ACTION_FIND}).get_count(), 200 );
+	BOOST_CHECK_EQUAL( aggregator.get_histogram({ACTION_FIND, ACTION_READ}).get_count(), 0 );
+	BOOST_CHECK_EQUAL( aggregator.get_path_tree().size(), 3 );
+
+	std::string json = print_json_to_string(aggregator);
+	BOOST_CHECK( json.find("\"name\": \"READ\"") != std::string::npos );
+	BOOST_CHECK( json.find("\"calls\": 400") != std::string::npos );
+	BOOST_CHECK( json.find("\"99%\"") != std::string::npos );
+
+	aggregator.clear();
+	BOOST_CHECK_EQUAL( aggregator.get_path_tree().size(), 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
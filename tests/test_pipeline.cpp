@@ -0,0 +1,117 @@
+#include "tests.hpp"
+
+#include "react/pipeline.hpp"
+
+BOOST_AUTO_TEST_SUITE( pipeline_suite )
+
+using namespace react;
+
+struct counting_aggregator_t : public aggregator_t {
+	void aggregate(const call_tree_t &call_tree) {
+		copied_trees.push_back(std::make_shared<call_tree_t>(call_tree));
+	}
+
+	void aggregate_handle(call_tree_handle_t call_tree) {
+		handles.push_back(call_tree);
+	}
+
+	std::vector<call_tree_handle_t> copied_trees;
+	std::vector<call_tree_handle_t> handles;
+};
+
+struct request_tree {
+	request_tree(): call_tree(std::make_shared<call_tree_t>(actions_set)) {
+		ACTION_READ = actions_set.define_new_action("READ");
+		ACTION_FIND = actions_set.define_new_action("FIND");
+		ACTION_LOCK = actions_set.define_new_action("LOCK");
+
+		call_tree_t::p_node_t read = add_node(call_tree->root, ACTION_READ, 0, 1000);
+		call_tree_t::p_node_t find = add_node(read, ACTION_FIND, 10, 900);
+		add_node(find, ACTION_LOCK, 20, 25);
+		add_node(read, ACTION_LOCK, 900, 905);
+		call_tree->add_stat("status", "ok");
+	}
+
+	call_tree_t::p_node_t add_node(call_tree_t::p_node_t parent, int action_code,
+								   int64_t start_time, int64_t stop_time) {
+		call_tree_t::p_node_t node = call_tree->add_new_link(parent, action_code);
+		call_tree->set_node_start_time(node, start_time);
+		call_tree->set_node_stop_time(node, stop_time);
+		return node;
+	}
+
+	actions_set_t actions_set;
+	std::shared_ptr<call_tree_t> call_tree;
+	int ACTION_READ;
+	int ACTION_FIND;
+	int ACTION_LOCK;
+};
+
+BOOST_AUTO_TEST_CASE( tee_aggregator_test )
+{
+	request_tree tree;
+	std::shared_ptr<counting_aggregator_t> first = std::make_shared<counting_aggregator_t>();
+	std::shared_ptr<counting_aggregator_t> second = std::make_shared<counting_aggregator_t>();
+
+	tee_aggregator_t tee({first, second});
+	tee.aggregate_handle(tree.call_tree);
+
+	BOOST_REQUIRE_EQUAL( first->handles.size(), 1 );
+	BOOST_REQUIRE_EQUAL( second->handles.size(), 1 );
+	BOOST_CHECK_EQUAL( first->handles[0].get(), tree.call_tree.get() );
+	BOOST_CHECK_EQUAL( second->handles[0].get(), tree.call_tree.get() );
+}
+
+BOOST_AUTO_TEST_CASE( filter_aggregator_test )
+{
+	request_tree tree;
+	std::shared_ptr<counting_aggregator_t> sink = std::make_shared<counting_aggregator_t>();
+
+	filter_aggregator_t status_filter(sink, filter_aggregator_t::stat_equals("status", std::string("ok")));
+	status_filter.aggregate_handle(tree.call_tree);
+	filter_aggregator_t root_filter(sink, filter_aggregator_t::root_action_is(tree.ACTION_FIND));
+	root_filter.aggregate_handle(tree.call_tree);
+	filter_aggregator_t stat_filter(sink, filter_aggregator_t::has_stat("error"));
+	stat_filter.aggregate(*tree.call_tree);
+
+	BOOST_CHECK_EQUAL( sink->handles.size(), 1 );
+	BOOST_CHECK( sink->copied_trees.empty() );
+}
+
+BOOST_AUTO_TEST_CASE( sampling_aggregator_test )
+{
+	request_tree tree;
+	std::shared_ptr<counting_aggregator_t> sink = std::make_shared<counting_aggregator_t>();
+
+	sampling_aggregator_t sampler(sink, 0.25);
+	for (int i = 0; i < 100; ++i) {
+		sampler.aggregate_handle(tree.call_tree);
+	}
+	BOOST_CHECK_EQUAL( sink->handles.size(), 25 );
+}
+
+BOOST_AUTO_TEST_CASE( transform_aggregator_test )
+{
+	request_tree tree;
+	std::shared_ptr<counting_aggregator_t> sink = std::make_shared<counting_aggregator_t>();
+
+	transform_aggregator_t::options_t options;
+	options.max_depth = 2;
+	options.min_duration = 10;
+	transform_aggregator_t transform(sink, options);
+	transform.aggregate(*tree.call_tree);
+
+	BOOST_REQUIRE_EQUAL( sink->handles.size(), 1 );
+	const call_tree_t &result = *sink->handles[0];
+	BOOST_CHECK_EQUAL( result.get_stat<std::string>("status"), "ok" );
+	BOOST_CHECK_EQUAL( result.get_stat<int>("pruned_actions"), 2 );
+
+	const auto &root_links = result.get_node_links(result.root);
+	BOOST_REQUIRE_EQUAL( root_links.size(), 1 );
+	const auto &read_links = result.get_node_links(root_links[0].second);
+	BOOST_REQUIRE_EQUAL( read_links.size(), 1 );
+	BOOST_CHECK_EQUAL( read_links[0].first, tree.ACTION_FIND );
+	BOOST_CHECK( result.get_node_links(read_links[0].second).empty() );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
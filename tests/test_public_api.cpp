@@ -1,10 +1,27 @@
+#include <thread>
+
 #include "tests.hpp"
 
 #include "react/react.hpp"
 #include "react/actions_set.hpp"
+#include "react/flight_recorder.hpp"
 
 BOOST_AUTO_TEST_SUITE( public_api_suite )
 
+class handle_aggregator_t : public react::aggregator_t {
+public:
+	void aggregate(const react::call_tree_t &call_tree) {
+		copied_trees.push_back(std::make_shared<react::call_tree_t>(call_tree));
+	}
+
+	void aggregate_handle(react::call_tree_handle_t call_tree) {
+		handles.push_back(call_tree);
+	}
+
+	std::vector<react::call_tree_handle_t> copied_trees;
+	std::vector<react::call_tree_handle_t> handles;
+};
+
 BOOST_AUTO_TEST_CASE( react_define_new_action_test )
 {
 	int action_code = react_define_new_action("ACTION");
@@ -229,6 +246,429 @@ BOOST_AUTO_TEST_CASE( react_create_subthread_aggregator_test )
 	react_deactivate();
 }
 
+BOOST_AUTO_TEST_CASE( react_deactivate_moves_call_tree_test )
+{
+	handle_aggregator_t aggregator;
+	int action_code = react_define_new_action("ACTION");
+
+	react_activate(&aggregator);
+	react_start_action(action_code);
+	react_stop_action(action_code);
+	react_submit_progress();
+	react_deactivate();
+
+	BOOST_REQUIRE_EQUAL( aggregator.copied_trees.size(), 1 );
+	BOOST_CHECK( !aggregator.copied_trees[0]->get_stat<bool>("complete") );
+
+	BOOST_REQUIRE_EQUAL( aggregator.handles.size(), 1 );
+	const react::call_tree_t &call_tree = *aggregator.handles[0];
+	BOOST_CHECK_EQUAL( aggregator.handles[0].use_count(), 1 );
+	BOOST_CHECK( call_tree.get_stat<bool>("complete") );
+	BOOST_REQUIRE_EQUAL( call_tree.get_node_links(call_tree.root).size(), 1 );
+	BOOST_CHECK_EQUAL( call_tree.get_node_links(call_tree.root)[0].first, action_code );
+}
+
+BOOST_AUTO_TEST_CASE( subthread_aggregator_merge_test )
+{
+	handle_aggregator_t aggregator;
+	int action_code = react_define_new_action("ACTION");
+	int subthread_action_code = react_define_new_action("SUBTHREAD_ACTION");
+
+	react_activate(&aggregator);
+	react_start_action(action_code);
+	{
+		std::shared_ptr<react::aggregator_t> subthread_aggregator = react::create_subthread_aggregator();
+		std::thread subthread([&] () {
+			react_activate(subthread_aggregator.get());
+			react_start_action(subthread_action_code);
+			react_stop_action(subthread_action_code);
+			react_deactivate();
+		});
+		subthread.join();
+	}
+	react_stop_action(action_code);
+	react_deactivate();
+
+	BOOST_REQUIRE_EQUAL( aggregator.handles.size(), 1 );
+	const react::call_tree_t &call_tree = *aggregator.handles[0];
+	const react::node_t::Container &links = call_tree.get_node_links(call_tree.root);
+	BOOST_REQUIRE_EQUAL( links.size(), 1 );
+	const react::node_t::Container &subthread_links = call_tree.get_node_links(links[0].second);
+	BOOST_REQUIRE_EQUAL( subthread_links.size(), 1 );
+	BOOST_CHECK_EQUAL( subthread_links[0].first, subthread_action_code );
+}
+
+BOOST_AUTO_TEST_CASE( context_handoff_test )
+{
+	handle_aggregator_t aggregator;
+	int action_code = react_define_new_action("ACTION");
+	int worker_action_code = react_define_new_action("WORKER_ACTION");
+
+	react_activate(&aggregator);
+	react_start_action(action_code);
+	std::shared_ptr<react::context_token_t> token = react::capture_context();
+	void *c_token = react_capture_context();
+	BOOST_REQUIRE( c_token != NULL );
+	std::thread worker([&] () {
+		react::attach_context(token);
+		BOOST_CHECK( react_is_active() );
+		react_start_action(worker_action_code);
+		react_stop_action(worker_action_code);
+		react::detach_context(token);
+		BOOST_CHECK( !react_is_active() );
+		BOOST_CHECK_THROW( react::attach_context(token), std::logic_error );
+
+		BOOST_CHECK_EQUAL( react_attach_context(c_token), 0 );
+		BOOST_CHECK_EQUAL( react_detach_context(c_token), 0 );
+	});
+	worker.join();
+
+	// Cancelled work item releases its token without recording anything
+	void *cancelled_token = react_capture_context();
+	BOOST_CHECK_EQUAL( react_release_context(cancelled_token), 0 );
+
+	react_stop_action(action_code);
+	react_deactivate();
+
+	BOOST_CHECK( react_capture_context() == NULL );
+	BOOST_CHECK_EQUAL( react_attach_context(NULL), 0 );
+	BOOST_CHECK_EQUAL( react_release_context(NULL), 0 );
+
+	BOOST_REQUIRE_EQUAL( aggregator.handles.size(), 1 );
+	const react::call_tree_t &call_tree = *aggregator.handles[0];
+	const react::node_t::Container &links = call_tree.get_node_links(call_tree.root);
+	BOOST_REQUIRE_EQUAL( links.size(), 1 );
+	const react::node_t::Container &worker_links = call_tree.get_node_links(links[0].second);
+	BOOST_REQUIRE_EQUAL( worker_links.size(), 3 );
+	int queue_wait_action_code = react_define_new_action("queue_wait");
+	BOOST_CHECK_EQUAL( worker_links[0].first, queue_wait_action_code );
+	BOOST_CHECK_EQUAL( worker_links[1].first, worker_action_code );
+	BOOST_CHECK_EQUAL( worker_links[2].first, queue_wait_action_code );
+	BOOST_CHECK( call_tree.get_node_stop_time(worker_links[0].second) >=
+				 call_tree.get_node_start_time(worker_links[0].second) );
+}
+
+BOOST_AUTO_TEST_CASE( context_handoff_grafts_worker_inbox_test )
+{
+	handle_aggregator_t aggregator;
+	int action_code = react_define_new_action("ACTION");
+	int span_action_code = react_define_new_action("SPAN");
+
+	react_activate(&aggregator);
+	react_start_action(action_code);
+	std::shared_ptr<react::context_token_t> token = react::capture_context();
+	std::thread worker([&] () {
+		react::attach_context(token);
+		std::shared_ptr<react::async_span_t> span = react::start_async(span_action_code);
+		react::stop_async(span);
+		react::detach_context(token);
+	});
+	worker.join();
+	react_stop_action(action_code);
+	react_deactivate();
+
+	BOOST_REQUIRE_EQUAL( aggregator.handles.size(), 1 );
+	const react::call_tree_t &call_tree = *aggregator.handles[0];
+	const react::node_t::Container &links = call_tree.get_node_links(call_tree.root);
+	BOOST_REQUIRE_EQUAL( links.size(), 1 );
+	const react::node_t::Container &worker_links = call_tree.get_node_links(links[0].second);
+	BOOST_REQUIRE_EQUAL( worker_links.size(), 2 );
+	BOOST_CHECK_EQUAL( worker_links[1].first, span_action_code );
+	BOOST_CHECK( call_tree.get_node_stop_time(worker_links[1].second) > 0 );
+	BOOST_CHECK( call_tree.get_node_stop_time(worker_links[1].second) >=
+				 call_tree.get_node_start_time(worker_links[1].second) );
+}
+
+BOOST_AUTO_TEST_CASE( suspend_resume_context_test )
+{
+	handle_aggregator_t aggregator;
+	int first_action_code = react_define_new_action("FIRST_REQUEST");
+	int second_action_code = react_define_new_action("SECOND_REQUEST");
+
+	react_activate(&aggregator);
+	react_start_action(first_action_code);
+	void *first_context = NULL;
+	BOOST_CHECK_EQUAL( react_suspend_context(&first_context), 0 );
+	BOOST_REQUIRE( first_context != NULL );
+	BOOST_CHECK( !react_is_active() );
+
+	react_activate(&aggregator);
+	react_start_action(second_action_code);
+	{
+		boost::test_tools::output_test_stream error_output;
+		cerr_redirect guard(error_output.rdbuf());
+		BOOST_CHECK_EQUAL( react_resume_context(first_context), -EINVAL );
+		BOOST_CHECK( !error_output.is_empty() );
+	}
+	void *second_context = NULL;
+	BOOST_CHECK_EQUAL( react_suspend_context(&second_context), 0 );
+
+	std::thread other_thread([&] () {
+		BOOST_CHECK_EQUAL( react_resume_context(first_context), 0 );
+		react_stop_action(first_action_code);
+		react_deactivate();
+	});
+	other_thread.join();
+
+	BOOST_CHECK_EQUAL( react_resume_context(second_context), 0 );
+	react_stop_action(second_action_code);
+	react_deactivate();
+	BOOST_CHECK( !react_is_active() );
+	void *no_context = &aggregator;
+	BOOST_CHECK_EQUAL( react_suspend_context(&no_context), 0 );
+	BOOST_CHECK( no_context == NULL );
+
+	BOOST_REQUIRE_EQUAL( aggregator.handles.size(), 2 );
+	for (int i = 0; i < 2; ++i) {
+		const react::call_tree_t &call_tree = *aggregator.handles[i];
+		const react::node_t::Container &links = call_tree.get_node_links(call_tree.root);
+		BOOST_REQUIRE_EQUAL( links.size(), 1 );
+		BOOST_CHECK_EQUAL( links[0].first, i == 0 ? first_action_code : second_action_code );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( discard_suspended_context_test )
+{
+	handle_aggregator_t aggregator;
+	int action_code = react_define_new_action("ABANDONED_REQUEST");
+
+	react_activate(&aggregator);
+	react_start_action(action_code);
+	void *react_context = NULL;
+	BOOST_CHECK_EQUAL( react_suspend_context(&react_context), 0 );
+	BOOST_REQUIRE( react_context != NULL );
+	{
+		// Abandoned request is discarded silently, even with started actions
+		boost::test_tools::output_test_stream error_output;
+		cerr_redirect guard(error_output.rdbuf());
+		BOOST_CHECK_EQUAL( react_discard_context(react_context), 0 );
+		BOOST_CHECK_EQUAL( react_discard_context(NULL), 0 );
+		BOOST_CHECK( error_output.is_empty() );
+	}
+	BOOST_CHECK( !react_is_active() );
+	BOOST_CHECK( aggregator.handles.empty() );
+	BOOST_CHECK( aggregator.copied_trees.empty() );
+
+	// Flight recorder context is reported as not suspendable and stays active
+	react_activate_flight_recorder(&aggregator, 0);
+	react_context = &aggregator;
+	BOOST_CHECK_EQUAL( react_suspend_context(&react_context), -ENOTSUP );
+	BOOST_CHECK( react_context == NULL );
+	BOOST_CHECK( react_is_active() );
+	BOOST_CHECK_EQUAL( react_deactivate(), 0 );
+	BOOST_CHECK_EQUAL( aggregator.handles.size(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( coroutine_context_test )
+{
+	handle_aggregator_t aggregator;
+	int action_code = react_define_new_action("COROUTINE_ACTION");
+
+	react::coroutine_context_t context;
+	react_activate(&aggregator);
+	react_start_action(action_code);
+	context.suspend();
+	BOOST_CHECK( context.is_suspended() );
+	BOOST_CHECK( !react_is_active() );
+
+	std::thread resuming_thread([&] () {
+		context.resume();
+		BOOST_CHECK( !context.is_suspended() );
+		react_stop_action(action_code);
+		react_deactivate();
+	});
+	resuming_thread.join();
+
+	BOOST_REQUIRE_EQUAL( aggregator.handles.size(), 1 );
+	const react::call_tree_t &call_tree = *aggregator.handles[0];
+	const react::node_t::Container &links = call_tree.get_node_links(call_tree.root);
+	BOOST_REQUIRE_EQUAL( links.size(), 1 );
+	const react::node_t::Container &suspended_links = call_tree.get_node_links(links[0].second);
+	BOOST_REQUIRE_EQUAL( suspended_links.size(), 1 );
+	BOOST_CHECK_EQUAL( suspended_links[0].first, react_define_new_action("suspended") );
+	BOOST_CHECK( call_tree.get_node_stop_time(suspended_links[0].second) <=
+				 call_tree.get_node_stop_time(links[0].second) );
+
+	// Suspension without active context is no-op
+	context.suspend();
+	BOOST_CHECK( !context.is_suspended() );
+	context.resume();
+}
+
+BOOST_AUTO_TEST_CASE( async_span_test )
+{
+	handle_aggregator_t aggregator;
+	int action_code = react_define_new_action("ACTION");
+	int read_action_code = react_define_new_action("ASYNC_READ");
+	int write_action_code = react_define_new_action("ASYNC_WRITE");
+
+	react_activate(&aggregator);
+	react_start_action(action_code);
+	std::shared_ptr<react::async_span_t> read_span = react::start_async(read_action_code);
+	void *write_span = react_start_async(write_action_code);
+	BOOST_REQUIRE( write_span != NULL );
+	react_stop_action(action_code);
+
+	// Spans are stopped out of order from another thread
+	std::thread([&] () {
+		BOOST_CHECK_EQUAL( react_stop_async(write_span), 0 );
+		react::stop_async(read_span);
+		BOOST_CHECK_THROW( react::stop_async(read_span), std::logic_error );
+	}).join();
+	react_deactivate();
+
+	BOOST_CHECK( !react::start_async(read_action_code) );
+	BOOST_CHECK( react_start_async(read_action_code) == NULL );
+
+	BOOST_REQUIRE_EQUAL( aggregator.handles.size(), 1 );
+	const react::call_tree_t &call_tree = *aggregator.handles[0];
+	const react::node_t::Container &links = call_tree.get_node_links(call_tree.root);
+	BOOST_REQUIRE_EQUAL( links.size(), 1 );
+	const react::node_t::Container &span_links = call_tree.get_node_links(links[0].second);
+	BOOST_REQUIRE_EQUAL( span_links.size(), 2 );
+	BOOST_CHECK_EQUAL( span_links[0].first, read_action_code );
+	BOOST_CHECK_EQUAL( span_links[1].first, write_action_code );
+	for (auto it = span_links.begin(); it != span_links.end(); ++it) {
+		BOOST_CHECK( call_tree.get_node_stop_time(it->second) >= call_tree.get_node_stop_time(links[0].second) );
+		BOOST_CHECK( call_tree.get_node_start_time(it->second) >= call_tree.get_node_start_time(links[0].second) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( subthread_aggregator_deferred_graft_test )
+{
+	handle_aggregator_t aggregator;
+	int action_code = react_define_new_action("ACTION");
+	int subthread_action_code = react_define_new_action("SUBTHREAD_ACTION");
+
+	react_activate(&aggregator);
+	react_start_action(action_code);
+	std::shared_ptr<react::aggregator_t> subthread_aggregator = react::create_subthread_aggregator();
+	std::vector<std::thread> subthreads;
+	for (int i = 0; i < 8; ++i) {
+		subthreads.push_back(std::thread([&] () {
+			react_activate(subthread_aggregator.get());
+			react_start_action(subthread_action_code);
+			react_stop_action(subthread_action_code);
+			react_deactivate();
+		}));
+	}
+	for (auto it = subthreads.begin(); it != subthreads.end(); ++it) {
+		it->join();
+	}
+	react_stop_action(action_code);
+
+	// Subthread trees are grafted when parent submits progress
+	react_submit_progress();
+	BOOST_REQUIRE_EQUAL( aggregator.copied_trees.size(), 1 );
+	const react::call_tree_t &progress_tree = *aggregator.copied_trees[0];
+	const react::node_t::Container &links = progress_tree.get_node_links(progress_tree.root);
+	BOOST_REQUIRE_EQUAL( links.size(), 1 );
+	BOOST_CHECK_EQUAL( progress_tree.get_node_links(links[0].second).size(), 8 );
+
+	react_deactivate();
+	BOOST_REQUIRE_EQUAL( aggregator.handles.size(), 1 );
+	const react::call_tree_t &call_tree = *aggregator.handles[0];
+	BOOST_CHECK_EQUAL( call_tree.get_node_links(call_tree.get_node_links(call_tree.root)[0].second).size(), 8 );
+}
+
+BOOST_AUTO_TEST_CASE( flight_recorder_test )
+{
+	int ACTION_READ = react_define_new_action("READ");
+	int ACTION_FIND = react_define_new_action("FIND");
+	handle_aggregator_t aggregator;
+
+	auto run_request = [&](long long threshold, bool flag) {
+		react_activate_flight_recorder(&aggregator, threshold);
+		BOOST_CHECK( react_is_active() );
+		react_start_action(ACTION_READ);
+		{
+			react::action_guard guard(ACTION_FIND);
+		}
+		react_add_stat_int("size", 42);
+		if (flag) {
+			react_flag_request();
+		}
+		react_stop_action(ACTION_READ);
+		BOOST_CHECK_EQUAL( react_deactivate(), 0 );
+		BOOST_CHECK( !react_is_active() );
+	};
+
+	run_request(1000000000LL, false);
+	BOOST_CHECK( aggregator.handles.empty() );
+
+	run_request(1000000000LL, true);
+	run_request(0, false);
+	BOOST_REQUIRE_EQUAL( aggregator.handles.size(), 2 );
+	BOOST_CHECK( aggregator.copied_trees.empty() );
+
+	const react::call_tree_t &call_tree = *aggregator.handles[0];
+	BOOST_CHECK_EQUAL( call_tree.get_stat<int>("size"), 42 );
+	BOOST_CHECK( call_tree.get_stat<bool>("flagged") );
+	BOOST_CHECK( call_tree.get_stat<bool>("complete") );
+
+	const auto &root_links = call_tree.get_node_links(call_tree.root);
+	BOOST_REQUIRE_EQUAL( root_links.size(), 1 );
+	BOOST_CHECK_EQUAL( root_links[0].first, ACTION_READ );
+	const auto &read_links = call_tree.get_node_links(root_links[0].second);
+	BOOST_REQUIRE_EQUAL( read_links.size(), 1 );
+	BOOST_CHECK_EQUAL( read_links[0].first, ACTION_FIND );
+	BOOST_CHECK( call_tree.get_node_start_time(read_links[0].second) >=
+				 call_tree.get_node_start_time(root_links[0].second) );
+	BOOST_CHECK( !aggregator.handles[1]->has_stat("flagged") );
+}
+
+BOOST_AUTO_TEST_CASE( flight_recorder_truncation_test )
+{
+	react::actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	react::flight_recorder_t recorder(actions_set, 3);
+	recorder.reset();
+	recorder.start(action_code);
+	recorder.start(action_code);
+	recorder.stop(action_code);
+	recorder.stop(action_code);
+	BOOST_CHECK( recorder.truncated() );
+
+	react::call_tree_t call_tree(actions_set);
+	recorder.build_call_tree(call_tree);
+	BOOST_CHECK( call_tree.get_stat<bool>("truncated") );
+	const auto &links = call_tree.get_node_links(call_tree.root);
+	BOOST_REQUIRE_EQUAL( links.size(), 1 );
+	BOOST_CHECK( call_tree.get_node_stop_time(links[0].second) >= call_tree.get_node_start_time(links[0].second) );
+}
+
+BOOST_AUTO_TEST_CASE( flight_recorder_invalid_action_test )
+{
+	int ACTION_READ = react_define_new_action("READ");
+	int ACTION_FIND = react_define_new_action("FIND");
+	handle_aggregator_t aggregator;
+	boost::test_tools::output_test_stream output;
+
+	react_activate_flight_recorder(&aggregator, 0);
+	react_start_action(ACTION_READ);
+	{
+		cerr_redirect guard(output.rdbuf());
+		BOOST_CHECK_EQUAL( react_start_action(-1), -EINVAL );
+		BOOST_CHECK_EQUAL( react_stop_action(ACTION_FIND), -EINVAL );
+		BOOST_CHECK_THROW( react::action_guard(-1), std::invalid_argument );
+	}
+	BOOST_CHECK( !output.is_empty() );
+	react_stop_action(ACTION_READ);
+	{
+		cerr_redirect guard(output.rdbuf());
+		BOOST_CHECK_EQUAL( react_stop_action(ACTION_READ), -EINVAL );
+	}
+
+	// Rejected events are not recorded, so request tree is still built
+	BOOST_CHECK_EQUAL( react_deactivate(), 0 );
+	BOOST_REQUIRE_EQUAL( aggregator.handles.size(), 1 );
+	const react::call_tree_t &call_tree = *aggregator.handles[0];
+	const auto &root_links = call_tree.get_node_links(call_tree.root);
+	BOOST_REQUIRE_EQUAL( root_links.size(), 1 );
+	BOOST_CHECK_EQUAL( root_links[0].first, ACTION_READ );
+	BOOST_CHECK( call_tree.get_node_links(root_links[0].second).empty() );
+}
+
 BOOST_AUTO_TEST_CASE( get_actions_set_test )
 {
 	int action_code = react_define_new_action("ACTION");
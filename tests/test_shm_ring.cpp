@@ -0,0 +1,158 @@
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "tests.hpp"
+
+#include "react/shm_ring.hpp"
+#include "react/tree_codec.hpp"
+
+BOOST_AUTO_TEST_SUITE( shm_ring_suite )
+
+using namespace react;
+
+std::string segment_name(const std::string &suffix) {
+	return "/react_shm_ring_test_" + std::to_string(static_cast<long long>(getpid())) + "_" + suffix;
+}
+
+BOOST_AUTO_TEST_CASE( tree_codec_test )
+{
+	actions_set_t actions_set;
+	int ACTION_READ = actions_set.define_new_action("READ");
+	int ACTION_FIND = actions_set.define_new_action("FIND");
+	call_tree_t call_tree(actions_set);
+	call_tree_t::p_node_t read = call_tree.add_new_link(call_tree.root, ACTION_READ);
+	call_tree.set_node_start_time(read, 100);
+	call_tree.set_node_stop_time(read, 1100);
+	call_tree_t::p_node_t find = call_tree.add_new_link(read, ACTION_FIND);
+	call_tree.set_node_start_time(find, 110);
+	call_tree.set_node_stop_time(find, 200);
+	call_tree.add_stat("complete", true);
+	call_tree.add_stat("size", 42);
+	call_tree.add_stat("ratio", 0.5);
+	call_tree.add_stat("id", "tree");
+
+	std::string record;
+	tree_codec_t::encode(call_tree, record);
+
+	actions_set_t decoded_actions_set;
+	decoded_actions_set.define_new_action("FIND");
+	call_tree_t decoded = tree_codec_t::decode(record.data(), record.size(), decoded_actions_set);
+
+	BOOST_CHECK_EQUAL( decoded.get_stat<bool>("complete"), true );
+	BOOST_CHECK_EQUAL( decoded.get_stat<int>("size"), 42 );
+	BOOST_CHECK_EQUAL( decoded.get_stat<double>("ratio"), 0.5 );
+	BOOST_CHECK_EQUAL( decoded.get_stat<std::string>("id"), "tree" );
+
+	std::string expected_json = print_json_to_string(call_tree);
+	std::string decoded_json = print_json_to_string(decoded);
+	BOOST_CHECK_EQUAL( decoded_json.substr(decoded_json.find("\"actions\"")),
+					   expected_json.substr(expected_json.find("\"actions\"")) );
+
+	BOOST_CHECK_THROW( tree_codec_t::decode(record.data(), record.size() - 1, decoded_actions_set),
+					   std::runtime_error );
+}
+
+BOOST_AUTO_TEST_CASE( shm_ring_read_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	call_tree_t call_tree(actions_set);
+	call_tree.add_new_link(call_tree.root, action_code);
+
+	std::string name = segment_name("read");
+	shm_ring_aggregator_t aggregator(name, 4, 256);
+	shm_ring_reader_t reader(name);
+
+	BOOST_CHECK( !reader.read_call_tree() );
+
+	for (int i = 0; i < 3; ++i) {
+		call_tree.add_stat("id", i);
+		aggregator.aggregate(call_tree);
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		std::unique_ptr<call_tree_t> tree = reader.read_call_tree();
+		BOOST_REQUIRE( tree );
+		BOOST_CHECK_EQUAL( tree->get_stat<int>("id"), i );
+		BOOST_CHECK_EQUAL( tree->get_actions_set().get_action_name(
+							   tree->get_node_links(tree->root).front().first), "ACTION" );
+	}
+	BOOST_CHECK( !reader.read_call_tree() );
+	BOOST_CHECK_EQUAL( reader.get_lost_count(), 0 );
+	BOOST_CHECK_EQUAL( aggregator.get_written_count(), 3 );
+	BOOST_CHECK_EQUAL( aggregator.get_overruns_count(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( shm_ring_overrun_test )
+{
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+
+	std::string name = segment_name("overrun");
+	shm_ring_aggregator_t aggregator(name, 4, 64);
+	shm_ring_reader_t reader(name);
+
+	for (int i = 0; i < 10; ++i) {
+		call_tree.add_stat("id", i);
+		aggregator.aggregate(call_tree);
+	}
+
+	call_tree.add_stat("id", std::string(128, 'x'));
+	aggregator.aggregate(call_tree);
+
+	BOOST_CHECK_EQUAL( aggregator.get_written_count(), 10 );
+	BOOST_CHECK_EQUAL( aggregator.get_overruns_count(), 6 );
+	BOOST_CHECK_EQUAL( aggregator.get_dropped_count(), 1 );
+
+	for (int i = 6; i < 10; ++i) {
+		std::unique_ptr<call_tree_t> tree = reader.read_call_tree();
+		BOOST_REQUIRE( tree );
+		BOOST_CHECK_EQUAL( tree->get_stat<int>("id"), i );
+	}
+	BOOST_CHECK( !reader.read_call_tree() );
+	BOOST_CHECK_EQUAL( reader.get_lost_count(), 6 );
+	BOOST_CHECK_EQUAL( reader.get_dropped_count(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( shm_ring_concurrent_writers_test )
+{
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+
+	std::string name = segment_name("concurrent");
+	shm_ring_aggregator_t aggregator(name, 2, 64);
+	shm_ring_reader_t reader(name);
+
+	std::vector<std::thread> writers;
+	for (int i = 0; i < 4; ++i) {
+		writers.emplace_back([&] () {
+			for (int j = 0; j < 10000; ++j) {
+				aggregator.aggregate(call_tree);
+			}
+		});
+	}
+
+	uint64_t read_count = 0;
+	std::string record;
+	for (auto it = writers.begin(); it != writers.end(); ++it) {
+		while (reader.read_record(record)) {
+			++read_count;
+		}
+		it->join();
+	}
+
+	// Slots dropped by lapped writers must not stall the reader
+	while (reader.read_record(record)) {
+		++read_count;
+	}
+	BOOST_CHECK_EQUAL( read_count + reader.get_lost_count(), aggregator.get_written_count() );
+}
+
+BOOST_AUTO_TEST_CASE( shm_ring_open_error_test )
+{
+	BOOST_CHECK_THROW( shm_ring_reader_t reader(segment_name("missing")), std::runtime_error );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
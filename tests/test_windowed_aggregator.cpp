@@ -0,0 +1,55 @@
+#include "tests.hpp"
+
+#include "react/windowed_aggregator.hpp"
+
+BOOST_AUTO_TEST_SUITE( windowed_aggregator_suite )
+
+using namespace react;
+
+const int64_t SECOND = 1000000;
+
+void add_action(call_tree_t &call_tree, int action_code, int64_t start_time, int64_t duration) {
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree.set_node_start_time(node, start_time);
+	call_tree.set_node_stop_time(node, start_time + duration);
+}
+
+BOOST_AUTO_TEST_CASE( windowed_aggregator_test )
+{
+	actions_set_t actions_set;
+	int ACTION_READ = actions_set.define_new_action("READ");
+	int ACTION_WRITE = actions_set.define_new_action("WRITE");
+
+	windowed_aggregator_t aggregator(actions_set, 1, 4);
+
+	for (int64_t second = 100; second < 106; ++second) {
+		call_tree_t call_tree(actions_set);
+		for (int i = 0; i < 10; ++i) {
+			add_action(call_tree, ACTION_READ, second * SECOND + i, 100 * (second - 99));
+		}
+		add_action(call_tree, ACTION_WRITE, second * SECOND, 5);
+		aggregator.aggregate(call_tree);
+	}
+
+	histogram_t last_two = aggregator.get_histogram(ACTION_READ, 2, 105 * SECOND + 500);
+	BOOST_CHECK_EQUAL( last_two.get_count(), 20 );
+	BOOST_CHECK_EQUAL( last_two.get_min(), 500 );
+
+	histogram_t all = aggregator.get_histogram(ACTION_READ, 100, 105 * SECOND);
+	BOOST_CHECK_EQUAL( all.get_count(), 40 );
+	BOOST_CHECK_EQUAL( all.get_min(), 300 );
+	BOOST_CHECK_EQUAL( aggregator.get_histogram(ACTION_WRITE, 100, 105 * SECOND).get_count(), 4 );
+
+	call_tree_t old_tree(actions_set);
+	add_action(old_tree, ACTION_READ, 101 * SECOND, 1);
+	aggregator.aggregate(old_tree);
+	BOOST_CHECK_EQUAL( aggregator.get_dropped_count(), 1 );
+
+	std::string json = print_json_to_string(aggregator);
+	BOOST_CHECK( json.find("\"READ\"") != std::string::npos );
+	BOOST_CHECK( json.find("\"timestamp\": 102000") < json.find("\"timestamp\": 105000") );
+	BOOST_CHECK( json.find("\"timestamp\": 101000") == std::string::npos );
+	BOOST_CHECK( json.find("\"calls\": 10") != std::string::npos );
+}
+
+BOOST_AUTO_TEST_SUITE_END()